@@ -111,7 +111,7 @@ int uart_console_probe_from_dtb(uart_console_info_t *info)
 
     err = dtb_chosen_stdout(&node);
     if (!err) {
-        err = dtb_decode_reg(node, 0, &base, &size);
+        err = dtb_decode_reg_cpu(node, 0, &base, &size);
         if (err)
             node = -1;
     }
@@ -158,17 +158,32 @@ int uart_console_set_backend(const uart_console_backend_t *backend)
 
 int uart_console_init_from_dtb(void)
 {
+    uart_console_info_t info;
     int err;
 
     g_uart_console_ready = 0;
     uart_console_set_defaults(&g_uart_console_info);
-    if (!g_uart_console_backend)
-        g_uart_console_backend = &g_ns16550a_backend;
 
-    err = uart_console_probe_from_dtb(&g_uart_console_info);
+    err = uart_console_probe_from_dtb(&info);
     if (err)
         return err;
 
+    return uart_console_init_from_info(&info);
+}
+
+int uart_console_init_from_info(const uart_console_info_t *info)
+{
+    int err;
+
+    if (!info)
+        return UART_CONSOLE_ERR_BADVALUE;
+
+    g_uart_console_ready = 0;
+    if (!g_uart_console_backend)
+        g_uart_console_backend = &g_ns16550a_backend;
+
+    g_uart_console_info = *info;
+
     err = g_uart_console_backend->init_from_info(&g_uart_console_info);
     if (err)
         return UART_CONSOLE_ERR_UART_INIT_FAILED;
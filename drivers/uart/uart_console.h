@@ -41,6 +41,7 @@ enum {
 int uart_console_set_backend(const uart_console_backend_t *backend);
 int uart_console_probe_from_dtb(uart_console_info_t *info);
 int uart_console_init_from_dtb(void);
+int uart_console_init_from_info(const uart_console_info_t *info);
 int uart_console_is_ready(void);
 const uart_console_info_t *uart_console_info(void);
 void uart_console_dump_info(void);
@@ -0,0 +1,351 @@
+#include <stdint.h>
+#include <uart/uart_console.h>
+#include <hart.h>
+#include <spinlock.h>
+#include <kmalloc.h>
+#include <csr.h>
+#include <tlb.h>
+#include <shootdown.h>
+#include <asid.h>
+
+#define ASID_WORD_BITS 64
+
+/**
+ * Liczniki alokatora. fast to przełączenia bez blokady (ASID z bieżącej generacji),
+ * slow to przełączenia pod blokadą, allocs to nowe ASID, flushes to pełne
+ * unieważnienia lokalnego TLB (po przejściu generacji albo bez ASID).
+ */
+typedef struct {
+    uint64_t fast;
+    uint64_t slow;
+    uint64_t allocs;
+    uint64_t rollovers;
+    uint64_t flushes;
+} asid_stats_t;
+
+/*
+ * g_asid_generation jest wielokrotnością g_asid_count, więc id = generacja | ASID.
+ * g_asid_map to zajęte ASID bieżącej generacji. Per hart: active - id, z którym
+ * hart teraz działa (0 w trakcie przejścia generacji), reserved - id, które hart
+ * miał przy ostatnim przejściu (dalej jest w jego TLB, więc nie można go oddać
+ * komu innemu), flush_pending - hart musi wyczyścić TLB przed użyciem nowej generacji.
+ */
+static uint32_t g_asid_bits;
+static uint64_t g_asid_count;
+static uint64_t g_asid_generation;
+static uint64_t *g_asid_map;
+static uint64_t *g_asid_active;
+static uint64_t *g_asid_reserved;
+static uint32_t *g_asid_flush_pending;
+static uint64_t g_asid_next;
+static uint32_t g_asid_harts;
+static spinlock_t g_asid_lock = SPINLOCK_INIT;
+static int g_asid_ready;
+static asid_stats_t g_asid_stats;
+
+static void asid_stat_add(uint64_t *counter)
+{
+    __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+static uint64_t asid_of(uint64_t id)
+{
+    return id & (g_asid_count - 1ULL);
+}
+
+static int asid_same_generation(uint64_t id)
+{
+    return id && !((id ^ __atomic_load_n(&g_asid_generation, __ATOMIC_RELAXED)) >> g_asid_bits);
+}
+
+static void asid_map_set(uint64_t asid)
+{
+    g_asid_map[asid / ASID_WORD_BITS] |= 1ULL << (asid % ASID_WORD_BITS);
+}
+
+/**
+ * Sprawdza szerokość pola ASID: zapis samych jedynek zostawia w satp tylko
+ * zaimplementowane bity. Wymaga włączonego stronicowania (mapowania jądra są
+ * globalne, więc chwilowa zmiana ASID jest bezpieczna).
+ * @return Liczba bitów ASID (0..16)
+ */
+static uint32_t asid_probe_bits(void)
+{
+    uint64_t satp;
+    uint64_t probe;
+
+    if (!vm_enabled())
+        return 0;
+
+    satp = csr_read_satp();
+    csr_write_satp(satp | (SATP_ASID_MASK << SATP_ASID_SHIFT));
+    probe = csr_read_satp();
+    csr_write_satp(satp);
+    sfence_vma_all();
+
+    return (uint32_t)__builtin_popcountll((probe >> SATP_ASID_SHIFT) & SATP_ASID_MASK);
+}
+
+/**
+ * Sprawdza szerokość ASID i tworzy bitmapę ASID oraz tablice per hart (z kmalloc).
+ * Bez ASID (albo bez stronicowania, albo gdy ASID jest za mało na liczbę hartów)
+ * każde przełączenie czyści cały TLB.
+ * @param hw Stan sprzętowy z init_dtb (cpu_count)
+ * @return 0 jeśli sukces, ASID_ERR_* w przeciwnym razie
+ */
+int asid_init(const hw_state_t *hw)
+{
+    uint64_t words;
+    uint64_t i;
+
+    if (!hw || hw->cpu_count <= 0)
+        return ASID_ERR_BADVALUE;
+
+    /*
+     * Po przejściu każdy hart może trzymać zarezerwowany ASID, więc bez co najmniej
+     * jednego ASID ponad cpu_count (i ASID_KERNEL) asid_find_free zwróciłby 0
+     * i kontekst dostałby ASID jądra. Wtedy ASID nie dają zysku: ścieżka bez ASID.
+     */
+    g_asid_bits = asid_probe_bits();
+    if (g_asid_bits && (uint64_t)hw->cpu_count >= (1ULL << g_asid_bits) - 1ULL)
+        g_asid_bits = 0;
+    g_asid_count = 1ULL << g_asid_bits;
+    g_asid_generation = g_asid_count;
+    g_asid_next = 1;
+    g_asid_harts = (uint32_t)hw->cpu_count;
+
+    words = (g_asid_count + ASID_WORD_BITS - 1) / ASID_WORD_BITS;
+    g_asid_map = kmalloc(words * sizeof(uint64_t));
+    g_asid_active = kmalloc(g_asid_harts * sizeof(uint64_t));
+    g_asid_reserved = kmalloc(g_asid_harts * sizeof(uint64_t));
+    g_asid_flush_pending = kmalloc(g_asid_harts * sizeof(uint32_t));
+    if (!g_asid_map || !g_asid_active || !g_asid_reserved || !g_asid_flush_pending)
+        return ASID_ERR_NO_MEMORY;
+
+    for (i = 0; i < words; i++)
+        g_asid_map[i] = 0;
+    for (i = 0; i < g_asid_harts; i++) {
+        g_asid_active[i] = 0;
+        g_asid_reserved[i] = 0;
+        g_asid_flush_pending[i] = 0;
+    }
+    asid_map_set(ASID_KERNEL);
+
+    g_asid_ready = 1;
+    return 0;
+}
+
+/**
+ * Zwraca liczbę zaimplementowanych bitów ASID (0 przed asid_init albo bez ASID).
+ */
+uint32_t asid_bits(void)
+{
+    return g_asid_bits;
+}
+
+/**
+ * Zaczyna nową generację: czyści bitmapę, zostawiając ASID, z którymi harty
+ * działają (albo działały przy poprzednim przejściu), i każe każdemu hartowi
+ * jednorazowo wyczyścić TLB przy najbliższym przełączeniu. Pod g_asid_lock.
+ */
+static void asid_rollover(void)
+{
+    uint64_t words = (g_asid_count + ASID_WORD_BITS - 1) / ASID_WORD_BITS;
+    uint64_t i;
+
+    __atomic_store_n(&g_asid_generation, g_asid_generation + g_asid_count, __ATOMIC_RELAXED);
+
+    for (i = 0; i < words; i++)
+        g_asid_map[i] = 0;
+    asid_map_set(ASID_KERNEL);
+
+    for (i = 0; i < g_asid_harts; i++) {
+        uint64_t id = __atomic_exchange_n(&g_asid_active[i], 0, __ATOMIC_RELAXED);
+
+        /* active == 0: hart nie przełączał się od poprzedniego przejścia */
+        if (!id)
+            id = g_asid_reserved[i];
+        if (id)
+            asid_map_set(asid_of(id));
+        g_asid_reserved[i] = id;
+        g_asid_flush_pending[i] = 1;
+    }
+
+    g_asid_next = 1;
+    asid_stat_add(&g_asid_stats.rollovers);
+}
+
+/**
+ * Szuka wolnego ASID od g_asid_next do końca, potem od 1.
+ * @return ASID albo 0, gdy bieżąca generacja jest pełna
+ */
+static uint64_t asid_find_free(void)
+{
+    uint64_t pass;
+    uint64_t asid;
+
+    for (pass = 0; pass < 2; pass++) {
+        uint64_t from = pass ? 1 : g_asid_next;
+        uint64_t to = pass ? g_asid_next : g_asid_count;
+
+        for (asid = from; asid < to; asid++) {
+            uint64_t word = g_asid_map[asid / ASID_WORD_BITS];
+
+            if (word == ~0ULL) {
+                asid |= ASID_WORD_BITS - 1;
+                continue;
+            }
+            if (!(word & (1ULL << (asid % ASID_WORD_BITS))))
+                return asid;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Nadaje kontekstowi id w bieżącej generacji. Pod g_asid_lock.
+ * Poprzedni ASID jest zachowywany, jeśli jest zarezerwowany przez któryś hart
+ * (ten sam kontekst działał tam przy przejściu) albo wciąż wolny.
+ * @param old Poprzednie id kontekstu (0 = brak)
+ * @return Nowe id
+ */
+static uint64_t asid_new_context(uint64_t old)
+{
+    uint64_t generation = g_asid_generation;
+    uint64_t asid = asid_of(old);
+    int reserved = 0;
+    uint32_t i;
+
+    if (old) {
+        for (i = 0; i < g_asid_harts; i++) {
+            if (g_asid_reserved[i] == old) {
+                g_asid_reserved[i] = generation | asid;
+                reserved = 1;
+            }
+        }
+        if (reserved)
+            return generation | asid;
+
+        if (!(g_asid_map[asid / ASID_WORD_BITS] & (1ULL << (asid % ASID_WORD_BITS)))) {
+            asid_map_set(asid);
+            return generation | asid;
+        }
+    }
+
+    asid = asid_find_free();
+    if (!asid) {
+        asid_rollover();
+        generation = g_asid_generation;
+        asid = asid_find_free();
+    }
+
+    asid_map_set(asid);
+    g_asid_next = asid + 1;
+    asid_stat_add(&g_asid_stats.allocs);
+    return generation | asid;
+}
+
+/**
+ * Wybiera ASID dla kontekstu na bieżącym harcie.
+ * @param ctx Kontekst
+ * @param asid ASID do zapisu w satp (wyjście)
+ * @return 1 jeśli po zapisie satp trzeba wyczyścić lokalny TLB, 0 w przeciwnym razie
+ */
+static int asid_acquire(asid_ctx_t *ctx, uint32_t *asid)
+{
+    uint32_t self = hart_index();
+    uint64_t id;
+    uint64_t old;
+    int flush = 0;
+
+    if (!g_asid_bits || self >= g_asid_harts) {
+        *asid = ASID_KERNEL;
+        return 1;
+    }
+
+    /*
+     * Szybka ścieżka: id z bieżącej generacji. cmpxchg na active nie przejdzie,
+     * jeśli asid_rollover właśnie wyzerował active tego harta - wtedy ścieżka wolna.
+     */
+    id = __atomic_load_n(&ctx->id, __ATOMIC_RELAXED);
+    old = __atomic_load_n(&g_asid_active[self], __ATOMIC_RELAXED);
+    if (old && asid_same_generation(id) &&
+        __atomic_compare_exchange_n(&g_asid_active[self], &old, id, 0,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        asid_stat_add(&g_asid_stats.fast);
+        *asid = (uint32_t)asid_of(id);
+        return 0;
+    }
+
+    spin_lock(&g_asid_lock);
+    id = ctx->id;
+    if (!asid_same_generation(id)) {
+        id = asid_new_context(id);
+        __atomic_store_n(&ctx->id, id, __ATOMIC_RELAXED);
+    }
+    if (g_asid_flush_pending[self]) {
+        g_asid_flush_pending[self] = 0;
+        flush = 1;
+    }
+    __atomic_store_n(&g_asid_active[self], id, __ATOMIC_RELAXED);
+    spin_unlock(&g_asid_lock);
+
+    asid_stat_add(&g_asid_stats.slow);
+    *asid = (uint32_t)asid_of(id);
+    return flush;
+}
+
+/**
+ * Przełącza bieżący hart na tablice root z ASID kontekstu. TLB jest czyszczony
+ * tylko raz na generację (po przejściu) albo przy każdym przełączeniu, gdy
+ * sprzęt nie ma ASID; w pozostałych przypadkach wpisy innych przestrzeni zostają.
+ * @param ctx Kontekst przestrzeni adresowej
+ * @param root Tablica najwyższego poziomu tej przestrzeni
+ * @return 0 jeśli sukces, ASID_ERR_* w przeciwnym razie
+ */
+int asid_switch(asid_ctx_t *ctx, const pte_t *root)
+{
+    uint32_t asid;
+    int flush;
+
+    if (!ctx || !root)
+        return ASID_ERR_BADVALUE;
+    if (!g_asid_ready)
+        return ASID_ERR_NOT_READY;
+
+    flush = asid_acquire(ctx, &asid);
+    shootdown_note_asid(asid);
+    csr_write_satp(vm_satp(root, asid));
+    if (flush) {
+        tlb_flush_all();
+        asid_stat_add(&g_asid_stats.flushes);
+    }
+
+    return 0;
+}
+
+/**
+ * Wyświetla szerokość ASID, generację i liczniki alokatora.
+ */
+void asid_dump(void)
+{
+    if (!uart_console_is_ready())
+        return;
+
+    uart_console_puts("[asid] bits=");
+    uart_console_put_dec_u64(g_asid_bits);
+    uart_console_puts(" generation=");
+    uart_console_put_dec_u64(g_asid_generation >> g_asid_bits);
+    uart_console_puts(" allocs=");
+    uart_console_put_dec_u64(g_asid_stats.allocs);
+    uart_console_puts(" rollovers=");
+    uart_console_put_dec_u64(g_asid_stats.rollovers);
+    uart_console_puts(" fast=");
+    uart_console_put_dec_u64(g_asid_stats.fast);
+    uart_console_puts(" slow=");
+    uart_console_put_dec_u64(g_asid_stats.slow);
+    uart_console_puts(" flushes=");
+    uart_console_put_dec_u64(g_asid_stats.flushes);
+    uart_console_puts("\n");
+}
@@ -0,0 +1,33 @@
+#ifndef KERNEL_ASID_H
+#define KERNEL_ASID_H
+
+#include <stdint.h>
+#include <platform_init.h>
+#include <vm.h>
+
+/* ASID tablic jądra; nigdy nie jest przydzielany przestrzeniom adresowym */
+#define ASID_KERNEL 0
+
+enum {
+    ASID_ERR_BADVALUE = -14000,
+    ASID_ERR_NOT_READY,
+    ASID_ERR_NO_MEMORY,
+};
+
+/**
+ * ASID przestrzeni adresowej: generacja w bitach od asid_bits() wzwyż, ASID
+ * w dolnych asid_bits(); 0 = jeszcze nie przydzielony. ASID z poprzedniej
+ * generacji jest nieważny i przy następnym przełączeniu dostaje nowy.
+ */
+typedef struct {
+    uint64_t id;
+} asid_ctx_t;
+
+#define ASID_CTX_INIT { 0 }
+
+int asid_init(const hw_state_t *hw);
+uint32_t asid_bits(void);
+int asid_switch(asid_ctx_t *ctx, const pte_t *root);
+void asid_dump(void);
+
+#endif
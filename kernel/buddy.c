@@ -0,0 +1,574 @@
+#include <stdint.h>
+#include <memory_map.h>
+#include <frame_alloc.h>
+#include <spinlock.h>
+#include <buddy.h>
+
+#define BUDDY_ORDERS     (BUDDY_MAX_ORDER + 1)
+#define BUDDY_PAGE_FREE  0x80   /* Głowa wolnego bloku; niższe bity to rząd */
+#define BUDDY_PAGE_ALLOC 0x40   /* Głowa przydzielonego bloku; niższe bity to rząd */
+
+/**
+ * Węzeł listy wolnych bloków, zapisany w pierwszej stronie samego bloku.
+ */
+typedef struct buddy_block {
+    struct buddy_block *next;
+    struct buddy_block *prev;
+} buddy_block_t;
+
+/* Głowy (wartowniki) list wolnych bloków, po jednej na rząd */
+static buddy_block_t g_buddy_free[BUDDY_ORDERS];
+
+/**
+ * Strefa: jeden wolny region mapy pamięci i bajty stanu jego stron. Osobna tablica
+ * na region sprawia, że dziury między regionami (MMIO, rezerwacje) nie kosztują
+ * metadanych; bloki nigdy nie przekraczają granicy strefy.
+ */
+typedef struct {
+    uint64_t base;      /* Adres fizyczny pierwszej strony */
+    uint64_t pages;     /* Liczba stron */
+    uint8_t *state;     /* Bajt stanu na stronę */
+} buddy_zone_t;
+
+static buddy_zone_t *g_buddy_zones;
+static int g_buddy_zone_count;
+static mm_buddy_stats_t *g_buddy_stats;
+static int g_buddy_ready;
+
+/*
+ * Blokada całego stanu buddy (listy, bajty stanu stron, statystyki). Biorą ją
+ * wszystkie publiczne wejścia, więc frame_alloc*, page_cache i buddy_block_of
+ * (kfree, kmem_cache_of) widzą spójny stan niezależnie od tego, kto woła.
+ */
+static spinlock_t g_buddy_lock = SPINLOCK_INIT;
+
+/**
+ * Rozmiar bloku danego rzędu w bajtach.
+ * @param order Rząd bloku
+ * @return 2^order stron w bajtach
+ */
+static uint64_t buddy_block_size(int order)
+{
+    return BUDDY_PAGE_SIZE << order;
+}
+
+/**
+ * Sprawdza, czy count stron od pa leży w strefie.
+ * @param z Strefa
+ * @param pa Adres fizyczny pierwszej strony
+ * @param count Liczba stron
+ * @return 1 jeśli leży, 0 w przeciwnym razie
+ */
+static int buddy_zone_owns(const buddy_zone_t *z, uint64_t pa, uint64_t count)
+{
+    uint64_t first;
+
+    if (pa < z->base)
+        return 0;
+    first = (pa - z->base) / BUDDY_PAGE_SIZE;
+    return first < z->pages && count <= z->pages - first;
+}
+
+/**
+ * Znajduje strefę zawierającą stronę (strefy są posortowane, wyszukiwanie binarne).
+ * @param pa Adres fizyczny strony
+ * @return Strefa albo 0, gdy strona nie należy do buddy
+ */
+static buddy_zone_t *buddy_zone_of(uint64_t pa)
+{
+    int lo = 0;
+    int hi = g_buddy_zone_count - 1;
+
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        buddy_zone_t *z = &g_buddy_zones[mid];
+
+        if (pa < z->base)
+            hi = mid - 1;
+        else if ((pa - z->base) / BUDDY_PAGE_SIZE >= z->pages)
+            lo = mid + 1;
+        else
+            return z;
+    }
+
+    return 0;
+}
+
+/**
+ * Zwraca bajt stanu strony.
+ * @param z Strefa strony
+ * @param pa Adres fizyczny strony (musi należeć do z)
+ * @return Wskaźnik do bajtu stanu
+ */
+static uint8_t *buddy_page_state(const buddy_zone_t *z, uint64_t pa)
+{
+    return &z->state[(pa - z->base) / BUDDY_PAGE_SIZE];
+}
+
+/**
+ * Dokłada wolny blok na początek listy swojego rzędu.
+ * @param z Strefa bloku
+ * @param pa Adres fizyczny bloku
+ * @param order Rząd bloku
+ */
+static void buddy_push(const buddy_zone_t *z, uint64_t pa, int order)
+{
+    buddy_block_t *head = &g_buddy_free[order];
+    buddy_block_t *block = (buddy_block_t *)(uintptr_t)pa;
+
+    block->next = head->next;
+    block->prev = head;
+    head->next->prev = block;
+    head->next = block;
+
+    *buddy_page_state(z, pa) = (uint8_t)(BUDDY_PAGE_FREE | order);
+    g_buddy_stats->free_blocks[order]++;
+}
+
+/**
+ * Wyjmuje wolny blok z listy jego rzędu w O(1).
+ * @param z Strefa bloku
+ * @param pa Adres fizyczny bloku
+ * @param order Rząd bloku
+ */
+static void buddy_unlink(const buddy_zone_t *z, uint64_t pa, int order)
+{
+    buddy_block_t *block = (buddy_block_t *)(uintptr_t)pa;
+
+    block->prev->next = block->next;
+    block->next->prev = block->prev;
+
+    *buddy_page_state(z, pa) = 0;
+    g_buddy_stats->free_blocks[order]--;
+}
+
+/**
+ * Oddaje blok do list wolnych, scalając go z wolnym buddy tak długo, jak się da.
+ * Buddy bloku rzędu k to pa ^ (rozmiar bloku); scalenie wymaga, by buddy był
+ * głową wolnego bloku tego samego rzędu w tej samej strefie.
+ * @param z Strefa bloku
+ * @param pa Adres fizyczny bloku
+ * @param order Rząd bloku
+ */
+static void buddy_release(const buddy_zone_t *z, uint64_t pa, int order)
+{
+    while (order < BUDDY_MAX_ORDER) {
+        uint64_t buddy = pa ^ buddy_block_size(order);
+
+        if (!buddy_zone_owns(z, buddy, 1ULL << order) ||
+            *buddy_page_state(z, buddy) != (uint8_t)(BUDDY_PAGE_FREE | order))
+            break;
+
+        buddy_unlink(z, buddy, order);
+        pa &= ~buddy_block_size(order);
+        order++;
+    }
+
+    buddy_push(z, pa, order);
+}
+
+/**
+ * Oddaje dowolny zakres stron jako największe wyrównane bloki (z scalaniem).
+ * @param z Strefa zakresu
+ * @param pa Adres fizyczny pierwszej strony
+ * @param count Liczba stron
+ */
+static void buddy_release_range(const buddy_zone_t *z, uint64_t pa, uint64_t count)
+{
+    g_buddy_stats->free_pages += count;
+
+    while (count) {
+        int order = 0;
+
+        while (order < BUDDY_MAX_ORDER &&
+               !(pa & buddy_block_size(order)) &&
+               (2ULL << order) <= count)
+            order++;
+
+        buddy_release(z, pa, order);
+        pa += buddy_block_size(order);
+        count -= 1ULL << order;
+    }
+}
+
+/**
+ * Callback przekazania pamięci z alokatora ramek (frame_alloc_handover).
+ * Wolne ciągi trafiają do list buddy, zajęte są oznaczane jako przydzielone
+ * strony rzędu 0, więc można je później zwolnić przez buddy_free_pages.
+ * @param pa Adres fizyczny pierwszej ramki ciągu
+ * @param count Liczba ramek
+ * @param used 1 jeśli ramki są zajęte
+ */
+static void buddy_seed_run(uint64_t pa, uint64_t count, int used)
+{
+    const buddy_zone_t *z = buddy_zone_of(pa);
+    uint64_t i;
+
+    if (!z || !buddy_zone_owns(z, pa, count))
+        return;
+
+    g_buddy_stats->managed_pages += count;
+
+    if (!used) {
+        buddy_release_range(z, pa, count);
+        return;
+    }
+
+    for (i = 0; i < count; i++)
+        *buddy_page_state(z, pa + i * BUDDY_PAGE_SIZE) = BUDDY_PAGE_ALLOC;
+}
+
+/**
+ * Inicjalizuje alokator buddy i przejmuje pamięć od alokatora ramek.
+ * Deskryptory stref (po jednej na wolny region) i ich tablice stanu stron (bajt
+ * na stronę regionu, bez dziur między regionami) są przydzielane jednym
+ * frame_alloc_contiguous; potem frame_alloc_handover przekazuje wszystkie ramki,
+ * a frame_alloc* od tej chwili korzysta z buddy.
+ * @return 0 jeśli sukces, BUDDY_ERR_* w przeciwnym razie
+ */
+int buddy_init(void)
+{
+    const mm_state_t *st = mm_state();
+    uint64_t desc_bytes;
+    uint64_t pages = 0;
+    uint64_t meta;
+    uint8_t *state;
+    uint64_t i;
+    int order;
+    int n;
+
+    if (!st || !st->free || st->free_count <= 0)
+        return BUDDY_ERR_NO_MEMORY;
+
+    g_buddy_ready = 0;
+    for (n = 0; n < st->free_count; n++)
+        pages += (st->free[n].end - st->free[n].start) / BUDDY_PAGE_SIZE;
+
+    desc_bytes = (uint64_t)st->free_count * sizeof(buddy_zone_t);
+    if (frame_alloc_contiguous((desc_bytes + pages + BUDDY_PAGE_SIZE - 1ULL) / BUDDY_PAGE_SIZE, &meta))
+        return BUDDY_ERR_NO_MEMORY;
+
+    g_buddy_zones = (buddy_zone_t *)(uintptr_t)meta;
+    state = (uint8_t *)(uintptr_t)(meta + desc_bytes);
+    for (n = 0; n < st->free_count; n++) {
+        buddy_zone_t *z = &g_buddy_zones[n];
+
+        z->base = st->free[n].start;
+        z->pages = (st->free[n].end - st->free[n].start) / BUDDY_PAGE_SIZE;
+        z->state = state;
+        for (i = 0; i < z->pages; i++)
+            z->state[i] = 0;
+        state += z->pages;
+    }
+    g_buddy_zone_count = st->free_count;
+
+    for (order = 0; order < BUDDY_ORDERS; order++) {
+        g_buddy_free[order].next = &g_buddy_free[order];
+        g_buddy_free[order].prev = &g_buddy_free[order];
+    }
+
+    g_buddy_stats = mm_buddy_stats();
+    *g_buddy_stats = (mm_buddy_stats_t){ 0 };
+
+    if (frame_alloc_handover(buddy_seed_run))
+        return BUDDY_ERR_NOT_READY;
+
+    g_buddy_stats->ready = 1;
+    g_buddy_ready = 1;
+    return 0;
+}
+
+/**
+ * Zwraca 1, gdy buddy przejął pamięć od alokatora ramek.
+ */
+int buddy_ready(void)
+{
+    return g_buddy_ready;
+}
+
+/**
+ * Przydziela blok 2^order stron wyrównany do własnego rozmiaru (pod g_buddy_lock).
+ * Bierze najmniejszy niepusty rząd >= order i dzieli go, oddając górne połowy.
+ * @param order Rząd bloku (0..BUDDY_MAX_ORDER)
+ * @param pa Adres fizyczny bloku (wyjście)
+ * @return 0 jeśli sukces, BUDDY_ERR_NO_MEMORY w przeciwnym razie
+ */
+static int buddy_alloc_locked(int order, uint64_t *pa)
+{
+    const buddy_zone_t *z;
+    buddy_block_t *block;
+    uint64_t addr;
+    int o;
+
+    for (o = order; o <= BUDDY_MAX_ORDER; o++) {
+        if (g_buddy_free[o].next != &g_buddy_free[o])
+            break;
+    }
+    if (o > BUDDY_MAX_ORDER)
+        return BUDDY_ERR_NO_MEMORY;
+
+    block = g_buddy_free[o].next;
+    addr = (uint64_t)(uintptr_t)block;
+    z = buddy_zone_of(addr);
+    buddy_unlink(z, addr, o);
+
+    while (o > order) {
+        o--;
+        buddy_push(z, addr + buddy_block_size(o), o);
+    }
+
+    *buddy_page_state(z, addr) = (uint8_t)(BUDDY_PAGE_ALLOC | order);
+    g_buddy_stats->free_pages -= 1ULL << order;
+    *pa = addr;
+    return 0;
+}
+
+/**
+ * Przydziela blok 2^order stron wyrównany do własnego rozmiaru.
+ * @param order Rząd bloku (0..BUDDY_MAX_ORDER)
+ * @param pa Adres fizyczny bloku (wyjście)
+ * @return 0 jeśli sukces, BUDDY_ERR_* w przeciwnym razie
+ */
+int buddy_alloc(int order, uint64_t *pa)
+{
+    int err;
+
+    if (!pa || order < 0 || order > BUDDY_MAX_ORDER)
+        return BUDDY_ERR_BADVALUE;
+    if (!g_buddy_ready)
+        return BUDDY_ERR_NOT_READY;
+
+    spin_lock(&g_buddy_lock);
+    err = buddy_alloc_locked(order, pa);
+    spin_unlock(&g_buddy_lock);
+    return err;
+}
+
+/**
+ * Zwalnia blok rzędu order (pod g_buddy_lock); pa jest już wyrównany do rozmiaru bloku.
+ * @param pa Adres fizyczny bloku
+ * @param order Rząd bloku
+ * @return 0 jeśli sukces, BUDDY_ERR_* w przeciwnym razie
+ */
+static int buddy_free_locked(uint64_t pa, int order)
+{
+    const buddy_zone_t *z = buddy_zone_of(pa);
+    uint8_t state;
+
+    if (!z)
+        return BUDDY_ERR_NOT_OWNED;
+
+    state = *buddy_page_state(z, pa);
+    if (state & BUDDY_PAGE_FREE)
+        return BUDDY_ERR_DOUBLE_FREE;
+    if (state != (uint8_t)(BUDDY_PAGE_ALLOC | order))
+        return BUDDY_ERR_NOT_OWNED;
+
+    *buddy_page_state(z, pa) = 0;
+    g_buddy_stats->free_pages += 1ULL << order;
+    buddy_release(z, pa, order);
+    return 0;
+}
+
+/**
+ * Zwalnia blok przydzielony przez buddy_alloc z tym samym rzędem.
+ * @param pa Adres fizyczny bloku
+ * @param order Rząd bloku
+ * @return 0 jeśli sukces, BUDDY_ERR_* w przeciwnym razie
+ */
+int buddy_free(uint64_t pa, int order)
+{
+    int err;
+
+    if (order < 0 || order > BUDDY_MAX_ORDER || (pa & (buddy_block_size(order) - 1ULL)))
+        return BUDDY_ERR_BADVALUE;
+    if (!g_buddy_ready)
+        return BUDDY_ERR_NOT_READY;
+
+    spin_lock(&g_buddy_lock);
+    err = buddy_free_locked(pa, order);
+    spin_unlock(&g_buddy_lock);
+    return err;
+}
+
+/**
+ * Zwalnia paczkę pojedynczych stron (rząd 0) pod jednym wzięciem blokady;
+ * używane przez magazynki page_cache. Błędne adresy są pomijane.
+ * @param pages Adresy fizyczne stron
+ * @param count Liczba stron
+ * @return Liczba stron, których nie udało się zwolnić
+ */
+uint32_t buddy_free_batch(const uint64_t *pages, uint32_t count)
+{
+    uint32_t failed = 0;
+    uint32_t i;
+
+    if (!pages || !g_buddy_ready)
+        return count;
+
+    spin_lock(&g_buddy_lock);
+    for (i = 0; i < count; i++) {
+        if ((pages[i] & (BUDDY_PAGE_SIZE - 1ULL)) || buddy_free_locked(pages[i], 0))
+            failed++;
+    }
+    spin_unlock(&g_buddy_lock);
+
+    return failed;
+}
+
+/**
+ * Przydziela do count pojedynczych stron (rząd 0) pod jednym wzięciem blokady.
+ * @param pages Tablica na adresy fizyczne (wyjście)
+ * @param count Żądana liczba stron
+ * @return Liczba przydzielonych stron (mniej niż count, gdy brakuje pamięci)
+ */
+uint32_t buddy_alloc_batch(uint64_t *pages, uint32_t count)
+{
+    uint32_t i;
+
+    if (!pages || !g_buddy_ready)
+        return 0;
+
+    spin_lock(&g_buddy_lock);
+    for (i = 0; i < count && !buddy_alloc_locked(0, &pages[i]); i++)
+        ;
+    spin_unlock(&g_buddy_lock);
+
+    return i;
+}
+
+/**
+ * Przydziela count ciągłych stron (dowolna liczba, nie tylko potęga dwójki).
+ * Blok najbliższego rzędu jest dzielony na strony rzędu 0, a nadmiar wraca od razu,
+ * więc nic się nie marnuje i zakres można zwalniać także po kawałku.
+ * @param count Liczba stron
+ * @param pa Adres fizyczny pierwszej strony (wyjście)
+ * @return 0 jeśli sukces, BUDDY_ERR_* w przeciwnym razie
+ */
+int buddy_alloc_pages(uint64_t count, uint64_t *pa)
+{
+    const buddy_zone_t *z;
+    uint64_t addr;
+    uint64_t i;
+    int order = 0;
+    int err;
+
+    if (!pa || !count || count > (1ULL << BUDDY_MAX_ORDER))
+        return BUDDY_ERR_BADVALUE;
+    if (!g_buddy_ready)
+        return BUDDY_ERR_NOT_READY;
+
+    while ((1ULL << order) < count)
+        order++;
+
+    spin_lock(&g_buddy_lock);
+    err = buddy_alloc_locked(order, &addr);
+    if (err) {
+        spin_unlock(&g_buddy_lock);
+        return err;
+    }
+
+    z = buddy_zone_of(addr);
+    for (i = 0; i < count; i++)
+        *buddy_page_state(z, addr + i * BUDDY_PAGE_SIZE) = BUDDY_PAGE_ALLOC;
+
+    if (count < (1ULL << order))
+        buddy_release_range(z, addr + count * BUDDY_PAGE_SIZE, (1ULL << order) - count);
+    spin_unlock(&g_buddy_lock);
+
+    *pa = addr;
+    return 0;
+}
+
+/**
+ * Zwalnia count ciągłych stron przydzielonych przez buddy_alloc_pages (lub przejętych
+ * jako zajęte od alokatora ramek). Wszystkie strony muszą być przydzielone jako rząd 0;
+ * blok z buddy_alloc o dokładnie count stronach też jest akceptowany.
+ * @param pa Adres fizyczny pierwszej strony
+ * @param count Liczba stron
+ * @return 0 jeśli sukces, BUDDY_ERR_* w przeciwnym razie
+ */
+int buddy_free_pages(uint64_t pa, uint64_t count)
+{
+    const buddy_zone_t *z;
+    uint64_t i;
+    int err = 0;
+
+    if (!count || (pa & (BUDDY_PAGE_SIZE - 1ULL)))
+        return BUDDY_ERR_BADVALUE;
+    if (!g_buddy_ready)
+        return BUDDY_ERR_NOT_READY;
+
+    z = buddy_zone_of(pa);
+    if (!z || !buddy_zone_owns(z, pa, count))
+        return BUDDY_ERR_NOT_OWNED;
+
+    spin_lock(&g_buddy_lock);
+    if (!(count & (count - 1ULL)) && count > 1 &&
+        *buddy_page_state(z, pa) == (uint8_t)(BUDDY_PAGE_ALLOC | __builtin_ctzll(count))) {
+        err = buddy_free_locked(pa, __builtin_ctzll(count));
+        spin_unlock(&g_buddy_lock);
+        return err;
+    }
+
+    for (i = 0; i < count && !err; i++) {
+        uint8_t state = *buddy_page_state(z, pa + i * BUDDY_PAGE_SIZE);
+
+        if (state & BUDDY_PAGE_FREE)
+            err = BUDDY_ERR_DOUBLE_FREE;
+        else if (state != BUDDY_PAGE_ALLOC)
+            err = BUDDY_ERR_NOT_OWNED;
+    }
+
+    if (!err) {
+        for (i = 0; i < count; i++)
+            *buddy_page_state(z, pa + i * BUDDY_PAGE_SIZE) = 0;
+        buddy_release_range(z, pa, count);
+    }
+    spin_unlock(&g_buddy_lock);
+
+    return err;
+}
+
+/**
+ * Znajduje przydzielony blok zawierający adres. Bloki są wyrównane do swojego
+ * rozmiaru, więc wystarczy sprawdzić głowę pa wyrównanego w dół dla każdego rzędu.
+ * Stan czytany jest pod g_buddy_lock, więc równoległe dzielenie lub scalanie
+ * sąsiednich bloków nie da fałszywej głowy.
+ * @param pa Adres fizyczny wewnątrz bloku
+ * @param head Adres głowy bloku (wyjście)
+ * @param order Rząd bloku (wyjście)
+ * @return 0 jeśli sukces, BUDDY_ERR_NOT_OWNED gdy pa nie leży w przydzielonym bloku
+ */
+int buddy_block_of(uint64_t pa, uint64_t *head, int *order)
+{
+    const buddy_zone_t *z;
+    uint64_t base;
+    int err = BUDDY_ERR_NOT_OWNED;
+    int o;
+
+    if (!head || !order)
+        return BUDDY_ERR_BADVALUE;
+    if (!g_buddy_ready)
+        return BUDDY_ERR_NOT_READY;
+
+    z = buddy_zone_of(pa);
+    if (!z)
+        return BUDDY_ERR_NOT_OWNED;
+
+    spin_lock(&g_buddy_lock);
+    for (o = 0; o <= BUDDY_MAX_ORDER; o++) {
+        base = pa & ~(buddy_block_size(o) - 1ULL);
+        if (!buddy_zone_owns(z, base, 1))
+            break;
+        if (*buddy_page_state(z, base) == (uint8_t)(BUDDY_PAGE_ALLOC | o)) {
+            *head = base;
+            *order = o;
+            err = 0;
+            break;
+        }
+    }
+    spin_unlock(&g_buddy_lock);
+
+    return err;
+}
@@ -0,0 +1,29 @@
+#ifndef KERNEL_BUDDY_H
+#define KERNEL_BUDDY_H
+
+#include <stdint.h>
+#include <memory_map.h>
+
+/* Rozmiar strony zarządzanej przez buddy (Sv39, 4KB) */
+#define BUDDY_PAGE_SIZE 0x1000ULL
+#define BUDDY_MAX_ORDER MM_BUDDY_MAX_ORDER
+
+enum {
+    BUDDY_ERR_BADVALUE = -8000,
+    BUDDY_ERR_NOT_READY,
+    BUDDY_ERR_NO_MEMORY,
+    BUDDY_ERR_NOT_OWNED,
+    BUDDY_ERR_DOUBLE_FREE,
+};
+
+int buddy_init(void);
+int buddy_ready(void);
+int buddy_alloc(int order, uint64_t *pa);
+int buddy_free(uint64_t pa, int order);
+int buddy_alloc_pages(uint64_t count, uint64_t *pa);
+int buddy_free_pages(uint64_t pa, uint64_t count);
+uint32_t buddy_alloc_batch(uint64_t *pages, uint32_t count);
+uint32_t buddy_free_batch(const uint64_t *pages, uint32_t count);
+int buddy_block_of(uint64_t pa, uint64_t *head, int *order);
+
+#endif
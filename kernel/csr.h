@@ -0,0 +1,80 @@
+#ifndef KERNEL_CSR_H
+#define KERNEL_CSR_H
+
+#include <stdint.h>
+
+/* Pola rejestru satp (RV64): MODE[63:60], ASID[59:44], PPN[43:0] */
+#define SATP_MODE_SHIFT 60
+#define SATP_MODE_BARE  0ULL
+#define SATP_MODE_SV39  8ULL
+#define SATP_MODE_SV48  9ULL
+#define SATP_MODE_SV57  10ULL
+#define SATP_ASID_SHIFT 44
+#define SATP_ASID_MASK  0xFFFFULL
+#define SATP_PPN_MASK   ((1ULL << 44) - 1ULL)
+
+static inline uint64_t csr_read_satp(void)
+{
+    uint64_t value;
+
+    asm volatile("csrr %0, satp" : "=r"(value));
+    return value;
+}
+
+static inline void csr_write_satp(uint64_t value)
+{
+    asm volatile("csrw satp, %0" : : "r"(value) : "memory");
+}
+
+/* Unieważnia wszystkie wpisy TLB bieżącego harta */
+static inline void sfence_vma_all(void)
+{
+    asm volatile("sfence.vma" : : : "memory");
+}
+
+/* Unieważnia wpisy dla adresu va we wszystkich ASID (także globalne) */
+static inline void sfence_vma_va(uint64_t va)
+{
+    asm volatile("sfence.vma %0, zero" : : "r"(va) : "memory");
+}
+
+/* Unieważnia nieglobalne wpisy danego ASID */
+static inline void sfence_vma_asid(uint64_t asid)
+{
+    asm volatile("sfence.vma zero, %0" : : "r"(asid) : "memory");
+}
+
+/* Unieważnia nieglobalne wpisy dla adresu va w danym ASID */
+static inline void sfence_vma_va_asid(uint64_t va, uint64_t asid)
+{
+    asm volatile("sfence.vma %0, %1" : : "r"(va), "r"(asid) : "memory");
+}
+
+/*
+ * Svinval: sinval.vma działa jak sfence.vma bez bariery; partię unieważnień
+ * otaczają sfence.w.inval (wcześniejsze zapisy PTE przed unieważnieniami)
+ * i sfence.inval.ir (unieważnienia przed kolejnymi dostępami). Instrukcje są
+ * kodowane ręcznie (.word/.insn), żeby nie wymagać asemblera znającego rozszerzenie.
+ */
+static inline void sfence_w_inval(void)
+{
+    asm volatile(".word 0x18000073" : : : "memory");
+}
+
+static inline void sfence_inval_ir(void)
+{
+    asm volatile(".word 0x18100073" : : : "memory");
+}
+
+/* rs2 = x0 oznacza wszystkie ASID, tak jak w sfence.vma */
+static inline void sinval_vma(uint64_t va, uint64_t asid)
+{
+    asm volatile(".insn r 0x73, 0, 0x0b, x0, %0, %1" : : "r"(va), "r"(asid) : "memory");
+}
+
+static inline void sinval_vma_va(uint64_t va)
+{
+    asm volatile(".insn r 0x73, 0, 0x0b, x0, %0, x0" : : "r"(va) : "memory");
+}
+
+#endif
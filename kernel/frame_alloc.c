@@ -0,0 +1,558 @@
+#include <stdint.h>
+#include <uart/uart_console.h>
+#include <memory_map.h>
+#include <frame_alloc.h>
+#include <buddy.h>
+
+#define FRAME_BITS_PER_WORD 64ULL
+#define FRAME_WORD_FULL     (~0ULL)
+
+/**
+ * Jeden ciągły wolny region z mapy pamięci i jego fragment bitmapy.
+ * Bit 1 oznacza ramkę zajętą; bity za ostatnią ramką w ostatnim słowie są
+ * ustawione na stałe, więc skanowanie nie musi sprawdzać granicy regionu.
+ */
+typedef struct {
+    uint64_t base;       /* Adres fizyczny pierwszej ramki */
+    uint64_t frames;     /* Liczba ramek w regionie */
+    uint64_t *bitmap;    /* Słowa bitmapy regionu */
+    uint64_t words;      /* Liczba słów bitmapy */
+    uint64_t cursor;     /* Next-fit: słowo, od którego zaczyna się kolejne szukanie */
+    uint64_t free;       /* Liczba wolnych ramek */
+} frame_region_t;
+
+static frame_region_t *g_frame_regions;
+static int g_frame_region_count;
+static int g_frame_hint;
+static uint64_t g_frame_total;
+static uint64_t g_frame_free;
+static uint64_t g_frame_meta_start;
+static uint64_t g_frame_meta_end;
+static int g_frame_ready;
+static int g_frame_handed_over;
+
+/**
+ * Wyrównuje wartość w górę do określonej granicy.
+ * @param value Wartość do wyrównania
+ * @param align Granica wyrównania (musi być potęgą dwójki)
+ * @return Wartość wyrównana w górę
+ */
+static uint64_t frame_align_up(uint64_t value, uint64_t align)
+{
+    return (value + align - 1ULL) & ~(align - 1ULL);
+}
+
+/**
+ * Liczy słowa bitmapy potrzebne dla podanej liczby ramek.
+ * @param frames Liczba ramek
+ * @return Liczba 64-bitowych słów
+ */
+static uint64_t frame_words(uint64_t frames)
+{
+    return (frames + FRAME_BITS_PER_WORD - 1ULL) / FRAME_BITS_PER_WORD;
+}
+
+/**
+ * Ustawia albo czyści ciąg bitów, całymi słowami tam, gdzie się da.
+ * @param bitmap Bitmapa regionu
+ * @param first Indeks pierwszego bitu
+ * @param count Liczba bitów
+ * @param set 1 ustawia bity (zajęte), 0 czyści (wolne)
+ */
+static void frame_bits_update(uint64_t *bitmap, uint64_t first, uint64_t count, int set)
+{
+    while (count) {
+        uint64_t w = first / FRAME_BITS_PER_WORD;
+        uint64_t bit = first % FRAME_BITS_PER_WORD;
+        uint64_t n = FRAME_BITS_PER_WORD - bit;
+        uint64_t mask;
+
+        if (n > count)
+            n = count;
+        mask = (n == FRAME_BITS_PER_WORD) ? FRAME_WORD_FULL : (((1ULL << n) - 1ULL) << bit);
+
+        if (set)
+            bitmap[w] |= mask;
+        else
+            bitmap[w] &= ~mask;
+
+        first += n;
+        count -= n;
+    }
+}
+
+/**
+ * Sprawdza, czy wszystkie bity w ciągu są ustawione (ramki zajęte).
+ * @param bitmap Bitmapa regionu
+ * @param first Indeks pierwszego bitu
+ * @param count Liczba bitów
+ * @return 1 jeśli wszystkie są ustawione, 0 w przeciwnym razie
+ */
+static int frame_bits_all_set(const uint64_t *bitmap, uint64_t first, uint64_t count)
+{
+    while (count) {
+        uint64_t w = first / FRAME_BITS_PER_WORD;
+        uint64_t bit = first % FRAME_BITS_PER_WORD;
+        uint64_t n = FRAME_BITS_PER_WORD - bit;
+        uint64_t mask;
+
+        if (n > count)
+            n = count;
+        mask = (n == FRAME_BITS_PER_WORD) ? FRAME_WORD_FULL : (((1ULL << n) - 1ULL) << bit);
+
+        if ((bitmap[w] & mask) != mask)
+            return 0;
+
+        first += n;
+        count -= n;
+    }
+
+    return 1;
+}
+
+/**
+ * Znajduje region zawierający adres fizyczny (regiony są posortowane, wyszukiwanie binarne).
+ * @param pa Adres fizyczny
+ * @return Wskaźnik do regionu lub 0, jeśli adres nie należy do alokatora
+ */
+static frame_region_t *frame_region_find(uint64_t pa)
+{
+    int lo = 0;
+    int hi = g_frame_region_count - 1;
+
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        frame_region_t *r = &g_frame_regions[mid];
+
+        if (pa < r->base)
+            hi = mid - 1;
+        else if (pa - r->base >= r->frames * FRAME_SIZE)
+            lo = mid + 1;
+        else
+            return r;
+    }
+
+    return 0;
+}
+
+/**
+ * Przydziela jedną ramkę z regionu: skan słowo po słowie od kursora next-fit,
+ * pierwsze wolne miejsce w słowie daje ctz(~słowo).
+ * @param r Region
+ * @param pa Adres fizyczny przydzielonej ramki (wyjście)
+ * @return 0 jeśli sukces, FRAME_ALLOC_ERR_NO_MEMORY gdy region jest pełny
+ */
+static int frame_region_alloc_one(frame_region_t *r, uint64_t *pa)
+{
+    uint64_t w = r->cursor;
+    uint64_t n;
+
+    for (n = 0; n < r->words; n++) {
+        uint64_t word = r->bitmap[w];
+
+        if (word != FRAME_WORD_FULL) {
+            uint64_t bit = (uint64_t)__builtin_ctzll(~word);
+
+            r->bitmap[w] = word | (1ULL << bit);
+            r->cursor = w;
+            r->free--;
+            *pa = r->base + (w * FRAME_BITS_PER_WORD + bit) * FRAME_SIZE;
+            return 0;
+        }
+
+        if (++w == r->words)
+            w = 0;
+    }
+
+    return FRAME_ALLOC_ERR_NO_MEMORY;
+}
+
+/**
+ * Szuka w regionie ciągu count wolnych ramek (first-fit). Pełne słowa są pomijane,
+ * puste wydłużają ciąg o 64 ramki naraz; bit po bicie sprawdzane są tylko słowa mieszane.
+ * @param r Region
+ * @param count Liczba ramek
+ * @param first Indeks pierwszej ramki ciągu (wyjście)
+ * @return 0 jeśli znaleziono, FRAME_ALLOC_ERR_NO_MEMORY w przeciwnym razie
+ */
+static int frame_region_find_run(const frame_region_t *r, uint64_t count, uint64_t *first)
+{
+    uint64_t run = 0;
+    uint64_t start = 0;
+    uint64_t w;
+
+    for (w = 0; w < r->words; w++) {
+        uint64_t word = r->bitmap[w];
+        uint64_t bit;
+
+        if (word == FRAME_WORD_FULL) {
+            run = 0;
+            continue;
+        }
+
+        if (!word) {
+            if (!run)
+                start = w * FRAME_BITS_PER_WORD;
+            run += FRAME_BITS_PER_WORD;
+            if (run >= count) {
+                *first = start;
+                return 0;
+            }
+            continue;
+        }
+
+        for (bit = 0; bit < FRAME_BITS_PER_WORD; bit++) {
+            if (word & (1ULL << bit)) {
+                run = 0;
+                continue;
+            }
+            if (!run)
+                start = w * FRAME_BITS_PER_WORD + bit;
+            if (++run >= count) {
+                *first = start;
+                return 0;
+            }
+        }
+    }
+
+    return FRAME_ALLOC_ERR_NO_MEMORY;
+}
+
+/**
+ * Inicjalizuje alokator ramek z wolnych regionów mapy pamięci (mm_stage2_build).
+ * Deskryptory regionów i bitmapa trafiają do pierwszych wolnych ramek (od first_free_frame)
+ * i są oznaczane w bitmapie jako zajęte. Zakres zostaje wolny w mapie pamięci:
+ * frame_alloc_handover oddaje go jako wolny, gdy bitmapa przestaje być potrzebna.
+ * @return 0 jeśli sukces, FRAME_ALLOC_ERR_* w przeciwnym razie
+ */
+int frame_alloc_init(void)
+{
+    const mm_state_t *st = mm_state();
+    uint64_t words = 0;
+    uint64_t used_words = 0;
+    uint64_t desc_bytes;
+    uint64_t meta_size;
+    uint64_t meta_start = 0;
+    uint64_t *bits;
+    frame_region_t *meta_region;
+    int i;
+
+    g_frame_ready = 0;
+
+    if (!st || !st->free || st->free_count <= 0)
+        return FRAME_ALLOC_ERR_NO_MEMORY;
+
+    for (i = 0; i < st->free_count; i++)
+        words += frame_words((st->free[i].end - st->free[i].start) / FRAME_SIZE);
+
+    desc_bytes = frame_align_up((uint64_t)st->free_count * sizeof(frame_region_t), sizeof(uint64_t));
+    meta_size = frame_align_up(desc_bytes + words * sizeof(uint64_t), FRAME_SIZE);
+
+    for (i = 0; i < st->free_count; i++) {
+        const mm_region_t *r = &st->free[i];
+
+        if (r->start <= st->first_free_frame && st->first_free_frame < r->end &&
+            r->end - st->first_free_frame >= meta_size) {
+            meta_start = st->first_free_frame;
+            break;
+        }
+    }
+
+    for (i = 0; !meta_start && i < st->free_count; i++) {
+        if (st->free[i].end - st->free[i].start >= meta_size)
+            meta_start = st->free[i].start;
+    }
+
+    if (!meta_start)
+        return FRAME_ALLOC_ERR_NO_MEMORY;
+
+    g_frame_regions = (frame_region_t *)(uintptr_t)meta_start;
+    bits = (uint64_t *)(uintptr_t)(meta_start + desc_bytes);
+    g_frame_total = 0;
+
+    for (i = 0; i < st->free_count; i++) {
+        frame_region_t *r = &g_frame_regions[i];
+        uint64_t w;
+
+        r->base = st->free[i].start;
+        r->frames = (st->free[i].end - st->free[i].start) / FRAME_SIZE;
+        r->words = frame_words(r->frames);
+        if (used_words + r->words > words)
+            return FRAME_ALLOC_ERR_MAP;
+
+        r->bitmap = bits + used_words;
+        used_words += r->words;
+        for (w = 0; w < r->words; w++)
+            r->bitmap[w] = 0;
+        if (r->frames % FRAME_BITS_PER_WORD)
+            r->bitmap[r->words - 1] = FRAME_WORD_FULL << (r->frames % FRAME_BITS_PER_WORD);
+
+        r->cursor = 0;
+        r->free = r->frames;
+        g_frame_total += r->frames;
+    }
+
+    g_frame_region_count = st->free_count;
+
+    meta_region = frame_region_find(meta_start);
+    if (!meta_region)
+        return FRAME_ALLOC_ERR_MAP;
+    frame_bits_update(meta_region->bitmap, (meta_start - meta_region->base) / FRAME_SIZE,
+                      meta_size / FRAME_SIZE, 1);
+    meta_region->free -= meta_size / FRAME_SIZE;
+
+    g_frame_hint = 0;
+    g_frame_free = g_frame_total - meta_size / FRAME_SIZE;
+    g_frame_meta_start = meta_start;
+    g_frame_meta_end = meta_start + meta_size;
+    g_frame_ready = 1;
+    return 0;
+}
+
+/**
+ * Przekazuje ciąg ramek dalej, pomijając ramki metadanych alokatora (oddawane
+ * osobno na końcu frame_alloc_handover). Metadane są zajęte, więc dotyczy to
+ * tylko ciągów zajętych.
+ * @param fn Callback przekazania
+ * @param pa Adres fizyczny pierwszej ramki ciągu
+ * @param count Liczba ramek
+ * @param used 1 jeśli ramki są zajęte
+ */
+static void frame_handover_run(frame_alloc_run_fn fn, uint64_t pa, uint64_t count, int used)
+{
+    uint64_t end = pa + count * FRAME_SIZE;
+
+    if (!used || end <= g_frame_meta_start || pa >= g_frame_meta_end) {
+        fn(pa, count, used);
+        return;
+    }
+
+    if (pa < g_frame_meta_start)
+        fn(pa, (g_frame_meta_start - pa) / FRAME_SIZE, 1);
+    if (end > g_frame_meta_end)
+        fn(g_frame_meta_end, (end - g_frame_meta_end) / FRAME_SIZE, 1);
+}
+
+/**
+ * Przekazuje całą pamięć alokatora ramek dalej (bootmem-style, np. do buddy).
+ * Każdy region jest opisywany ciągami ramek o jednakowym stanie; pełne lub puste
+ * słowa bitmapy wydłużają ciąg o 64 ramki naraz. Ramki samej bitmapy idą na końcu
+ * jako wolne, bo callback może je nadpisać dopiero po przejściu przez bitmapę.
+ * Od tej chwili frame_alloc* przekierowują wywołania do buddy.
+ * @param fn Callback wołany dla każdego ciągu
+ * @return 0 jeśli sukces, FRAME_ALLOC_ERR_* w przeciwnym razie
+ */
+int frame_alloc_handover(frame_alloc_run_fn fn)
+{
+    int i;
+
+    if (!fn)
+        return FRAME_ALLOC_ERR_BADVALUE;
+    if (!g_frame_ready || g_frame_handed_over)
+        return FRAME_ALLOC_ERR_NOT_READY;
+
+    for (i = 0; i < g_frame_region_count; i++) {
+        const frame_region_t *r = &g_frame_regions[i];
+        uint64_t first = 0;
+
+        while (first < r->frames) {
+            uint64_t w = first / FRAME_BITS_PER_WORD;
+            int used = (int)((r->bitmap[w] >> (first % FRAME_BITS_PER_WORD)) & 1ULL);
+            uint64_t uniform = used ? FRAME_WORD_FULL : 0;
+            uint64_t next = first + 1;
+
+            while (next < r->frames) {
+                uint64_t nw = next / FRAME_BITS_PER_WORD;
+
+                if (!(next % FRAME_BITS_PER_WORD) && r->bitmap[nw] == uniform) {
+                    next += FRAME_BITS_PER_WORD;
+                    continue;
+                }
+                if ((int)((r->bitmap[nw] >> (next % FRAME_BITS_PER_WORD)) & 1ULL) != used)
+                    break;
+                next++;
+            }
+
+            if (next > r->frames)
+                next = r->frames;
+
+            frame_handover_run(fn, r->base + first * FRAME_SIZE, next - first, used);
+            first = next;
+        }
+    }
+
+    /* Deskryptory i bitmapa leżą w ramkach oddawanych poniżej */
+    g_frame_handed_over = 1;
+    g_frame_regions = 0;
+    g_frame_region_count = 0;
+    fn(g_frame_meta_start, (g_frame_meta_end - g_frame_meta_start) / FRAME_SIZE, 0);
+    return 0;
+}
+
+/**
+ * Przydziela jedną ramkę fizyczną. Zaczyna od regionu, w którym poprzednio była wolna
+ * ramka, a w nim od kursora next-fit, więc typowy przydział to O(1) zamortyzowane.
+ * @param pa Adres fizyczny ramki (wyjście)
+ * @return 0 jeśli sukces, FRAME_ALLOC_ERR_* w przeciwnym razie
+ */
+int frame_alloc(uint64_t *pa)
+{
+    int n;
+    int i;
+
+    if (!pa)
+        return FRAME_ALLOC_ERR_BADVALUE;
+    if (g_frame_handed_over)
+        return buddy_alloc(0, pa);
+    if (!g_frame_ready)
+        return FRAME_ALLOC_ERR_NOT_READY;
+    if (!g_frame_free)
+        return FRAME_ALLOC_ERR_NO_MEMORY;
+
+    i = g_frame_hint;
+    for (n = 0; n < g_frame_region_count; n++) {
+        frame_region_t *r = &g_frame_regions[i];
+
+        if (r->free && !frame_region_alloc_one(r, pa)) {
+            g_frame_hint = i;
+            g_frame_free--;
+            return 0;
+        }
+
+        if (++i == g_frame_region_count)
+            i = 0;
+    }
+
+    return FRAME_ALLOC_ERR_NO_MEMORY;
+}
+
+/**
+ * Zwalnia jedną ramkę przydzieloną przez frame_alloc lub frame_alloc_contiguous.
+ * @param pa Adres fizyczny ramki (wyrównany do FRAME_SIZE)
+ * @return 0 jeśli sukces, FRAME_ALLOC_ERR_* w przeciwnym razie
+ */
+int frame_free(uint64_t pa)
+{
+    return frame_free_contiguous(pa, 1);
+}
+
+/**
+ * Przydziela count fizycznie ciągłych ramek.
+ * @param count Liczba ramek
+ * @param pa Adres fizyczny pierwszej ramki (wyjście)
+ * @return 0 jeśli sukces, FRAME_ALLOC_ERR_* w przeciwnym razie
+ */
+int frame_alloc_contiguous(uint64_t count, uint64_t *pa)
+{
+    int i;
+
+    if (!pa || !count)
+        return FRAME_ALLOC_ERR_BADVALUE;
+    if (count == 1)
+        return frame_alloc(pa);
+    if (g_frame_handed_over)
+        return buddy_alloc_pages(count, pa);
+    if (!g_frame_ready)
+        return FRAME_ALLOC_ERR_NOT_READY;
+    if (g_frame_free < count)
+        return FRAME_ALLOC_ERR_NO_MEMORY;
+
+    for (i = 0; i < g_frame_region_count; i++) {
+        frame_region_t *r = &g_frame_regions[i];
+        uint64_t first;
+
+        if (r->free < count || frame_region_find_run(r, count, &first))
+            continue;
+
+        frame_bits_update(r->bitmap, first, count, 1);
+        r->free -= count;
+        g_frame_free -= count;
+        *pa = r->base + first * FRAME_SIZE;
+        return 0;
+    }
+
+    return FRAME_ALLOC_ERR_NO_MEMORY;
+}
+
+/**
+ * Zwalnia count ciągłych ramek. Cały zakres musi leżeć w jednym regionie
+ * i być w całości zajęty; inaczej nic nie jest zmieniane.
+ * @param pa Adres fizyczny pierwszej ramki
+ * @param count Liczba ramek
+ * @return 0 jeśli sukces, FRAME_ALLOC_ERR_* w przeciwnym razie
+ */
+int frame_free_contiguous(uint64_t pa, uint64_t count)
+{
+    frame_region_t *r;
+    uint64_t first;
+
+    if (!count || (pa & (FRAME_SIZE - 1ULL)))
+        return FRAME_ALLOC_ERR_BADVALUE;
+    if (g_frame_handed_over)
+        return buddy_free_pages(pa, count);
+    if (!g_frame_ready)
+        return FRAME_ALLOC_ERR_NOT_READY;
+
+    r = frame_region_find(pa);
+    if (!r)
+        return FRAME_ALLOC_ERR_NOT_OWNED;
+
+    first = (pa - r->base) / FRAME_SIZE;
+    if (count > r->frames - first)
+        return FRAME_ALLOC_ERR_NOT_OWNED;
+    if (!frame_bits_all_set(r->bitmap, first, count))
+        return FRAME_ALLOC_ERR_DOUBLE_FREE;
+
+    frame_bits_update(r->bitmap, first, count, 0);
+    r->free += count;
+    g_frame_free += count;
+    return 0;
+}
+
+/**
+ * Zwraca liczbę ramek zarządzanych przez alokator i liczbę wolnych
+ * (po frame_alloc_handover: statystyki buddy).
+ * @param total Liczba wszystkich ramek (wyjście, może być 0)
+ * @param free Liczba wolnych ramek (wyjście, może być 0)
+ * @return 0 jeśli sukces, FRAME_ALLOC_ERR_NOT_READY przed frame_alloc_init
+ */
+int frame_alloc_stats(uint64_t *total, uint64_t *free)
+{
+    if (g_frame_handed_over) {
+        const mm_buddy_stats_t *buddy = mm_buddy_stats();
+
+        if (total)
+            *total = buddy->managed_pages;
+        if (free)
+            *free = buddy->free_pages;
+        return 0;
+    }
+    if (!g_frame_ready)
+        return FRAME_ALLOC_ERR_NOT_READY;
+    if (total)
+        *total = g_frame_total;
+    if (free)
+        *free = g_frame_free;
+    return 0;
+}
+
+/**
+ * Wyświetla stan alokatora ramek przez UART.
+ */
+void frame_alloc_dump(void)
+{
+    if (!g_frame_ready || g_frame_handed_over || !uart_console_is_ready())
+        return;
+
+    uart_console_puts("[frame] regions=");
+    uart_console_put_dec_i32(g_frame_region_count);
+    uart_console_puts(" total=");
+    uart_console_put_dec_u64(g_frame_total);
+    uart_console_puts(" free=");
+    uart_console_put_dec_u64(g_frame_free);
+    uart_console_puts(" bitmap=");
+    uart_console_put_hex_u64(g_frame_meta_start);
+    uart_console_puts("..");
+    uart_console_put_hex_u64(g_frame_meta_end);
+    uart_console_puts("\n");
+}
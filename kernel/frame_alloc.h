@@ -0,0 +1,30 @@
+#ifndef KERNEL_FRAME_ALLOC_H
+#define KERNEL_FRAME_ALLOC_H
+
+#include <stdint.h>
+
+/* Rozmiar ramki fizycznej (strona Sv39, 4KB) */
+#define FRAME_SIZE 0x1000ULL
+
+enum {
+    FRAME_ALLOC_ERR_BADVALUE = -7000,
+    FRAME_ALLOC_ERR_NOT_READY,
+    FRAME_ALLOC_ERR_NO_MEMORY,
+    FRAME_ALLOC_ERR_NOT_OWNED,
+    FRAME_ALLOC_ERR_DOUBLE_FREE,
+    FRAME_ALLOC_ERR_MAP,
+};
+
+/* Callback przekazania pamięci: ciąg count ramek od pa, zajętych (used=1) lub wolnych */
+typedef void (*frame_alloc_run_fn)(uint64_t pa, uint64_t count, int used);
+
+int frame_alloc_init(void);
+int frame_alloc_handover(frame_alloc_run_fn fn);
+int frame_alloc(uint64_t *pa);
+int frame_free(uint64_t pa);
+int frame_alloc_contiguous(uint64_t count, uint64_t *pa);
+int frame_free_contiguous(uint64_t pa, uint64_t count);
+int frame_alloc_stats(uint64_t *total, uint64_t *free);
+void frame_alloc_dump(void);
+
+#endif
@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include <libfdt.h>
+#include <dtb/dtb.h>
+#include <sbi/sbi.h>
+#include <sbi/sbi_hart state management extension.h>
+#include <memblock.h>
+#include <hart.h>
+
+/* g_hart_ids[indeks] = hartid; indeks 0 to hart startowy */
+static uint32_t *g_hart_ids;
+static uint32_t g_hart_count;
+
+/**
+ * Buduje tablicę indeks → hartid z aktywnych węzłów /cpus: hart startowy dostaje
+ * indeks 0, pozostałe kolejne indeksy w porządku drzewa. Lista CPU z DTB
+ * (dtb_cpu_list_alloc) jest tymczasowa: arena memblock wraca potem do stanu
+ * sprzed niej, na stałe zostaje tylko tablica hartid.
+ * Wołana po memblock_init, przed pierwszym modułem z tablicami per hart.
+ * @param hw Stan sprzętowy z init_dtb (boot_hartid, cpu_count)
+ * @return 0 jeśli sukces, HART_ERR_* w przeciwnym razie
+ */
+int hart_table_init(const hw_state_t *hw)
+{
+    dtb_arena_t *arena = memblock_arena();
+    dtb_cpu_t *cpus = 0;
+    uint64_t mark;
+    uint32_t count = 1;
+    int listed = 0;
+    int err;
+    int i;
+
+    if (!hw || hw->cpu_count <= 0)
+        return HART_ERR_BADVALUE;
+
+    g_hart_ids = memblock_alloc((uint64_t)hw->cpu_count * sizeof(uint32_t), sizeof(uint32_t));
+    if (!arena || !g_hart_ids)
+        return HART_ERR_NO_MEMORY;
+
+    mark = arena->used;
+    err = dtb_cpu_list_alloc(arena, &cpus, &listed);
+    if (err && (err != -FDT_ERR_NOSPACE || !cpus)) {
+        arena->used = mark;
+        return (err == -FDT_ERR_NOSPACE) ? HART_ERR_NO_MEMORY : HART_ERR_DTB;
+    }
+
+    g_hart_ids[0] = hw->boot_hartid;
+    for (i = 0; i < listed && count < (uint32_t)hw->cpu_count; i++) {
+        if (cpus[i].hartid != hw->boot_hartid)
+            g_hart_ids[count++] = cpus[i].hartid;
+    }
+    arena->used = mark;
+
+    g_hart_count = count;
+    hart_set_index(0);
+    return 0;
+}
+
+/**
+ * Zwraca liczbę hartów w tablicy (0 przed hart_table_init).
+ */
+uint32_t hart_count(void)
+{
+    return g_hart_count;
+}
+
+/**
+ * Zamienia gęsty indeks na hartid (np. dla hart_mask SBI).
+ * @param index Indeks harta
+ * @return hartid albo HART_NONE, gdy indeks jest poza tablicą
+ */
+uint32_t hart_id_of(uint32_t index)
+{
+    return (index < g_hart_count) ? g_hart_ids[index] : HART_NONE;
+}
+
+/**
+ * Zamienia hartid na gęsty indeks.
+ * @param hartid Identyfikator harta
+ * @return Indeks albo HART_NONE, gdy hart nie występuje w /cpus
+ */
+uint32_t hart_index_of(uint32_t hartid)
+{
+    uint32_t i;
+
+    for (i = 0; i < g_hart_count; i++) {
+        if (g_hart_ids[i] == hartid)
+            return i;
+    }
+
+    return HART_NONE;
+}
+
+/**
+ * Startuje hart o danym indeksie przez SBI HSM. Hart zaczyna w entry z a0 = hartid
+ * i a1 = indeks, który kod wejścia musi przepisać do tp.
+ * @param index Indeks harta (różny od 0)
+ * @param entry Adres fizyczny kodu wejścia
+ * @return 0 jeśli sukces, HART_ERR_BADVALUE dla złego indeksu, błąd SBI w przeciwnym razie
+ */
+int hart_start(uint32_t index, uint64_t entry)
+{
+    struct sbiret ret;
+
+    if (!index || index >= g_hart_count)
+        return HART_ERR_BADVALUE;
+
+    ret = sbi_hart_start(g_hart_ids[index], entry, index);
+    return (int)ret.error;
+}
@@ -0,0 +1,43 @@
+#ifndef KERNEL_HART_H
+#define KERNEL_HART_H
+
+#include <stdint.h>
+#include <platform_init.h>
+
+/* Wynik hart_index_of / hart_id_of dla harta spoza tablicy */
+#define HART_NONE ((uint32_t)-1)
+
+enum {
+    HART_ERR_BADVALUE = -15000,
+    HART_ERR_NO_MEMORY,
+    HART_ERR_DTB,
+};
+
+/*
+ * Gęsty indeks bieżącego harta (0..hart_count()-1) trzymany w rejestrze tp.
+ * Hart startowy ma zawsze indeks 0 (entry.S ustawia tp = 0 przed kmain), pozostałe
+ * dostają kolejne indeksy w porządku /cpus (hart_table_init). Tablice per hart są
+ * więc zwarte niezależnie od numeracji hartid (np. hart 0 jako rdzeń monitora S7,
+ * hart startowy 1). Harty startowane później przez hart_start dostają indeks
+ * w a1 (opaque SBI HSM) i muszą przepisać go do tp, zanim dotkną danych per-hart.
+ */
+static inline uint32_t hart_index(void)
+{
+    uint64_t tp;
+
+    asm volatile("mv %0, tp" : "=r"(tp));
+    return (uint32_t)tp;
+}
+
+static inline void hart_set_index(uint32_t index)
+{
+    asm volatile("mv tp, %0" : : "r"((uint64_t)index));
+}
+
+int hart_table_init(const hw_state_t *hw);
+uint32_t hart_count(void);
+uint32_t hart_id_of(uint32_t index);
+uint32_t hart_index_of(uint32_t hartid);
+int hart_start(uint32_t index, uint64_t entry);
+
+#endif
@@ -6,7 +6,20 @@
 #include <panic.h>
 #include <uart/uart_console.h>
 #include <platform_init.h>
+#include <platform_desc.h>
+#include <dtb/dtb.h>
 #include <memory_map.h>
+#include <memblock.h>
+#include <hart.h>
+#include <frame_alloc.h>
+#include <buddy.h>
+#include <page_cache.h>
+#include <slab.h>
+#include <kmalloc.h>
+#include <tlb.h>
+#include <shootdown.h>
+#include <vm.h>
+#include <asid.h>
 
 extern char _bss_start[];
 extern char _bss_end[];
@@ -45,19 +58,55 @@ void kmain(uint64_t hartid, void *dtb)
     g_hw.boot_hartid = (uint32_t)hartid;
 
     init_dtb(&g_hw, dtb, hartid);
+    if (memblock_init(&g_hw))
+        panic("memblock does not fit in RAM");
+    /* Indeks DTB w memblock; bez niego (błąd nie jest krytyczny) dtb_* czytają blob przez libfdt */
+    if (!platform_desc())
+        dtb_index_init(memblock_arena());
+    if (hart_table_init(&g_hw))
+        panic("hart table init failed");
     {
-        int uart_err = uart_console_init_from_dtb();
+        const platform_desc_t *desc = platform_desc();
+        int uart_err = desc ? uart_console_init_from_info(&desc->uart)
+                            : uart_console_init_from_dtb();
         if (uart_err)
             panic(uart_console_strerror(uart_err));
     }
     uart_console_puts("[kernel] uart initialized\n");
+    if (platform_desc())
+        uart_console_puts("[kernel] precompiled platform descriptor matches DTB, parse skipped\n");
     validate_and_dump_dtb_state(&g_hw);
     init_sbi(&g_hw);
     uart_console_puts("[kernel] sbi ready\n");
     if (mm_stage2_build(&g_hw))
         panic("memory map stage2 build failed");
+    if (frame_alloc_init())
+        panic("frame allocator init failed");
+    if (buddy_init())
+        panic("buddy allocator init failed");
+    if (page_cache_init(&g_hw))
+        panic("per-hart page cache init failed");
+    if (kmem_init(&g_hw))
+        panic("slab allocator init failed");
+    if (kmalloc_init())
+        panic("kmalloc init failed");
+    tlb_init(&g_hw);
+    if (shootdown_init(&g_hw))
+        panic("TLB shootdown init failed");
+    {
+        int vm_err = vm_init(&g_hw);
+        if (vm_err && vm_err != VM_ERR_UNSUPPORTED)
+            panic("kernel page table setup failed");
+    }
+    if (asid_init(&g_hw))
+        panic("ASID allocator init failed");
     if (mm_stage2_dump())
         panic("memory map stage2 dump failed");
+    kmem_cache_dump();
+    kmalloc_dump();
+    vm_dump();
+    shootdown_dump();
+    asid_dump();
 
     {
         
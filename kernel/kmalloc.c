@@ -0,0 +1,300 @@
+#include <stdint.h>
+#include <uart/uart_console.h>
+#include <spinlock.h>
+#include <buddy.h>
+#include <page_cache.h>
+#include <slab.h>
+#include <kmalloc.h>
+
+/* Indeks liczników dużych przydziałów (za klasami slab) */
+#define KMALLOC_LARGE KMALLOC_CLASSES
+
+/**
+ * Liczniki jednego miejsca wywołania kmalloc. Klucz (file, line) jest
+ * publikowany przez zapis file, więc odczyt tablicy nie wymaga blokady.
+ */
+typedef struct {
+    const char *file;
+    int line;
+    uint64_t allocs;
+    uint64_t failed;
+    uint64_t requested;     /* Suma żądanych bajtów */
+    uint64_t allocated;     /* Suma bajtów faktycznie zajętych (rozmiar klasy / strony) */
+} kmalloc_site_t;
+
+typedef struct {
+    uint64_t allocs;
+    uint64_t frees;
+} kmalloc_class_stats_t;
+
+static kmem_cache_t *g_kmalloc_caches[KMALLOC_CLASSES];
+static char g_kmalloc_names[KMALLOC_CLASSES][16];
+static kmalloc_class_stats_t g_kmalloc_class_stats[KMALLOC_CLASSES + 1];
+static kmalloc_site_t g_kmalloc_sites[KMALLOC_SITE_CAP];
+static kmalloc_site_t g_kmalloc_site_overflow;
+static spinlock_t g_kmalloc_site_lock = SPINLOCK_INIT;
+static int g_kmalloc_ready;
+
+/**
+ * Zwraca indeks najmniejszej klasy mieszczącej size (1..KMALLOC_MAX_SMALL).
+ */
+static int kmalloc_class(uint64_t size)
+{
+    int p;
+
+    if (size <= 64)
+        return (int)((size + 7ULL) / 8ULL) - 1;
+
+    /* 2^p < size <= 2^(p+1); cztery klasy co 2^(p-2) */
+    p = 63 - __builtin_clzll(size - 1ULL);
+    return 8 + (p - 6) * 4 + (int)((size - 1ULL - (1ULL << p)) >> (p - 2));
+}
+
+/**
+ * Zwraca rozmiar klasy o danym indeksie.
+ */
+static uint64_t kmalloc_class_size(int idx)
+{
+    int p;
+
+    if (idx < 8)
+        return (uint64_t)(idx + 1) * 8ULL;
+
+    p = 6 + (idx - 8) / 4;
+    return (1ULL << p) + (uint64_t)((idx - 8) % 4 + 1) * (1ULL << (p - 2));
+}
+
+/**
+ * Zapisuje w buforze nazwę cache klasy, np. "kmalloc-96".
+ */
+static void kmalloc_class_name(char *buf, uint64_t size)
+{
+    static const char prefix[] = "kmalloc-";
+    char digits[20];
+    int n = 0;
+    int i;
+
+    for (i = 0; prefix[i]; i++)
+        *buf++ = prefix[i];
+    do {
+        digits[n++] = (char)('0' + size % 10ULL);
+        size /= 10ULL;
+    } while (size);
+    while (n)
+        *buf++ = digits[--n];
+    *buf = '\0';
+}
+
+/**
+ * Zwraca wpis miejsca wywołania, wstawiając go przy pierwszym użyciu.
+ * Szukanie jest bez blokady; wstawienie powtarza szukanie pod blokadą.
+ */
+static kmalloc_site_t *kmalloc_site(const char *file, int line)
+{
+    uint32_t start = (uint32_t)((((uintptr_t)file >> 3) * 31u + (uint32_t)line) & (KMALLOC_SITE_CAP - 1));
+    kmalloc_site_t *site;
+    const char *key;
+    uint32_t i;
+
+    for (i = 0; i < KMALLOC_SITE_CAP; i++) {
+        site = &g_kmalloc_sites[(start + i) & (KMALLOC_SITE_CAP - 1)];
+        key = __atomic_load_n(&site->file, __ATOMIC_ACQUIRE);
+        if (!key)
+            break;
+        if (key == file && site->line == line)
+            return site;
+    }
+
+    spin_lock(&g_kmalloc_site_lock);
+    for (i = 0; i < KMALLOC_SITE_CAP; i++) {
+        site = &g_kmalloc_sites[(start + i) & (KMALLOC_SITE_CAP - 1)];
+        if (!site->file) {
+            site->line = line;
+            __atomic_store_n(&site->file, file, __ATOMIC_RELEASE);
+            break;
+        }
+        if (site->file == file && site->line == line)
+            break;
+    }
+    spin_unlock(&g_kmalloc_site_lock);
+
+    return (i < KMALLOC_SITE_CAP) ? site : &g_kmalloc_site_overflow;
+}
+
+/**
+ * Rząd bloku buddy dla dużego przydziału.
+ * @return Rząd albo -1, gdy size przekracza największy blok
+ */
+static int kmalloc_large_order(uint64_t size)
+{
+    uint64_t pages = (size + BUDDY_PAGE_SIZE - 1ULL) / BUDDY_PAGE_SIZE;
+    int order = 0;
+
+    while ((1ULL << order) < pages)
+        order++;
+
+    return (order <= BUDDY_MAX_ORDER) ? order : -1;
+}
+
+/**
+ * Tworzy cache slab dla wszystkich klas kmalloc. Obiekty są wyrównane
+ * naturalnie (największa potęga dwójki dzieląca rozmiar, najwyżej linia cache).
+ * @return 0 jeśli sukces, KMALLOC_ERR_NOT_READY gdy slab nie jest gotowy
+ */
+int kmalloc_init(void)
+{
+    uint64_t size;
+    uint64_t align;
+    int i;
+
+    for (i = 0; i < KMALLOC_CLASSES; i++) {
+        size = kmalloc_class_size(i);
+        align = size & (~size + 1ULL);
+        if (align > KMEM_CACHE_LINE)
+            align = KMEM_CACHE_LINE;
+
+        kmalloc_class_name(g_kmalloc_names[i], size);
+        g_kmalloc_caches[i] = kmem_cache_create(g_kmalloc_names[i], size, align, 0, 0);
+        if (!g_kmalloc_caches[i])
+            return KMALLOC_ERR_NOT_READY;
+    }
+
+    g_kmalloc_ready = 1;
+    return 0;
+}
+
+/**
+ * Przydziela size bajtów: do KMALLOC_MAX_SMALL z cache najmniejszej pasującej
+ * klasy, powyżej blok 2^order stron z buddy. Zwykle wołane przez makro kmalloc.
+ * @param size Rozmiar w bajtach
+ * @param file Plik miejsca wywołania
+ * @param line Linia miejsca wywołania
+ * @return Wskaźnik albo 0 przy błędzie lub size == 0
+ */
+void *kmalloc_at(uint64_t size, const char *file, int line)
+{
+    kmalloc_site_t *site;
+    uint64_t allocated;
+    uint64_t pa;
+    void *ptr = 0;
+    int idx;
+    int order;
+
+    if (!g_kmalloc_ready || !size)
+        return 0;
+
+    if (size <= KMALLOC_MAX_SMALL) {
+        idx = kmalloc_class(size);
+        allocated = kmalloc_class_size(idx);
+        ptr = kmem_cache_alloc(g_kmalloc_caches[idx]);
+    } else {
+        idx = KMALLOC_LARGE;
+        order = kmalloc_large_order(size);
+        allocated = (order < 0) ? 0 : BUDDY_PAGE_SIZE << order;
+        if (order >= 0 && !page_alloc_order(order, &pa))
+            ptr = (void *)(uintptr_t)pa;
+    }
+
+    site = kmalloc_site(file, line);
+    if (!ptr) {
+        __atomic_fetch_add(&site->failed, 1ULL, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    __atomic_fetch_add(&site->allocs, 1ULL, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site->requested, size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site->allocated, allocated, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_kmalloc_class_stats[idx].allocs, 1ULL, __ATOMIC_RELAXED);
+    return ptr;
+}
+
+/**
+ * Zwalnia pamięć z kmalloc. Duży przydział to głowa bloku buddy,
+ * mały to obiekt slaba, którego cache musi być jedną z klas kmalloc.
+ * @param ptr Wskaźnik z kmalloc (0 jest ignorowane)
+ * @return 0 jeśli sukces, KMALLOC_ERR_* w przeciwnym razie
+ */
+int kfree(void *ptr)
+{
+    kmem_cache_t *cache;
+    uint64_t head;
+    int order;
+    int idx;
+
+    if (!ptr)
+        return 0;
+    if (!g_kmalloc_ready)
+        return KMALLOC_ERR_NOT_READY;
+    if (buddy_block_of((uint64_t)(uintptr_t)ptr, &head, &order))
+        return KMALLOC_ERR_NOT_OWNED;
+
+    if (head == (uint64_t)(uintptr_t)ptr) {
+        if (page_free_order(head, order))
+            return KMALLOC_ERR_NOT_OWNED;
+        idx = KMALLOC_LARGE;
+    } else {
+        cache = kmem_cache_of(ptr);
+        if (!cache || kmem_cache_size(cache) > KMALLOC_MAX_SMALL)
+            return KMALLOC_ERR_NOT_OWNED;
+        idx = kmalloc_class(kmem_cache_size(cache));
+        if (g_kmalloc_caches[idx] != cache || kmem_cache_free(cache, ptr))
+            return KMALLOC_ERR_NOT_OWNED;
+    }
+
+    __atomic_fetch_add(&g_kmalloc_class_stats[idx].frees, 1ULL, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static void kmalloc_dump_site(const kmalloc_site_t *site)
+{
+    uart_console_puts("[kmalloc] site ");
+    uart_console_puts(site->file ? site->file : "(overflow)");
+    uart_console_puts(":");
+    uart_console_put_dec_i32(site->line);
+    uart_console_puts(" allocs=");
+    uart_console_put_dec_u64(site->allocs);
+    uart_console_puts(" failed=");
+    uart_console_put_dec_u64(site->failed);
+    uart_console_puts(" requested=");
+    uart_console_put_dec_u64(site->requested);
+    uart_console_puts(" allocated=");
+    uart_console_put_dec_u64(site->allocated);
+    uart_console_puts("\n");
+}
+
+/**
+ * Wyświetla liczniki klas (pomija nieużywane) i wszystkich miejsc wywołań.
+ * Liczniki czytane są bez blokady, więc wynik jest przybliżony.
+ */
+void kmalloc_dump(void)
+{
+    const kmalloc_class_stats_t *stats;
+    int i;
+
+    if (!g_kmalloc_ready || !uart_console_is_ready())
+        return;
+
+    for (i = 0; i <= KMALLOC_CLASSES; i++) {
+        stats = &g_kmalloc_class_stats[i];
+        if (!stats->allocs)
+            continue;
+
+        uart_console_puts("[kmalloc] class ");
+        if (i == KMALLOC_LARGE)
+            uart_console_puts("large");
+        else
+            uart_console_put_dec_u64(kmalloc_class_size(i));
+        uart_console_puts(" allocs=");
+        uart_console_put_dec_u64(stats->allocs);
+        uart_console_puts(" live=");
+        uart_console_put_dec_u64(stats->allocs - stats->frees);
+        uart_console_puts("\n");
+    }
+
+    for (i = 0; i < KMALLOC_SITE_CAP; i++) {
+        if (g_kmalloc_sites[i].file)
+            kmalloc_dump_site(&g_kmalloc_sites[i]);
+    }
+    if (g_kmalloc_site_overflow.allocs || g_kmalloc_site_overflow.failed)
+        kmalloc_dump_site(&g_kmalloc_site_overflow);
+}
@@ -0,0 +1,34 @@
+#ifndef KERNEL_KMALLOC_H
+#define KERNEL_KMALLOC_H
+
+#include <stdint.h>
+
+/* Największy rozmiar obsługiwany przez klasy slab; większe idą całymi stronami z buddy */
+#define KMALLOC_MAX_SMALL 2048
+
+/*
+ * Klasy: do 64 bajtów co 8, potem cztery klasy na każde podwojenie
+ * (80, 96, 112, 128, 160, ...), więc sąsiednie klasy różnią się najwyżej 1.25x.
+ */
+#define KMALLOC_CLASSES 28
+
+/* Pojemność tablicy miejsc wywołań (potęga dwójki); nadmiar trafia do wspólnego wpisu */
+#ifndef KMALLOC_SITE_CAP
+#define KMALLOC_SITE_CAP 64
+#endif
+
+enum {
+    KMALLOC_ERR_BADVALUE = -11000,
+    KMALLOC_ERR_NOT_READY,
+    KMALLOC_ERR_NOT_OWNED,
+};
+
+int kmalloc_init(void);
+void *kmalloc_at(uint64_t size, const char *file, int line);
+int kfree(void *ptr);
+void kmalloc_dump(void);
+
+/* Miejsce wywołania (plik:linia) trafia do statystyk kmalloc_dump */
+#define kmalloc(size) kmalloc_at((size), __FILE__, __LINE__)
+
+#endif
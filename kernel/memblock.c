@@ -0,0 +1,224 @@
+#include <libfdt.h>
+#include <stdint.h>
+#include <sbi/sbi_string.h>
+#include <dtb/dtb.h>
+#include <platform_desc.h>
+#include <memblock.h>
+
+#define MEMBLOCK_PAGE_SIZE 0x1000ULL
+
+extern char _kernel_image_end[];
+
+/*
+ * Zakres [g_memblock.base, g_memblock_limit). Przydziały trwałe rosną od dołu
+ * (arena, used), tymczasowe (scratch) od góry; g_memblock.size kończy się tam,
+ * gdzie zaczyna się scratch, więc obie części nie mogą na siebie wejść.
+ */
+static dtb_arena_t g_memblock;
+static uint64_t g_memblock_limit;
+static uint64_t g_memblock_scratch;
+static int g_memblock_ready;
+static int g_memblock_closed;
+
+static uint64_t memblock_page_up(uint64_t value)
+{
+    return (value + MEMBLOCK_PAGE_SIZE - 1ULL) & ~(MEMBLOCK_PAGE_SIZE - 1ULL);
+}
+
+static uint64_t memblock_page_down(uint64_t value)
+{
+    return value & ~(MEMBLOCK_PAGE_SIZE - 1ULL);
+}
+
+/**
+ * Przycina kandydata [*start, *limit) tak, żeby nie nachodził na zakres [rstart, rend).
+ * Zakres zaczynający się przed *start przesuwa start za swój koniec, zakres
+ * leżący wyżej obcina limit.
+ * @return 1 jeśli start się przesunął (trzeba ponownie sprawdzić wszystkie zakresy)
+ */
+static int memblock_avoid(uint64_t *start, uint64_t *limit, uint64_t bank_end,
+                          uint64_t rstart, uint64_t rend)
+{
+    if (rend <= *start || rstart >= *limit)
+        return 0;
+
+    if (rstart <= *start) {
+        *start = memblock_page_up(rend);
+        *limit = *start + MEMBLOCK_MAX_SIZE;
+        if (*limit > bank_end)
+            *limit = bank_end;
+        return 1;
+    }
+
+    *limit = memblock_page_down(rstart);
+    return 0;
+}
+
+/**
+ * Ustawia memblock na pierwszych wolnych stronach za _kernel_image_end.
+ * Zakres omija blob DTB (musi przetrwać cały boot) i regiony zarezerwowane
+ * (/reserved-memory albo prekompilowany opis platformy) i mieści się w pierwszym
+ * banku RAM z DTB (hw->mem_base/mem_size).
+ * @param hw Stan sprzętu z init_dtb()
+ * @return 0 jeśli sukces, kod błędu w przeciwnym razie
+ */
+int memblock_init(const hw_state_t *hw)
+{
+    const platform_desc_t *desc = platform_desc();
+    const void *fdt = dtb_get();
+    dtb_addr_t dtb_reserved[DTB_MAX_MEM_REGIONS];
+    int dtb_reserved_count = 0;
+    uint64_t bank_end;
+    uint64_t start;
+    uint64_t limit;
+    int moved;
+    int pass;
+    int i;
+
+    if (!hw)
+        return MEMBLOCK_ERR_BADVALUE;
+
+    bank_end = hw->mem_base + hw->mem_size;
+    start = memblock_page_up((uint64_t)(uintptr_t)_kernel_image_end);
+    limit = start + MEMBLOCK_MAX_SIZE;
+    if (limit > bank_end)
+        limit = bank_end;
+
+    if (!desc) {
+        int err = dtb_reserved_memory_regions(dtb_reserved, DTB_MAX_MEM_REGIONS, &dtb_reserved_count);
+        if (err && err != -FDT_ERR_NOSPACE)
+            dtb_reserved_count = 0;
+    }
+
+    /* Każde przesunięcie startu wymaga ponownego sprawdzenia wszystkich zakresów */
+    for (pass = 0, moved = 1; moved && pass <= DTB_MAX_MEM_REGIONS + 1; pass++) {
+        moved = 0;
+        if (fdt) {
+            uint64_t dtb_start = (uint64_t)(uintptr_t)fdt;
+            moved |= memblock_avoid(&start, &limit, bank_end,
+                                    dtb_start, dtb_start + (uint64_t)fdt_totalsize(fdt));
+        }
+        if (desc) {
+            for (i = 0; i < desc->reserved_count; i++)
+                moved |= memblock_avoid(&start, &limit, bank_end,
+                                        desc->reserved[i].start, desc->reserved[i].end);
+        }
+        for (i = 0; i < dtb_reserved_count; i++)
+            moved |= memblock_avoid(&start, &limit, bank_end, dtb_reserved[i].base,
+                                    dtb_reserved[i].base + dtb_reserved[i].size);
+    }
+
+    if (moved || start < hw->mem_base || start >= limit)
+        return MEMBLOCK_ERR_NO_RAM;
+
+    dtb_arena_init(&g_memblock, (void *)(uintptr_t)start, limit - start);
+    g_memblock_limit = limit;
+    g_memblock_scratch = limit;
+    g_memblock_closed = 0;
+    g_memblock_ready = 1;
+    return 0;
+}
+
+/**
+ * Przydziela wyzerowany blok na cały czas życia jądra (nie ma zwalniania).
+ * @param size Rozmiar w bajtach
+ * @param align Wyrównanie (potęga dwójki, 0 → 1)
+ * @return Wskaźnik albo 0, gdy zakres się skończył lub memblock jest zamknięty
+ */
+void *memblock_alloc(uint64_t size, uint64_t align)
+{
+    void *ptr;
+
+    if (!g_memblock_ready || g_memblock_closed)
+        return 0;
+
+    ptr = dtb_arena_alloc(&g_memblock, size, align);
+    if (ptr)
+        sbi_memset(ptr, 0, size);
+    return ptr;
+}
+
+/**
+ * Przydziela tymczasowy bufor od góry zakresu. Bufory scratch nie trafiają do mapy
+ * pamięci i są zwalniane razem przez memblock_scratch_release().
+ * @param size Rozmiar w bajtach
+ * @param align Wyrównanie (potęga dwójki, 0 → 1)
+ * @return Wskaźnik albo 0, gdy brak miejsca
+ */
+void *memblock_alloc_scratch(uint64_t size, uint64_t align)
+{
+    uint64_t base = (uint64_t)(uintptr_t)g_memblock.base;
+    uint64_t low;
+
+    if (!g_memblock_ready || g_memblock_closed)
+        return 0;
+    if (!align)
+        align = 1;
+    if (size > g_memblock_scratch - base)
+        return 0;
+
+    low = (g_memblock_scratch - size) & ~(align - 1ULL);
+    if (low < base + g_memblock.used)
+        return 0;
+
+    g_memblock_scratch = low;
+    g_memblock.size = low - base;
+    return (void *)(uintptr_t)low;
+}
+
+/**
+ * Zwalnia wszystkie bufory scratch.
+ */
+void memblock_scratch_release(void)
+{
+    if (!g_memblock_ready || g_memblock_closed)
+        return;
+
+    g_memblock_scratch = g_memblock_limit;
+    g_memblock.size = g_memblock_limit - (uint64_t)(uintptr_t)g_memblock.base;
+}
+
+/**
+ * Zwraca memblock jako arenę dla zapytań DTB (*_alloc) albo 0 przed
+ * memblock_init() i po memblock_close(). Przydziały z areny są trwałe, ale nie zerowane.
+ * @return Wskaźnik do areny
+ */
+dtb_arena_t *memblock_arena(void)
+{
+    return (g_memblock_ready && !g_memblock_closed) ? &g_memblock : 0;
+}
+
+/**
+ * Zwraca zakres fizyczny zajęty dotąd przez trwałe przydziały, zaokrąglony do stron,
+ * żeby mapa pamięci mogła go zarezerwować jako "memblock".
+ * @param start Adres początkowy
+ * @param end Adres końcowy (wyłączny)
+ * @return 0 jeśli sukces, kod błędu w przeciwnym razie
+ */
+int memblock_range(uint64_t *start, uint64_t *end)
+{
+    if (!start || !end)
+        return MEMBLOCK_ERR_BADVALUE;
+    if (!g_memblock_ready)
+        return MEMBLOCK_ERR_NOT_READY;
+
+    *start = (uint64_t)(uintptr_t)g_memblock.base;
+    *end = memblock_page_up(*start + g_memblock.used);
+    return 0;
+}
+
+/**
+ * Zamyka memblock: dalsze przydziały zwracają 0, a zakres za memblock_range()
+ * zostaje w mapie pamięci jako wolny i przejmuje go alokator ramek.
+ * Scratch musi być wcześniej zwolniony.
+ * @return 0 jeśli sukces, MEMBLOCK_ERR_NOT_READY przed memblock_init()
+ */
+int memblock_close(void)
+{
+    if (!g_memblock_ready)
+        return MEMBLOCK_ERR_NOT_READY;
+
+    g_memblock.size = g_memblock.used;
+    g_memblock_closed = 1;
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef KERNEL_MEMBLOCK_H
+#define KERNEL_MEMBLOCK_H
+
+#include <stdint.h>
+#include <dtb/dtb.h>
+#include <platform_init.h>
+
+/*
+ * Górna granica zakresu memblock (wczesny alokator za obrazem jądra).
+ * Zakres jest dodatkowo przycinany do końca pierwszego banku RAM, początku DTB
+ * i pierwszego regionu zarezerwowanego powyżej jądra. Do mapy pamięci trafia
+ * tylko faktycznie zużyta część; reszta zostaje wolna dla alokatora ramek.
+ */
+#ifndef MEMBLOCK_MAX_SIZE
+#define MEMBLOCK_MAX_SIZE 0x200000ULL
+#endif
+
+enum {
+    MEMBLOCK_ERR_BADVALUE = -4000,
+    MEMBLOCK_ERR_NO_RAM,
+    MEMBLOCK_ERR_NOT_READY,
+};
+
+int memblock_init(const hw_state_t *hw);
+void *memblock_alloc(uint64_t size, uint64_t align);
+void *memblock_alloc_scratch(uint64_t size, uint64_t align);
+void memblock_scratch_release(void);
+dtb_arena_t *memblock_arena(void);
+int memblock_range(uint64_t *start, uint64_t *end);
+int memblock_close(void);
+
+#endif
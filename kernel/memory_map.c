@@ -3,6 +3,8 @@
 #include <dtb/dtb.h>
 #include <uart/uart_console.h>
 #include <memory_map.h>
+#include <memblock.h>
+#include <platform_desc.h>
 
 /*
  * Stałe związane z zarządzaniem pamięcią
@@ -11,16 +13,17 @@
 /* Rozmiar strony pamięci w trybie Sv39 (4KB) */
 #define MM_PAGE_SIZE 0x1000ULL
 
-/* Maksymalna liczba regionów RAM (z DTB) */
-#define MM_MAX_RAM_REGIONS DTB_MAX_MEM_REGIONS
+/* Początkowa pojemność obszaru roboczego regionów zarezerwowanych w czasie budowy
+ * mapy. Obszar jest tymczasowy (scratch memblock) i podwaja się, gdy się zapełni;
+ * po scaleniu regiony są kopiowane do tablic dokładnej długości. */
+#define MM_REGION_WORKSPACE_INIT 64
 
-/* Pojemność obszaru roboczego dla wszystkich regionów (reserved + free)
- * Obliczona jako: liczba regionów RAM * (maksymalne rejestry DTB * 2 + 8) */
-#define MM_REGION_WORKSPACE_CAP (DTB_MAX_MEM_REGIONS * ((DTB_MAX_REGS * 2) + 8))
+/* Zapas wpisów reserved na mm_stage2_reserve. Rezerwacje są możliwe tylko do startu
+ * buddy, a po zamknięciu memblock nie ma z czego powiększyć tablic */
+#define MM_REGION_RESERVE_SLACK 8
 
-/* Maksymalna liczba unikalnych zakresów adresowych do deduplikacji
- * Używane w mm_sum_pages_clipped_to_ram() do alokacji tablic pomocniczych */
-#define MM_MAX_RANGES 64
+/* compatible urządzeń, których okna MMIO dostają MM_FLAG_WC (mapowanie z łączeniem zapisów) */
+#define MM_WC_COMPATIBLE "simple-framebuffer"
 
 enum {
     MM_ERR_BADVALUE = -3000,
@@ -28,31 +31,54 @@ enum {
     MM_ERR_DTB_RESERVED,
     MM_ERR_DTB_DEVICE_SCAN,
     MM_ERR_REGION_CAP,
+    MM_ERR_MEMBLOCK,
+    MM_ERR_BUDDY_READY,
 };
 
 extern char _kernel_start[];
 extern char _kernel_image_end[];
 
 /*
- * Tablice regionów pamięci (używane przez mm_state_t)
+ * Tablice regionów pamięci (używane przez mm_state_t), przydzielane z memblock
+ * w mm_stage2_build według tego, czego faktycznie potrzebuje DTB
  */
-static mm_region_t g_mm_ram[MM_MAX_RAM_REGIONS];
-static mm_region_t g_mm_reserved[MM_REGION_WORKSPACE_CAP];
-static mm_region_t g_mm_free[MM_REGION_WORKSPACE_CAP];
+static mm_region_t *g_mm_reserved;
+static mm_region_t *g_mm_free;
+static uint64_t *g_mm_reserved_max_end;
+static int g_mm_reserved_cap;
+static int g_mm_free_cap;
+
+/*
+ * Nazwy źródeł regionów wskazywane przez source_ids[] w mm_region_set_t.
+ * Pierwsze MM_SOURCE_FIRST wpisów ma stałe znaczenie, kolejne dopisuje
+ * mm_source_add dla każdego regionu zarezerwowanego.
+ */
+enum {
+    MM_SOURCE_MERGED = 0,
+    MM_SOURCE_FREE,
+    MM_SOURCE_FIRST,
+};
+
+static const char **g_mm_sources;
+static uint32_t g_mm_source_count;
+static uint32_t g_mm_source_cap;
+
+/* Płaska mapa dla mm_pa_classify (mm_pa_map_build) */
+static mm_region_t *g_mm_pa_map;
+static int g_mm_pa_map_cap;
 
 /*
  * Bufory tymczasowe dla danych z DTB
  */
-static dtb_addr_t g_dtb_ram_regions[DTB_MAX_MEM_REGIONS];
 static dtb_addr_t g_dtb_reserved_regions[DTB_MAX_MEM_REGIONS];
 
 /* Struktura przechowująca stan mapy pamięci */
 static mm_state_t g_mm_state = {
-    .ram = g_mm_ram,
+    .ram = 0,
     .ram_count = 0,
-    .reserved = g_mm_reserved,
+    .reserved = 0,
     .reserved_count = 0,
-    .free = g_mm_free,
+    .free = 0,
     .free_count = 0,
     .first_free_frame = 0,
     .ram_pages = 0,
@@ -62,6 +88,10 @@ static mm_state_t g_mm_state = {
     .totals_ok = 0,
     .first_free_ok = 0,
     .overlap_free_reserved = 0,
+    .reserved_set = { 0 },
+    .free_set = { 0 },
+    .buddy = { 0 },
+    .pa_map = { 0 },
 };
 
 /**
@@ -135,7 +165,7 @@ static uint64_t mm_pages_u64(uint64_t start, uint64_t end)
  */
 static int mm_region_add(mm_region_t *arr, int cap, int *count,
                          uint64_t start, uint64_t end, 
-                         uint8_t pte_flags, uint8_t protect_flags, const char *source)
+                         uint8_t pte_flags, uint16_t protect_flags, const char *source)
 {
     start = mm_align_down(start, MM_PAGE_SIZE);
     end = mm_align_up(end, MM_PAGE_SIZE);
@@ -158,7 +188,77 @@ static int mm_region_add(mm_region_t *arr, int cap, int *count,
 }
 
 /**
- * Sortuje regiony pamięci według adresu początkowego (algorytm insertion-sort).
+ * Dodaje region do bufora (jak mm_region_add). Pełny bufor z grow jest przenoszony
+ * do dwa razy większego w scratch memblock; poprzedni zostaje do memblock_scratch_release.
+ * @param buf Bufor regionów
+ * @param start Adres początkowy regionu
+ * @param end Adres końcowy regionu
+ * @param pte_flags Flagi uprawnień PTE (R/W/X)
+ * @param protect_flags Flagi ochronne (MM_FLAG_*)
+ * @param source Źródło regionu
+ * @return 0 jeśli sukces, kod błędu w przeciwnym razie
+ */
+static int mm_region_buf_add(mm_region_buf_t *buf, uint64_t start, uint64_t end,
+                             uint8_t pte_flags, uint16_t protect_flags, const char *source)
+{
+    if (buf->count >= buf->cap && buf->grow) {
+        int cap = buf->cap ? buf->cap * 2 : MM_REGION_WORKSPACE_INIT;
+        mm_region_t *regions = memblock_alloc_scratch((uint64_t)cap * sizeof(mm_region_t),
+                                                      sizeof(uint64_t));
+        int i;
+
+        if (!regions)
+            return MM_ERR_MEMBLOCK;
+        for (i = 0; i < buf->count; i++)
+            regions[i] = buf->regions[i];
+        buf->regions = regions;
+        buf->cap = cap;
+    }
+
+    return mm_region_add(buf->regions, buf->cap, &buf->count,
+                         start, end, pte_flags, protect_flags, source);
+}
+
+/**
+ * Porządek regionów: po adresie początkowym, przy równym początku po końcu.
+ * @param a Pierwszy region
+ * @param b Drugi region
+ * @return 1 jeśli a jest przed b, 0 w przeciwnym razie
+ */
+static int mm_region_less(const mm_region_t *a, const mm_region_t *b)
+{
+    return a->start < b->start || (a->start == b->start && a->end < b->end);
+}
+
+/**
+ * Przesiewa element w dół kopca (max-heap według mm_region_less).
+ * @param arr Tablica regionów
+ * @param root Indeks przesiewanego elementu
+ * @param count Liczba elementów kopca
+ */
+static void mm_sift_down(mm_region_t *arr, int root, int count)
+{
+    for (;;) {
+        int child = 2 * root + 1;
+        mm_region_t tmp;
+
+        if (child >= count)
+            return;
+        if (child + 1 < count && mm_region_less(&arr[child], &arr[child + 1]))
+            child++;
+        if (!mm_region_less(&arr[root], &arr[child]))
+            return;
+
+        tmp = arr[root];
+        arr[root] = arr[child];
+        arr[child] = tmp;
+        root = child;
+    }
+}
+
+/**
+ * Sortuje regiony pamięci według adresu początkowego (heapsort: O(n log n)
+ * bez dodatkowej pamięci, więc działa też na tysiącach regionów w memblock).
  * @param arr Tablica regionów do posortowania
  * @param count Liczba elementów w tablicy
  */
@@ -166,15 +266,15 @@ static void mm_sort_regions(mm_region_t *arr, int count)
 {
     int i;
 
-    for (i = 1; i < count; i++) {
-        mm_region_t key = arr[i];
-        int j = i - 1;
+    for (i = count / 2 - 1; i >= 0; i--)
+        mm_sift_down(arr, i, count);
 
-        while (j >= 0 && arr[j].start > key.start) {
-            arr[j + 1] = arr[j];
-            j--;
-        }
-        arr[j + 1] = key;
+    for (i = count - 1; i > 0; i--) {
+        mm_region_t tmp = arr[0];
+
+        arr[0] = arr[i];
+        arr[i] = tmp;
+        mm_sift_down(arr, 0, i);
     }
 }
 
@@ -233,69 +333,318 @@ static uint64_t mm_sum_pages(const mm_region_t *arr, int count)
     return sum;
 }
 
+/**
+ * Dopisuje nazwę źródła regionu do g_mm_sources. Powtórzenie ostatniego źródła
+ * (kolejne rezerwacje tego samego alokatora) dostaje ten sam identyfikator.
+ * @param source Nazwa źródła
+ * @param id Identyfikator źródła dla source_ids[] (wyjście)
+ * @return 0 jeśli sukces, MM_ERR_REGION_CAP gdy tablica jest pełna
+ */
+static int mm_source_add(const char *source, uint32_t *id)
+{
+    if (g_mm_source_count > MM_SOURCE_FIRST && g_mm_sources[g_mm_source_count - 1] == source) {
+        *id = g_mm_source_count - 1;
+        return 0;
+    }
+    if (g_mm_source_count >= g_mm_source_cap)
+        return MM_ERR_REGION_CAP;
+
+    g_mm_sources[g_mm_source_count] = source;
+    *id = g_mm_source_count++;
+    return 0;
+}
+
+/**
+ * Dodaje region do zbioru, wyrównując adresy do rozmiaru strony (jak mm_region_add).
+ * @param set Zbiór regionów
+ * @param start Adres początkowy regionu
+ * @param end Adres końcowy regionu
+ * @param flags Flagi regionu (MM_SET_FLAGS)
+ * @param source_id Identyfikator źródła
+ * @return 0 jeśli sukces, kod błędu w przeciwnym razie
+ */
+static int mm_set_add(mm_region_set_t *set, uint64_t start, uint64_t end,
+                      uint32_t flags, uint32_t source_id)
+{
+    start = mm_align_down(start, MM_PAGE_SIZE);
+    end = mm_align_up(end, MM_PAGE_SIZE);
+
+    if (end <= start)
+        return 0;
+    if (set->count >= set->cap)
+        return MM_ERR_REGION_CAP;
+
+    set->starts[set->count] = start;
+    set->ends[set->count] = end;
+    set->flags[set->count] = flags;
+    set->source_ids[set->count] = source_id;
+    set->count++;
+
+    return 0;
+}
+
+/**
+ * Porządek wpisów zbioru, ten sam co mm_region_less.
+ */
+static int mm_set_less(const mm_region_set_t *set, int a, int b)
+{
+    return set->starts[a] < set->starts[b] ||
+           (set->starts[a] == set->starts[b] && set->ends[a] < set->ends[b]);
+}
+
+/**
+ * Zamienia miejscami dwa wpisy zbioru we wszystkich tablicach.
+ */
+static void mm_set_swap(mm_region_set_t *set, int a, int b)
+{
+    uint64_t start = set->starts[a];
+    uint64_t end = set->ends[a];
+    uint32_t flags = set->flags[a];
+    uint32_t source_id = set->source_ids[a];
+
+    set->starts[a] = set->starts[b];
+    set->ends[a] = set->ends[b];
+    set->flags[a] = set->flags[b];
+    set->source_ids[a] = set->source_ids[b];
+    set->starts[b] = start;
+    set->ends[b] = end;
+    set->flags[b] = flags;
+    set->source_ids[b] = source_id;
+}
+
+/**
+ * Przesiewa wpis w dół kopca (jak mm_sift_down).
+ * @param set Zbiór regionów
+ * @param root Indeks przesiewanego wpisu
+ * @param count Liczba wpisów kopca
+ */
+static void mm_set_sift_down(mm_region_set_t *set, int root, int count)
+{
+    for (;;) {
+        int child = 2 * root + 1;
+
+        if (child >= count)
+            return;
+        if (child + 1 < count && mm_set_less(set, child, child + 1))
+            child++;
+        if (!mm_set_less(set, root, child))
+            return;
+
+        mm_set_swap(set, root, child);
+        root = child;
+    }
+}
+
+/**
+ * Sortuje zbiór regionów według adresu początkowego (heapsort).
+ * @param set Zbiór regionów
+ */
+static void mm_set_sort(mm_region_set_t *set)
+{
+    int i;
+
+    for (i = set->count / 2 - 1; i >= 0; i--)
+        mm_set_sift_down(set, i, set->count);
+
+    for (i = set->count - 1; i > 0; i--) {
+        mm_set_swap(set, 0, i);
+        mm_set_sift_down(set, 0, i);
+    }
+}
+
+/**
+ * Scala sąsiadujące lub nakładające się regiony zbioru o tych samych flagach
+ * (jak mm_merge_regions); set->count dostaje liczbę regionów po scaleniu.
+ * @param set Zbiór regionów
+ */
+static void mm_set_merge(mm_region_set_t *set)
+{
+    uint64_t *starts = set->starts;
+    uint64_t *ends = set->ends;
+    uint32_t *flags = set->flags;
+    uint32_t *source_ids = set->source_ids;
+    int i;
+    int out = 0;
+
+    if (set->count <= 1)
+        return;
+
+    mm_set_sort(set);
+
+    for (i = 1; i < set->count; i++) {
+        if (starts[i] <= ends[out] && flags[i] == flags[out]) {
+            if (ends[i] > ends[out])
+                ends[out] = ends[i];
+            if (source_ids[i] != source_ids[out])
+                source_ids[out] = MM_SOURCE_MERGED;
+            continue;
+        }
+
+        out++;
+        if (out != i) {
+            starts[out] = starts[i];
+            ends[out] = ends[i];
+            flags[out] = flags[i];
+            source_ids[out] = source_ids[i];
+        }
+    }
+
+    set->count = out + 1;
+}
+
+/**
+ * Sumuje liczbę stron w zbiorze. Wpisy są wyrównane do stron i niepuste
+ * (mm_set_add), więc wystarczy suma długości.
+ * @param set Zbiór regionów
+ * @return Suma stron we wszystkich regionach
+ */
+static uint64_t mm_set_sum_pages(const mm_region_set_t *set)
+{
+    const uint64_t *starts = set->starts;
+    const uint64_t *ends = set->ends;
+    uint64_t bytes = 0;
+    int i;
+
+    for (i = 0; i < set->count; i++)
+        bytes += ends[i] - starts[i];
+
+    return bytes / MM_PAGE_SIZE;
+}
+
+/**
+ * Przepisuje zbiór do tablicy mm_region_t (mm_stage2_dump, indeks, mm_pa_classify
+ * i moduły czytające mm_state_t).
+ * @param set Zbiór regionów
+ * @param out Tablica wyjściowa (co najmniej set->count elementów)
+ * @param first Pierwszy przepisywany wpis (wcześniejsze są już aktualne)
+ */
+static void mm_set_export(const mm_region_set_t *set, mm_region_t *out, int first)
+{
+    int i;
+
+    for (i = first; i < set->count; i++) {
+        out[i].start = set->starts[i];
+        out[i].end = set->ends[i];
+        out[i].pte_flags = MM_SET_PTE(set->flags[i]);
+        out[i].protect_flags = MM_SET_PROT(set->flags[i]);
+        out[i].source = g_mm_sources[set->source_ids[i]];
+    }
+}
+
+/**
+ * Szuka miejsca wstawienia zakresu w posortowanym zbiorze (porządek mm_set_less).
+ * @param set Zbiór regionów posortowany po początku i końcu
+ * @param start Początek zakresu
+ * @param end Koniec zakresu
+ * @return Indeks pierwszego wpisu nie mniejszego od [start, end)
+ */
+static int mm_set_lower_bound(const mm_region_set_t *set, uint64_t start, uint64_t end)
+{
+    int lo = 0;
+    int hi = set->count;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+
+        if (set->starts[mid] < start || (set->starts[mid] == start && set->ends[mid] < end))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/**
+ * Szuka pierwszego wpisu kończącego się za adresem w zbiorze rozłącznym i posortowanym
+ * (końce też są wtedy posortowane).
+ * @param set Zbiór regionów
+ * @param addr Adres
+ * @return Indeks pierwszego wpisu z end > addr (set->count, gdy takiego nie ma)
+ */
+static int mm_set_upper_bound_end(const mm_region_set_t *set, uint64_t addr)
+{
+    int lo = 0;
+    int hi = set->count;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+
+        if (set->ends[mid] <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/**
+ * Zastępuje wpisy [lo, hi) zbioru miejscem na n wpisów, przesuwając ogon.
+ * Wpisy przed lo i pozostawione na miejscu wpisy z [lo, lo + n) są nietknięte;
+ * wywołujący wypełnia nowe miejsca i dba o pojemność.
+ * @param set Zbiór regionów
+ * @param lo Pierwszy zastępowany wpis
+ * @param hi Koniec zastępowanych wpisów (wyłączny)
+ * @param n Liczba wpisów na ich miejsce
+ */
+static void mm_set_replace(mm_region_set_t *set, int lo, int hi, int n)
+{
+    int shift = n - (hi - lo);
+    int i;
+
+    if (shift > 0) {
+        for (i = set->count - 1; i >= hi; i--) {
+            set->starts[i + shift] = set->starts[i];
+            set->ends[i + shift] = set->ends[i];
+            set->flags[i + shift] = set->flags[i];
+            set->source_ids[i + shift] = set->source_ids[i];
+        }
+    } else if (shift < 0) {
+        for (i = hi; i < set->count; i++) {
+            set->starts[i + shift] = set->starts[i];
+            set->ends[i + shift] = set->ends[i];
+            set->flags[i + shift] = set->flags[i];
+            set->source_ids[i + shift] = set->source_ids[i];
+        }
+    }
+
+    set->count += shift;
+}
+
 /**
  * Sumuje strony z regionów, które mieszczą się w regionach RAM.
  * Oblicza ilość pamięci zarezerwowanej wewnątrz RAM.
  * Uwzględnia tylko unikalne strony (nie sumuje wielokrotnie tego samego obszaru).
- * @param regions Tablica regionów do zsumowania
- * @param region_count Liczba regionów
+ * Regiony muszą być posortowane po początku (mogą się nakładać), RAM posortowany
+ * i rozłączny: jedno przejście scala nakładające się regiony i przycina je do RAM.
+ * @param set Zbiór regionów do zsumowania
  * @param ram Tablica regionów RAM
  * @param ram_count Liczba regionów RAM
  * @return Suma stron przyciętych do RAM
  */
-static uint64_t mm_sum_pages_clipped_to_ram(const mm_region_t *regions, int region_count,
+static uint64_t mm_sum_pages_clipped_to_ram(const mm_region_set_t *set,
                                             const mm_region_t *ram, int ram_count)
 {
-    int i, j;
-    uint64_t starts[MM_MAX_RANGES];
-    uint64_t ends[MM_MAX_RANGES];
-    int range_count = 0;
+    const uint64_t *starts = set->starts;
+    const uint64_t *ends = set->ends;
+    int i = 0;
+    int j = 0;
     uint64_t sum = 0;
 
-    /* Najpierw zbieramy wszystkie unikalne zakresy */
-    for (i = 0; i < region_count && range_count < MM_MAX_RANGES; i++) {
-        for (j = 0; j < ram_count; j++) {
-            uint64_t start = mm_max_u64(regions[i].start, ram[j].start);
-            uint64_t end = mm_min_u64(regions[i].end, ram[j].end);
-            
-            if (end > start) {
-                starts[range_count] = start;
-                ends[range_count] = end;
-                range_count++;
-            }
-        }
-    }
+    while (i < set->count) {
+        uint64_t start = starts[i];
+        uint64_t end = ends[i];
+        int k;
 
-    /* Sortujemy zakresy */
-    for (i = 0; i < range_count - 1; i++) {
-        for (j = i + 1; j < range_count; j++) {
-            if (starts[i] > starts[j]) {
-                uint64_t tmp = starts[i];
-                starts[i] = starts[j];
-                starts[j] = tmp;
-                tmp = ends[i];
-                ends[i] = ends[j];
-                ends[j] = tmp;
-            }
-        }
-    }
+        for (i++; i < set->count && starts[i] <= end; i++)
+            end = mm_max_u64(end, ends[i]);
 
-    /* Sumujemy unikalne zakresy */
-    if (range_count > 0) {
-        uint64_t current_start = starts[0];
-        uint64_t current_end = ends[0];
-        
-        for (i = 1; i < range_count; i++) {
-            if (starts[i] <= current_end) {
-                if (ends[i] > current_end)
-                    current_end = ends[i];
-            } else {
-                sum += mm_pages_u64(current_start, current_end);
-                current_start = starts[i];
-                current_end = ends[i];
-            }
-        }
-        sum += mm_pages_u64(current_start, current_end);
+        while (j < ram_count && ram[j].end <= start)
+            j++;
+
+        for (k = j; k < ram_count && ram[k].start < end; k++)
+            sum += mm_pages_u64(mm_max_u64(start, ram[k].start), mm_min_u64(end, ram[k].end));
     }
 
     return sum;
@@ -315,8 +664,34 @@ static int mm_ranges_overlap(uint64_t a_start, uint64_t a_end,
     return a_start < b_end && b_start < a_end;
 }
 
+/**
+ * Zwraca liczbę regionów, które zaczynają się nie później niż addr (wyszukiwanie binarne).
+ * @param regions Tablica regionów posortowana po początku
+ * @param count Liczba regionów
+ * @param addr Adres
+ * @return Indeks pierwszego regionu z start > addr
+ */
+static int mm_regions_upper_bound(const mm_region_t *regions, int count, uint64_t addr)
+{
+    int lo = 0;
+    int hi = count;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+
+        if (regions[mid].start <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
 /**
  * Sprawdza czy dany zakres nakłada się z którymkolwiek z podanych regionów.
+ * Regiony muszą być posortowane i rozłączne (RAM, free po scaleniu), więc wystarczy
+ * sprawdzić ostatni region zaczynający się przed końcem zakresu.
  * @param start Początek sprawdzanego zakresu
  * @param end Koniec sprawdzanego zakresu
  * @param regions Tablica regionów do sprawdzenia
@@ -328,26 +703,85 @@ static int mm_region_overlaps_any(uint64_t start, uint64_t end,
 {
     int i;
 
-    for (i = 0; i < count; i++) {
-        if (mm_ranges_overlap(start, end, regions[i].start, regions[i].end))
-            return 1;
+    if (end <= start)
+        return 0;
+
+    i = mm_regions_upper_bound(regions, count, end - 1ULL);
+    return i > 0 && regions[i - 1].end > start;
+}
+
+/**
+ * Buduje indeks przedziałowy nad tablicą posortowaną po początku (regiony mogą się
+ * nakładać). Tablica jest niejawnym zrównoważonym drzewem: korzeniem zakresu
+ * [lo, hi) jest jego środek, a max_end[mid] to największy koniec w tym zakresie.
+ * @param regions Tablica regionów posortowana po początku
+ * @param max_end Tablica wyjściowa (tyle elementów co regionów)
+ * @param lo Początek zakresu indeksów
+ * @param hi Koniec zakresu indeksów (wyłączny)
+ * @return Największy koniec w zakresie (0 dla pustego)
+ */
+static uint64_t mm_region_index_build(const mm_region_t *regions, uint64_t *max_end, int lo, int hi)
+{
+    int mid;
+    uint64_t end;
+
+    if (lo >= hi)
+        return 0;
+
+    mid = lo + (hi - lo) / 2;
+    end = regions[mid].end;
+    end = mm_max_u64(end, mm_region_index_build(regions, max_end, lo, mid));
+    end = mm_max_u64(end, mm_region_index_build(regions, max_end, mid + 1, hi));
+    max_end[mid] = end;
+
+    return end;
+}
+
+/**
+ * Szuka regionu nakładającego się z zakresem w indeksie z mm_region_index_build, w O(log n).
+ * Jeśli lewe poddrzewo ma koniec za start, a nic w nim się nie nakłada, to jego
+ * region z tym końcem zaczyna się za end - tak samo wszystkie na prawo, więc
+ * wystarczy zejść jedną ścieżką.
+ * @param regions Tablica regionów posortowana po początku
+ * @param max_end Indeks zbudowany przez mm_region_index_build
+ * @param count Liczba regionów
+ * @param start Początek zakresu
+ * @param end Koniec zakresu
+ * @return Indeks nakładającego się regionu albo -1
+ */
+static int mm_region_index_find(const mm_region_t *regions, const uint64_t *max_end, int count,
+                                uint64_t start, uint64_t end)
+{
+    int lo = 0;
+    int hi = count;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+
+        if (mm_ranges_overlap(start, end, regions[mid].start, regions[mid].end))
+            return mid;
+
+        if (lo < mid && max_end[lo + (mid - lo) / 2] > start)
+            hi = mid;
+        else
+            lo = mid + 1;
     }
 
-    return 0;
+    return -1;
 }
 
 /**
  * Dodaje region MMIO do listy zarezerwowanych regionów.
- * @param reserved Tablica zarezerwowanych regionów
- * @param cap Pojemność tablicy
- * @param reserved_count Wskaźnik do licznika
+ * @param reserved Bufor zarezerwowanych regionów
  * @param start Adres początkowy
  * @param size Rozmiar regionu
+ * @param protect_flags MM_FLAG_MMIO, opcjonalnie z MM_FLAG_WC
  * @param source Źródło regionu
  * @return 0 jeśli sukces, kod błędu w przeciwnym razie
  */
-static int mm_add_mmio_candidate(mm_region_t *reserved, int cap, int *reserved_count,
-                                 uint64_t start, uint64_t size, const char *source)
+static int mm_add_mmio_candidate(mm_region_buf_t *reserved,
+                                 uint64_t start, uint64_t size, uint16_t protect_flags,
+                                 const char *source)
 {
     uint64_t end;
 
@@ -356,111 +790,235 @@ static int mm_add_mmio_candidate(mm_region_t *reserved, int cap, int *reserved_c
 
     end = (size > UINT64_MAX - start) ? UINT64_MAX : start + size;
 
-    return mm_region_add(reserved, cap, reserved_count, start, end, MM_RW, MM_FLAG_MMIO, source);
+    return mm_region_buf_add(reserved, start, end, MM_RW, protect_flags, source);
 }
 
 /**
- * Zbiera regiony MMIO z Device Tree Blob (DTB).
- * Przeszukuje wszystkie urządzenia i ich rejestry, dodając te które nie mieszczą się w RAM.
- * @param reserved Tablica zarezerwowanych regionów
- * @param cap Pojemność tablicy
- * @param reserved_count Wskaźnik do licznika
+ * Dodaje regiony reg jednego urządzenia jako MMIO, pomijając te które leżą w RAM.
+ * Adresy są tłumaczone przez ranges wszystkich magistral nad urządzeniem (dtb_translate_reg).
+ * Framebuffery (MM_WC_COMPATIBLE) dostają dodatkowo MM_FLAG_WC.
+ * @param reserved Bufor zarezerwowanych regionów
+ * @param dev Urządzenie z DTB (zdekodowane regiony reg)
  * @param ram Tablica regionów RAM
  * @param ram_count Liczba regionów RAM
  * @return 0 jeśli sukces, kod błędu w przeciwnym razie
  */
-static int mm_collect_dtb_mmio_regions(mm_region_t *reserved, int cap, int *reserved_count,
-                                       const mm_region_t *ram, int ram_count)
+static int mm_add_device_mmio(mm_region_buf_t *reserved,
+                              const dtb_device_dyn_t *dev, const mm_region_t *ram, int ram_count)
 {
-    const void *fdt = dtb_get();
-    int depth = -1;
-    int node = -1;
-
-    if (!fdt)
-        return -FDT_ERR_BADSTATE;
-
-    node = fdt_next_node(fdt, -1, &depth);
-    while (node >= 0) {
-        int len;
-        int reg_idx;
-        const char *compatible = fdt_getprop(fdt, node, "compatible", &len);
-
-        if (compatible && len > 0 && compatible[0] != '\0') {
-            for (reg_idx = 0; reg_idx < DTB_MAX_REGS; reg_idx++) {
-                uint64_t base;
-                uint64_t size;
-                uint64_t end;
-                int reg_err = dtb_decode_reg(node, reg_idx, &base, &size);
-
-                if (reg_err == -FDT_ERR_NOTFOUND)
-                    break;
-                if (reg_err)
-                    continue;
-                if (!size)
-                    continue;
-
-                end = (size > UINT64_MAX - base) ? UINT64_MAX : base + size;
-
-                if (mm_region_overlaps_any(base, end, ram, ram_count))
-                    continue;
-
-                if (mm_add_mmio_candidate(reserved, cap, reserved_count,
-                                          base, size, compatible)) {
-                    return MM_ERR_REGION_CAP;
-                }
-            }
-        }
+    uint16_t protect_flags = MM_FLAG_MMIO;
+    int err;
+    int i;
+
+    if (dev->compatible && strcmp(dev->compatible, MM_WC_COMPATIBLE) == 0)
+        protect_flags |= MM_FLAG_WC;
+
+    for (i = 0; i < dev->reg_count; i++) {
+        uint64_t base = dev->regs[i].base;
+        uint64_t size = dev->regs[i].size;
+        uint64_t end;
+
+        if (!size)
+            continue;
+
+        /* reg jest w przestrzeni magistrali rodzica; jeśli się da, przejdź na adres CPU */
+        dtb_translate_reg(dev->node, base, &base);
+
+        end = (size > UINT64_MAX - base) ? UINT64_MAX : base + size;
 
-        node = fdt_next_node(fdt, node, &depth);
+        if (mm_region_overlaps_any(base, end, ram, ram_count))
+            continue;
+
+        err = mm_add_mmio_candidate(reserved, base, size, protect_flags, dev->compatible);
+        if (err)
+            return err;
     }
 
     return 0;
 }
 
 /**
- * Sprawdza czy wolne regiony nakładają się z zarezerwowanymi.
- * @param free_regions Tablica wolnych regionów
- * @param free_count Liczba wolnych regionów
- * @param reserved Tablica zarezerwowanych regionów
- * @param reserved_count Liczba zarezerwowanych regionów
- * @return 1 jeśli występuje nakładanie, 0 w przeciwnym razie
+ * Zbiera regiony MMIO z Device Tree Blob (DTB).
+ * Każde włączone urządzenie jest czytane przez dtb_device_read_alloc do tablic dokładnej
+ * długości w arenie (bez limitu DTB_MAX_REGS i bez kopiowania pełnego dtb_device_t);
+ * po dopisaniu jego okien arena wraca do stanu sprzed odczytu, jak scratch.
+ * Dodaje rejestry, które nie mieszczą się w RAM.
+ * @param arena Arena na tymczasowe tablice urządzenia
+ * @param reserved Bufor zarezerwowanych regionów
+ * @param ram Tablica regionów RAM
+ * @param ram_count Liczba regionów RAM
+ * @return 0 jeśli sukces, MM_ERR_DTB_DEVICE_SCAN przy błędzie DTB, MM_ERR_MEMBLOCK gdy
+ *         urządzenie nie mieści się w arenie, błąd dopisywania regionu bez zmian
  */
-static int mm_free_overlaps_reserved(const mm_region_t *free_regions, int free_count,
-                                     const mm_region_t *reserved, int reserved_count)
+static int mm_collect_dtb_mmio_regions(dtb_arena_t *arena, mm_region_buf_t *reserved,
+                                       const mm_region_t *ram, int ram_count)
 {
-    int i;
-    int j;
+    dtb_device_dyn_t dev;
+    uint64_t mark = arena->used;
+    int node;
+    int err;
 
-    for (i = 0; i < free_count; i++) {
-        for (j = 0; j < reserved_count; j++) {
-            if (mm_ranges_overlap(free_regions[i].start, free_regions[i].end,
-                                  reserved[j].start, reserved[j].end)) {
-                return 1;
-            }
-        }
+    for (err = dtb_device_first(&node); !err; err = dtb_device_next(&node)) {
+        int read_err = dtb_device_read_alloc(arena, node, &dev);
+        int add_err = 0;
+
+        /* Węzeł z niepoprawnym reg jest pomijany, jak wcześniej przy dtb_device_read */
+        if (!read_err)
+            add_err = mm_add_device_mmio(reserved, &dev, ram, ram_count);
+        arena->used = mark;
+
+        if (read_err == -FDT_ERR_NOSPACE)
+            return MM_ERR_MEMBLOCK;
+        if (add_err)
+            return add_err;
     }
 
-    return 0;
+    return (err == -FDT_ERR_NOTFOUND) ? 0 : MM_ERR_DTB_DEVICE_SCAN;
 }
 
 /**
- * Sprawdza czy dany adres mieści się w jednym z podanych regionów.
- * @param addr Adres do sprawdzenia
- * @param regions Tablica regionów
- * @param count Liczba regionów
- * @return 1 jeśli adres jest w regionie, 0 w przeciwnym razie
+ * Zbiera wszystkie regiony mapy pamięci, które wynikają wyłącznie z DTB:
+ * scalone banki RAM (tablica dokładnej długości w arenie), regiony /reserved-memory
+ * i okna MMIO włączonych urządzeń leżące poza RAM (dopisywane do reserved).
+ * Wynik zależy tylko od bloba, więc tę samą funkcję woła tools/dtb_precompile
+ * przy budowaniu prekompilowanego opisu platformy.
+ * @param arena Arena na tablice RAM i tymczasowe rekordy urządzeń
+ * @param ram Wskaźnik na tablicę regionów RAM (wyjście)
+ * @param ram_count Liczba regionów RAM (wyjście)
+ * @param reserved Bufor zarezerwowanych regionów (dopisywanie)
+ * @return 0 jeśli sukces, kod błędu w przeciwnym razie
  */
-static int mm_addr_in_regions(uint64_t addr, const mm_region_t *regions, int count)
+int mm_dtb_regions_collect(dtb_arena_t *arena, mm_region_t **ram, int *ram_count,
+                           mm_region_buf_t *reserved)
 {
+    dtb_addr_t *dtb_ram = 0;
+    dtb_addr_t *dtb_reserved = g_dtb_reserved_regions;
+    mm_region_t *regions;
+    int dtb_ram_count = 0;
+    int dtb_reserved_count = 0;
+    int count = 0;
     int i;
+    int err;
 
-    for (i = 0; i < count; i++) {
-        if (regions[i].start <= addr && addr < regions[i].end)
-            return 1;
+    if (!arena || !ram || !ram_count || !reserved)
+        return MM_ERR_BADVALUE;
+
+    /* Banki RAM bez limitu DTB_MAX_MEM_REGIONS: tablice dokładnej długości w arenie */
+    err = dtb_memory_regions_alloc(arena, &dtb_ram, &dtb_ram_count);
+    if (err)
+        return MM_ERR_DTB_RAM;
+
+    regions = dtb_arena_alloc(arena, (uint64_t)dtb_ram_count * sizeof(mm_region_t), sizeof(uint64_t));
+    if (!regions && dtb_ram_count)
+        return MM_ERR_MEMBLOCK;
+
+    for (i = 0; i < dtb_ram_count; i++) {
+        err = mm_region_add(regions, dtb_ram_count, &count,
+                            dtb_ram[i].base, dtb_ram[i].base + dtb_ram[i].size,
+                            MM_RW, MM_FLAG_ALLOCATABLE, "dtb-memory");
+        if (err)
+            return err;
     }
 
-    return 0;
-}
+    count = mm_merge_regions(regions, count);
+
+    err = dtb_reserved_memory_regions(dtb_reserved, DTB_MAX_MEM_REGIONS, &dtb_reserved_count);
+    if (!err || err == -FDT_ERR_NOSPACE) {
+        for (i = 0; i < dtb_reserved_count; i++) {
+            err = mm_region_buf_add(reserved,
+                                    dtb_reserved[i].base,
+                                    dtb_reserved[i].base + dtb_reserved[i].size,
+                                    MM_R, MM_FLAG_RESERVED, "dtb-reserved");
+            if (err)
+                return err;
+        }
+    } else if (err != -FDT_ERR_NOTFOUND) {
+        return MM_ERR_DTB_RESERVED;
+    }
+
+    err = mm_collect_dtb_mmio_regions(arena, reserved, regions, count);
+    if (err)
+        return err;
+
+    *ram = regions;
+    *ram_count = count;
+    return 0;
+}
+
+/**
+ * Przenosi regiony z prekompilowanego opisu platformy do mapy pamięci, zamiast zbierać je z DTB.
+ * RAM jest kopiowany do areny (mm_state_t trzyma modyfikowalną tablicę), reserved jest dopisywane.
+ * @param desc Opis platformy wybrany przez platform_desc_select
+ * @param arena Arena na tablicę RAM
+ * @param ram Wskaźnik na tablicę regionów RAM (wyjście)
+ * @param ram_count Liczba regionów RAM (wyjście)
+ * @param reserved Bufor zarezerwowanych regionów (dopisywanie)
+ * @return 0 jeśli sukces, kod błędu w przeciwnym razie
+ */
+static int mm_desc_regions_load(const platform_desc_t *desc, dtb_arena_t *arena,
+                                mm_region_t **ram, int *ram_count, mm_region_buf_t *reserved)
+{
+    const mm_region_t *r;
+    mm_region_t *regions;
+    int err;
+    int i;
+
+    regions = dtb_arena_alloc(arena, (uint64_t)desc->ram_count * sizeof(mm_region_t), sizeof(uint64_t));
+    if (!regions && desc->ram_count)
+        return MM_ERR_MEMBLOCK;
+
+    for (i = 0; i < desc->ram_count; i++)
+        regions[i] = desc->ram[i];
+
+    for (i = 0; i < desc->reserved_count; i++) {
+        r = &desc->reserved[i];
+        err = mm_region_buf_add(reserved, r->start, r->end, r->pte_flags, r->protect_flags, r->source);
+        if (err)
+            return err;
+    }
+
+    *ram = regions;
+    *ram_count = desc->ram_count;
+    return 0;
+}
+
+/**
+ * Sprawdza czy wolne regiony nakładają się z zarezerwowanymi.
+ * @param free_regions Tablica wolnych regionów
+ * @param free_count Liczba wolnych regionów
+ * @param reserved Tablica zarezerwowanych regionów (posortowana)
+ * @param max_end Indeks przedziałowy reserved (mm_region_index_build)
+ * @param reserved_count Liczba zarezerwowanych regionów
+ * @return 1 jeśli występuje nakładanie, 0 w przeciwnym razie
+ */
+static int mm_free_overlaps_reserved(const mm_region_t *free_regions, int free_count,
+                                     const mm_region_t *reserved, const uint64_t *max_end,
+                                     int reserved_count)
+{
+    int i;
+
+    for (i = 0; i < free_count; i++) {
+        if (mm_region_index_find(reserved, max_end, reserved_count,
+                                 free_regions[i].start, free_regions[i].end) >= 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Sprawdza czy dany adres mieści się w jednym z podanych regionów.
+ * @param addr Adres do sprawdzenia
+ * @param regions Tablica regionów (posortowana i rozłączna)
+ * @param count Liczba regionów
+ * @return 1 jeśli adres jest w regionie, 0 w przeciwnym razie
+ */
+static int mm_addr_in_regions(uint64_t addr, const mm_region_t *regions, int count)
+{
+    int i = mm_regions_upper_bound(regions, count, addr);
+
+    return i > 0 && addr < regions[i - 1].end;
+}
 
 /**
  * Konwertuje flagi PTE na tekstowy opis.
@@ -486,7 +1044,7 @@ static void mm_dump_pte_flags(uint8_t flags)
 /**
  * Konwertuje flagi ochronne na tekstowy opis.
  */
-static void mm_dump_prot_flags(uint8_t flags)
+static void mm_dump_prot_flags(uint16_t flags)
 {
     if (flags & MM_FLAG_ALLOCATABLE)
         uart_console_puts("ALLOC");
@@ -501,6 +1059,8 @@ static void mm_dump_prot_flags(uint8_t flags)
         uart_console_puts("|MMIO");
     if (flags & MM_FLAG_DTB)
         uart_console_puts("|DTB");
+    if (flags & MM_FLAG_WC)
+        uart_console_puts("|WC");
 }
 
 /**
@@ -535,152 +1095,228 @@ static void mm_dump_range_line(const char *tag, int idx, const mm_region_t *r)
 }
 
 /**
- * Buduje mapę pamięci systemu i zapisuje wynik do zmiennych globalnych.
- * 
- * Proces:
- * 1. Pobiera regiony RAM z DTB
- * 2. Dodaje regiony zarezerwowane (kernel, boot, DTB, urządzenia)
- * 3. Oblicza wolne regiony jako RAM minus zarezerwowane
- * 4. Weryfikuje poprawność mapy pamięci
- * 
- * @param hw Wskaźnik do struktury stanu sprzętowego
- * @return 0 jeśli sukces, kod błędu w przeciwnym razie
+ * Nakłada region zarezerwowany na płaską mapę (wycinając przykryte części wpisów).
+ * Mapa jest rozłączna i posortowana, a nic w niej nie zaczyna się za r->start
+ * poza resztkami wcześniejszych regionów, więc r przecina tylko jej końcówkę.
+ * @param map Mapa
+ * @param count Liczba wpisów mapy
+ * @param r Region
+ * @return Nowa liczba wpisów albo MM_ERR_REGION_CAP
  */
-int mm_stage2_build(const hw_state_t *hw)
+static int mm_pa_map_insert(mm_region_t *map, int count, const mm_region_t *r)
 {
-    mm_region_t *ram = g_mm_ram;
-    mm_region_t *reserved = g_mm_reserved;
-    mm_region_t *free_regions = g_mm_free;
-    dtb_addr_t *dtb_ram = g_dtb_ram_regions;
-    dtb_addr_t *dtb_reserved = g_dtb_reserved_regions;
-    int ram_count = 0;
-    int reserved_count = 0;
-    int free_count = 0;
-    int dtb_ram_count = 0;
-    int dtb_reserved_count = 0;
-    int i;
-    int err;
-    uint64_t first_free_frame;
-    uint64_t ram_pages;
-    uint64_t reserved_pages;
-    uint64_t reserved_pages_in_ram;
-    uint64_t free_pages;
-    int totals_ok;
-    int first_free_ok;
-    int overlap_free_reserved;
-    const void *fdt;
-
-    if (!hw)
-        return MM_ERR_BADVALUE;
-
-    err = dtb_memory_regions(dtb_ram, DTB_MAX_MEM_REGIONS, &dtb_ram_count);
-    if (err)
-        return MM_ERR_DTB_RAM;
+    mm_region_t before;
+    int has_before = 0;
+    int tail = count;
+    int after = 0;
+    int k;
+
+    while (tail > 0 && map[tail - 1].end > r->start)
+        tail--;
+
+    if (tail < count && map[tail].start < r->start) {
+        before = map[tail];
+        before.end = r->start;
+        has_before = 1;
+    }
 
-    for (i = 0; i < dtb_ram_count; i++) {
-        err = mm_region_add(ram, MM_MAX_RAM_REGIONS, &ram_count,
-                            dtb_ram[i].base, dtb_ram[i].base + dtb_ram[i].size,
-                            MM_RW, MM_FLAG_ALLOCATABLE, "dtb-memory");
-        if (err)
-            return err;
+    for (k = tail; k < count; k++) {
+        if (map[k].end <= r->end)
+            continue;
+        map[tail + after] = map[k];
+        if (map[tail + after].start < r->end)
+            map[tail + after].start = r->end;
+        after++;
     }
 
-    ram_count = mm_merge_regions(ram, ram_count);
+    if (tail + has_before + 1 + after > g_mm_pa_map_cap)
+        return MM_ERR_REGION_CAP;
 
-    first_free_frame = mm_align_up((uint64_t)(uintptr_t)_kernel_image_end, MM_PAGE_SIZE);
+    for (k = after - 1; k >= 0; k--)
+        map[tail + has_before + 1 + k] = map[tail + k];
+    if (has_before)
+        map[tail] = before;
+    map[tail + has_before] = *r;
+    return tail + has_before + 1 + after;
+}
 
-    err = mm_region_add(reserved, MM_REGION_WORKSPACE_CAP, &reserved_count,
-                        (uint64_t)(uintptr_t)_kernel_start,
-                        (uint64_t)(uintptr_t)_kernel_image_end,
-                        MM_RWX, MM_FLAG_KERNEL | MM_FLAG_RESERVED, "kernel");
-    if (err)
-        return err;
+/**
+ * Buduje płaską mapę adresów fizycznych: rozłączne wycinki regionów zarezerwowanych
+ * scalone z wolnymi. Gdzie regiony zarezerwowane się nakładają, wygrywa węższy
+ * (np. okno wewnątrz szerszej rezerwacji): ten, który zaczyna się później, a przy
+ * równym początku ten, który kończy się wcześniej. reserved jest posortowane po
+ * (start, end) rosnąco, więc serie o równym początku są nakładane od końca.
+ * Każdy region dokłada co najwyżej dwa wpisy (swój i resztę przeciętego), więc
+ * wystarcza 2 * reserved + free wpisów.
+ * @param reserved Tablica zarezerwowanych regionów (posortowana po początku i końcu)
+ * @param reserved_count Liczba zarezerwowanych regionów
+ * @param free_regions Tablica wolnych regionów (posortowana, rozłączna z reserved)
+ * @param free_count Liczba wolnych regionów
+ * @return 0 jeśli sukces, kod błędu w przeciwnym razie
+ */
+static int mm_pa_map_build(const mm_region_t *reserved, int reserved_count,
+                           const mm_region_t *free_regions, int free_count)
+{
+    mm_region_t *map = g_mm_pa_map;
+    int count = 0;
+    int run;
+    int i;
+    int j;
+    int w;
 
-    err = mm_region_add(reserved, MM_REGION_WORKSPACE_CAP, &reserved_count,
-                        hw->mem_base, (uint64_t)(uintptr_t)_kernel_start,
-                        MM_R, MM_FLAG_BOOT | MM_FLAG_RESERVED, "boot-reserved");
-    if (err)
-        return err;
+    for (i = 0; i < reserved_count; i = run) {
+        for (run = i + 1; run < reserved_count && reserved[run].start == reserved[i].start; run++)
+            ;
 
-    fdt = dtb_get();
-    if (fdt && fdt_totalsize(fdt) > 0) {
-        uint64_t dtb_start = (uint64_t)(uintptr_t)fdt;
-        uint64_t dtb_end = dtb_start + (uint64_t)fdt_totalsize(fdt);
-        err = mm_region_add(reserved, MM_REGION_WORKSPACE_CAP, &reserved_count,
-                            dtb_start, dtb_end,
-                            MM_R, MM_FLAG_DTB | MM_FLAG_RESERVED, "dtb");
-        if (err)
-            return err;
+        for (j = run - 1; j >= i; j--) {
+            count = mm_pa_map_insert(map, count, &reserved[j]);
+            if (count < 0)
+                return count;
+        }
     }
 
-    err = dtb_reserved_memory_regions(dtb_reserved, DTB_MAX_MEM_REGIONS, &dtb_reserved_count);
-    if (!err || err == -FDT_ERR_NOSPACE) {
-        for (i = 0; i < dtb_reserved_count; i++) {
-            err = mm_region_add(reserved, MM_REGION_WORKSPACE_CAP, &reserved_count,
-                                dtb_reserved[i].base,
-                                dtb_reserved[i].base + dtb_reserved[i].size,
-                                MM_R, MM_FLAG_RESERVED, "dtb-reserved");
-            if (err)
-                return err;
-        }
-    } else if (err != -FDT_ERR_NOTFOUND) {
-        return MM_ERR_DTB_RESERVED;
+    if (count + free_count > g_mm_pa_map_cap)
+        return MM_ERR_REGION_CAP;
+
+    /* Scalanie od końca w miejscu: pozycja zapisu nigdy nie wyprzedza odczytu */
+    i = count - 1;
+    j = free_count - 1;
+    for (w = count + free_count - 1; j >= 0; w--) {
+        if (i >= 0 && map[i].start > free_regions[j].start)
+            map[w] = map[i--];
+        else
+            map[w] = free_regions[j--];
     }
 
-    err = mm_collect_dtb_mmio_regions(reserved, MM_REGION_WORKSPACE_CAP, &reserved_count,
-                                      ram, ram_count);
-    if (err)
-        return MM_ERR_DTB_DEVICE_SCAN;
+    g_mm_state.pa_map.regions = map;
+    g_mm_state.pa_map.count = count + free_count;
+    g_mm_state.pa_map.generation++;
+    return 0;
+}
 
-    reserved_count = mm_merge_regions(reserved, reserved_count);
+/**
+ * Rozcina w miejscu wpis płaskiej mapy, który jest całym wolnym regionem, na podane
+ * wpisy (resztki wolnego i region zarezerwowany z mm_stage2_reserve).
+ * @param free_start Początek wolnego regionu
+ * @param free_end Koniec wolnego regionu
+ * @param split Wpisy zastępujące (posortowane, pokrywające [free_start, free_end))
+ * @param n Liczba wpisów zastępujących
+ * @return 0 jeśli sukces, -1 gdy mapa nie ma takiego wpisu albo miejsca
+ */
+static int mm_pa_map_split(uint64_t free_start, uint64_t free_end, const mm_region_t *split, int n)
+{
+    mm_region_t *map = g_mm_pa_map;
+    int count = g_mm_state.pa_map.count;
+    int i = mm_regions_upper_bound(map, count, free_start) - 1;
+    int k;
+
+    if (i < 0 || map[i].start != free_start || map[i].end != free_end ||
+        count + n - 1 > g_mm_pa_map_cap)
+        return -1;
+
+    for (k = count - 1; k > i; k--)
+        map[k + n - 1] = map[k];
+    for (k = 0; k < n; k++)
+        map[i + k] = split[k];
+
+    g_mm_state.pa_map.count = count + n - 1;
+    g_mm_state.pa_map.generation++;
+    return 0;
+}
+
+/**
+ * Kończy budowę mapy: scala regiony zarezerwowane, liczy wolne regiony jako RAM minus
+ * zarezerwowane, sumuje strony, weryfikuje mapę i zapisuje wynik do g_mm_state.
+ * Scalanie, wycinanie i sumy działają na zbiorach SoA (reserved_set, free_set);
+ * tablice mm_region_t w mm_state_t są z nich odtwarzane na końcu.
+ * Wołana raz przez mm_stage2_build; mm_stage2_reserve aktualizuje wynik przyrostowo.
+ * @param ram Tablica regionów RAM (scalona)
+ * @param ram_count Liczba regionów RAM
+ * @param first_free_frame Pierwsza ramka za obrazem jądra
+ * @return 0 jeśli sukces, kod błędu w przeciwnym razie
+ */
+static int mm_stage2_finish(mm_region_t *ram, int ram_count, uint64_t first_free_frame)
+{
+    mm_region_set_t *reserved = &g_mm_state.reserved_set;
+    mm_region_set_t *free_set = &g_mm_state.free_set;
+    const uint64_t *res_starts = reserved->starts;
+    const uint64_t *res_ends = reserved->ends;
+    uint32_t free_flags = MM_SET_FLAGS(MM_RW, MM_FLAG_ALLOCATABLE);
+    int reserved_count;
+    int free_count;
+    int first = 0;
+    int i;
+    int err;
+    uint64_t ram_pages;
+    uint64_t reserved_pages;
+    uint64_t reserved_pages_in_ram;
+    uint64_t free_pages;
+    int totals_ok;
+    int first_free_ok;
+    int overlap_free_reserved;
+
+    mm_set_merge(reserved);
+    reserved_count = reserved->count;
+    free_set->count = 0;
 
     for (i = 0; i < ram_count; i++) {
         uint64_t cursor = ram[i].start;
         int j;
 
-        for (j = 0; j < reserved_count; j++) {
-            if (reserved[j].end <= cursor)
+        /* RAM i reserved są posortowane: region kończący się przed tym bankiem
+         * nie sięga też kolejnych, więc wycinanie zaczyna się za nim */
+        while (first < reserved_count && res_ends[first] <= cursor)
+            first++;
+
+        for (j = first; j < reserved_count; j++) {
+            if (res_ends[j] <= cursor)
                 continue;
-            if (reserved[j].start >= ram[i].end)
+            if (res_starts[j] >= ram[i].end)
                 break;
 
-            if (reserved[j].start > cursor) {
-                err = mm_region_add(free_regions, MM_REGION_WORKSPACE_CAP, &free_count,
-                                    cursor, mm_min_u64(reserved[j].start, ram[i].end),
-                                    MM_RW, MM_FLAG_ALLOCATABLE, "free");
+            if (res_starts[j] > cursor) {
+                err = mm_set_add(free_set, cursor, mm_min_u64(res_starts[j], ram[i].end),
+                                 free_flags, MM_SOURCE_FREE);
                 if (err)
                     return err;
             }
 
-            if (reserved[j].end > cursor)
-                cursor = reserved[j].end;
-
+            cursor = res_ends[j];
             if (cursor >= ram[i].end)
                 break;
         }
 
         if (cursor < ram[i].end) {
-            err = mm_region_add(free_regions, MM_REGION_WORKSPACE_CAP, &free_count,
-                                cursor, ram[i].end,
-                                MM_RW, MM_FLAG_ALLOCATABLE, "free");
+            err = mm_set_add(free_set, cursor, ram[i].end, free_flags, MM_SOURCE_FREE);
             if (err)
                 return err;
         }
     }
 
-    free_count = mm_merge_regions(free_regions, free_count);
+    mm_set_merge(free_set);
+    free_count = free_set->count;
 
     ram_pages = mm_sum_pages(ram, ram_count);
-    reserved_pages = mm_sum_pages(reserved, reserved_count);
-    reserved_pages_in_ram = mm_sum_pages_clipped_to_ram(reserved, reserved_count, ram, ram_count);
-    free_pages = mm_sum_pages(free_regions, free_count);
+    reserved_pages = mm_set_sum_pages(reserved);
+    reserved_pages_in_ram = mm_sum_pages_clipped_to_ram(reserved, ram, ram_count);
+    free_pages = mm_set_sum_pages(free_set);
+
+    mm_set_export(reserved, g_mm_reserved, 0);
+    mm_set_export(free_set, g_mm_free, 0);
+    mm_region_index_build(g_mm_reserved, g_mm_reserved_max_end, 0, reserved_count);
+
+    err = mm_pa_map_build(g_mm_reserved, reserved_count, g_mm_free, free_count);
+    if (err)
+        return err;
 
     totals_ok = (ram_pages == (reserved_pages_in_ram + free_pages));
-    first_free_ok = mm_addr_in_regions(first_free_frame, free_regions, free_count);
-    overlap_free_reserved = mm_free_overlaps_reserved(free_regions, free_count,
-                                                      reserved, reserved_count);
+    first_free_ok = mm_addr_in_regions(first_free_frame, g_mm_free, free_count);
+    overlap_free_reserved = mm_free_overlaps_reserved(g_mm_free, free_count,
+                                                      g_mm_reserved, g_mm_reserved_max_end,
+                                                      reserved_count);
 
     /* Zapis do struktury stanu mapy pamięci */
+    g_mm_state.ram = ram;
     g_mm_state.ram_count = ram_count;
     g_mm_state.reserved_count = reserved_count;
     g_mm_state.free_count = free_count;
@@ -696,6 +1332,458 @@ int mm_stage2_build(const hw_state_t *hw)
     return 0;
 }
 
+/**
+ * Liczy rozmiar jednego bloku z tablicami mapy dla reserved_cap / free_cap wpisów:
+ * zbiory SoA, tablice mm_region_t dla mm_state_t, płaska mapa (2R + F), indeks
+ * przedziałowy i nazwy źródeł. Tablice 8-bajtowe idą pierwsze, uint32 na końcu.
+ * @param reserved_cap Pojemność zbioru reserved
+ * @param free_cap Pojemność zbioru free
+ * @return Rozmiar bloku w bajtach
+ */
+static uint64_t mm_tables_size(int reserved_cap, int free_cap)
+{
+    uint64_t r = (uint64_t)reserved_cap;
+    uint64_t f = (uint64_t)free_cap;
+
+    return (r + f) * (2ULL * sizeof(uint64_t) + 2ULL * sizeof(uint32_t)) +
+           (r + f + 2ULL * r + f) * sizeof(mm_region_t) +
+           r * sizeof(uint64_t) +
+           (r + MM_SOURCE_FIRST) * sizeof(const char *);
+}
+
+/**
+ * Dzieli blok z mm_tables_size na puste tablice mapy (zbiory, tablice mm_state_t,
+ * płaską mapę, indeks, źródła) i podpina je do g_mm_state.
+ * @param base Blok (wyrównany do 8 bajtów)
+ * @param reserved_cap Pojemność zbioru reserved
+ * @param free_cap Pojemność zbioru free
+ */
+static void mm_tables_carve(void *base, int reserved_cap, int free_cap)
+{
+    mm_region_set_t *sets[2] = { &g_mm_state.reserved_set, &g_mm_state.free_set };
+    int caps[2] = { reserved_cap, free_cap };
+    uint8_t *p = base;
+    int s;
+
+    for (s = 0; s < 2; s++) {
+        sets[s]->starts = (uint64_t *)p;
+        p += (uint64_t)caps[s] * sizeof(uint64_t);
+        sets[s]->ends = (uint64_t *)p;
+        p += (uint64_t)caps[s] * sizeof(uint64_t);
+        sets[s]->count = 0;
+        sets[s]->cap = caps[s];
+    }
+    g_mm_reserved = (mm_region_t *)p;
+    p += (uint64_t)reserved_cap * sizeof(mm_region_t);
+    g_mm_free = (mm_region_t *)p;
+    p += (uint64_t)free_cap * sizeof(mm_region_t);
+    g_mm_pa_map = (mm_region_t *)p;
+    p += (uint64_t)(2 * reserved_cap + free_cap) * sizeof(mm_region_t);
+    g_mm_reserved_max_end = (uint64_t *)p;
+    p += (uint64_t)reserved_cap * sizeof(uint64_t);
+    g_mm_sources = (const char **)p;
+    p += (uint64_t)(reserved_cap + MM_SOURCE_FIRST) * sizeof(const char *);
+    for (s = 0; s < 2; s++) {
+        sets[s]->flags = (uint32_t *)p;
+        p += (uint64_t)caps[s] * sizeof(uint32_t);
+        sets[s]->source_ids = (uint32_t *)p;
+        p += (uint64_t)caps[s] * sizeof(uint32_t);
+    }
+
+    g_mm_reserved_cap = reserved_cap;
+    g_mm_free_cap = free_cap;
+    g_mm_pa_map_cap = 2 * reserved_cap + free_cap;
+    g_mm_source_cap = (uint32_t)reserved_cap + MM_SOURCE_FIRST;
+
+    g_mm_state.reserved = g_mm_reserved;
+    g_mm_state.free = g_mm_free;
+    g_mm_state.pa_map.regions = g_mm_pa_map;
+}
+
+/**
+ * Przenosi scalone regiony zarezerwowane z obszaru roboczego do zbioru SoA w memblock
+ * i dopisuje zakres zajęty przez memblock (łącznie z tymi tablicami).
+ * Zbiór free mieści ram_count + reserved_cap regionów: każdy region zarezerwowany
+ * dzieli co najwyżej jeden wolny na dwa. Wszystkie tablice mapy (też te dla mm_state_t,
+ * z indeksem przedziałowym, i mapa dla mm_pa_classify) są jednym blokiem z zapasem
+ * MM_REGION_RESERVE_SLACK na mm_stage2_reserve; tu powstaje też cache mm_pa_classify
+ * per hart (memblock po zamknięciu nie przydziela).
+ * @param workspace Obszar roboczy z regionami zarezerwowanymi
+ * @param workspace_count Liczba regionów w obszarze roboczym
+ * @param ram_count Liczba regionów RAM
+ * @param cpu_count Liczba hartów (wpisy cache mm_pa_classify)
+ * @return 0 jeśli sukces, kod błędu w przeciwnym razie
+ */
+static int mm_stage2_alloc_regions(mm_region_t *workspace, int workspace_count, int ram_count,
+                                   int cpu_count)
+{
+    mm_region_set_t *reserved = &g_mm_state.reserved_set;
+    uint64_t memblock_start;
+    uint64_t memblock_end;
+    uint32_t source_id;
+    int count = mm_merge_regions(workspace, workspace_count);
+    int reserved_cap = count + 1 + MM_REGION_RESERVE_SLACK;
+    int free_cap = ram_count + reserved_cap;
+    void *base;
+    int err;
+    int i;
+
+    base = memblock_alloc(mm_tables_size(reserved_cap, free_cap), sizeof(uint64_t));
+    if (!base)
+        return MM_ERR_MEMBLOCK;
+    mm_tables_carve(base, reserved_cap, free_cap);
+
+    g_mm_sources[MM_SOURCE_MERGED] = "merged";
+    g_mm_sources[MM_SOURCE_FREE] = "free";
+    g_mm_source_count = MM_SOURCE_FIRST;
+
+    if (cpu_count > 0) {
+        g_mm_state.pa_map.cache = memblock_alloc((uint64_t)cpu_count * sizeof(mm_pa_cache_t),
+                                                 MM_CACHE_LINE);
+        if (!g_mm_state.pa_map.cache)
+            return MM_ERR_MEMBLOCK;
+        g_mm_state.pa_map.cache_count = (uint32_t)cpu_count;
+    }
+
+    for (i = 0; i < count; i++) {
+        err = mm_source_add(workspace[i].source, &source_id);
+        if (!err)
+            err = mm_set_add(reserved, workspace[i].start, workspace[i].end,
+                             MM_SET_FLAGS(workspace[i].pte_flags, workspace[i].protect_flags),
+                             source_id);
+        if (err)
+            return err;
+    }
+
+    if (memblock_range(&memblock_start, &memblock_end))
+        return MM_ERR_MEMBLOCK;
+    if (memblock_end > memblock_start) {
+        err = mm_source_add("memblock", &source_id);
+        if (!err)
+            err = mm_set_add(reserved, memblock_start, memblock_end,
+                             MM_SET_FLAGS(MM_RW, MM_FLAG_KERNEL | MM_FLAG_RESERVED), source_id);
+        if (err)
+            return err;
+    }
+
+    return 0;
+}
+
+/**
+ * Buduje mapę pamięci systemu i zapisuje wynik do zmiennych globalnych.
+ * 
+ * Proces:
+ * 1. Dodaje regiony zarezerwowane zależne od obrazu jądra (kernel, boot, DTB)
+ * 2. Pobiera RAM, /reserved-memory i MMIO urządzeń z DTB (mm_dtb_regions_collect)
+ *    albo z prekompilowanego opisu platformy, jeśli pasuje do bloba
+ * 3. Przenosi regiony do tablic dokładnej długości w memblock, rezerwuje zużytą
+ *    część memblock i zamyka go (reszta zakresu zostaje wolna)
+ * 4. Oblicza wolne regiony jako RAM minus zarezerwowane
+ * 5. Weryfikuje poprawność mapy pamięci
+ * 
+ * @param hw Wskaźnik do struktury stanu sprzętowego
+ * @return 0 jeśli sukces, kod błędu w przeciwnym razie
+ */
+int mm_stage2_build(const hw_state_t *hw)
+{
+    mm_region_t *ram = 0;
+    mm_region_buf_t reserved = { 0, 0, 0, 1 };
+    dtb_arena_t *arena = memblock_arena();
+    const platform_desc_t *desc = platform_desc();
+    int ram_count = 0;
+    int err;
+    uint64_t first_free_frame;
+    uint64_t memblock_start;
+    uint64_t memblock_end;
+    const void *fdt;
+
+    if (!hw)
+        return MM_ERR_BADVALUE;
+    if (!arena)
+        return MM_ERR_MEMBLOCK;
+
+    err = mm_region_buf_add(&reserved,
+                            (uint64_t)(uintptr_t)_kernel_start,
+                            (uint64_t)(uintptr_t)_kernel_image_end,
+                            MM_RWX, MM_FLAG_KERNEL | MM_FLAG_RESERVED, "kernel");
+    if (err)
+        return err;
+
+    err = mm_region_buf_add(&reserved,
+                            hw->mem_base, (uint64_t)(uintptr_t)_kernel_start,
+                            MM_R, MM_FLAG_BOOT | MM_FLAG_RESERVED, "boot-reserved");
+    if (err)
+        return err;
+
+    fdt = dtb_get();
+    if (fdt && fdt_totalsize(fdt) > 0) {
+        uint64_t dtb_start = (uint64_t)(uintptr_t)fdt;
+        uint64_t dtb_end = dtb_start + (uint64_t)fdt_totalsize(fdt);
+        err = mm_region_buf_add(&reserved, dtb_start, dtb_end,
+                                MM_R, MM_FLAG_DTB | MM_FLAG_RESERVED, "dtb");
+        if (err)
+            return err;
+    }
+
+    /* RAM, /reserved-memory i MMIO: z prekompilowanego opisu albo z DTB */
+    if (desc)
+        err = mm_desc_regions_load(desc, arena, &ram, &ram_count, &reserved);
+    else
+        err = mm_dtb_regions_collect(arena, &ram, &ram_count, &reserved);
+    if (err)
+        return err;
+
+    err = mm_stage2_alloc_regions(reserved.regions, reserved.count, ram_count, hw->cpu_count);
+    if (err)
+        return err;
+
+    memblock_scratch_release();
+    if (memblock_close() || memblock_range(&memblock_start, &memblock_end))
+        return MM_ERR_MEMBLOCK;
+
+    /* memblock zaczyna się na pierwszej wolnej stronie za jądrem (omija DTB), więc
+     * pierwsza wolna ramka to koniec jego zużytej części */
+    first_free_frame = memblock_end;
+
+    return mm_stage2_finish(ram, ram_count, first_free_frame);
+}
+
+/**
+ * Wycina zakres z mapy pamięci po mm_stage2_build: dodaje go jako region zarezerwowany
+ * i aktualizuje wolne regiony oraz statystyki. Używane przez alokatory, które zajmują
+ * część wolnej pamięci na własne metadane.
+ * Zmiana jest przyrostowa: region trafia na swoje miejsce w posortowanym zbiorze
+ * (scalając się z sąsiadami o tych samych flagach), z wolnych wycinany jest tylko
+ * przecięty fragment, a płaska mapa jest rozcinana w miejscu, gdy zakres leży w jednym
+ * wolnym wpisie. Indeks przedziałowy jest przebudowywany w O(n), bo wstawienie
+ * przesuwa układ niejawnego drzewa.
+ * Mapa nie zabiera stron alokatorom, więc rezerwacja musi poprzedzić przejęcie listy
+ * free (frame_alloc_init); po starcie buddy jest odrzucana. Tablice mają zapas
+ * MM_REGION_RESERVE_SLACK wpisów i nie rosną (memblock jest już zamknięty).
+ * Jeśli first_free_frame wpada w zakres, przesuwa się za jego koniec.
+ * @param start Adres początkowy zakresu
+ * @param end Adres końcowy zakresu
+ * @param pte_flags Flagi uprawnień PTE (R/W/X)
+ * @param protect_flags Flagi ochronne (MM_FLAG_*)
+ * @param source Źródło regionu
+ * @return 0 jeśli sukces, MM_ERR_BUDDY_READY po starcie buddy, MM_ERR_REGION_CAP
+ *         gdy zapas tablic się wyczerpał, inny kod błędu w przeciwnym razie
+ */
+int mm_stage2_reserve(uint64_t start, uint64_t end,
+                      uint8_t pte_flags, uint16_t protect_flags, const char *source)
+{
+    mm_region_set_t *reserved = &g_mm_state.reserved_set;
+    mm_region_set_t *free_set = &g_mm_state.free_set;
+    uint32_t flags = MM_SET_FLAGS(pte_flags, protect_flags);
+    uint64_t first_free_frame = g_mm_state.first_free_frame;
+    uint64_t merged_start;
+    uint64_t merged_end;
+    uint64_t replaced = 0;
+    uint64_t removed = 0;
+    uint64_t free_start = 0;
+    uint64_t free_end = 0;
+    uint32_t free_flags = 0;
+    uint32_t free_id = 0;
+    uint32_t source_id;
+    mm_region_t split[3];
+    int has_left;
+    int has_right;
+    int absorbed;
+    int lo;
+    int hi;
+    int k0;
+    int k1;
+    int k;
+    int n;
+    int err;
+
+    if (!g_mm_state.ram)
+        return MM_ERR_BADVALUE;
+    if (g_mm_state.buddy.ready)
+        return MM_ERR_BUDDY_READY;
+
+    start = mm_align_down(start, MM_PAGE_SIZE);
+    end = mm_align_up(end, MM_PAGE_SIZE);
+    if (end <= start)
+        return 0;
+
+    /* Wstawienie dokłada najwyżej jeden wpis reserved, jeden free i jedno źródło */
+    if (reserved->count >= g_mm_reserved_cap || free_set->count >= g_mm_free_cap)
+        return MM_ERR_REGION_CAP;
+    err = mm_source_add(source, &source_id);
+    if (err)
+        return err;
+
+    /* Wstawienie do reserved ze scaleniem z sąsiadami o tych samych flagach (jak mm_set_merge) */
+    lo = mm_set_lower_bound(reserved, start, end);
+    hi = lo;
+    merged_start = start;
+    merged_end = end;
+    if (lo > 0 && reserved->flags[lo - 1] == flags && start <= reserved->ends[lo - 1]) {
+        lo--;
+        merged_start = reserved->starts[lo];
+        merged_end = mm_max_u64(merged_end, reserved->ends[lo]);
+    }
+    while (hi < reserved->count && reserved->flags[hi] == flags &&
+           reserved->starts[hi] <= merged_end) {
+        merged_end = mm_max_u64(merged_end, reserved->ends[hi]);
+        hi++;
+    }
+    absorbed = hi - lo;
+    for (k = lo; k < hi; k++) {
+        replaced += reserved->ends[k] - reserved->starts[k];
+        if (reserved->source_ids[k] != source_id)
+            source_id = MM_SOURCE_MERGED;
+    }
+
+    mm_set_replace(reserved, lo, hi, 1);
+    reserved->starts[lo] = merged_start;
+    reserved->ends[lo] = merged_end;
+    reserved->flags[lo] = flags;
+    reserved->source_ids[lo] = source_id;
+
+    /* Wycięcie [start, end) z free: ze skrajnych przeciętych wpisów zostają resztki */
+    k0 = mm_set_upper_bound_end(free_set, start);
+    for (k1 = k0; k1 < free_set->count && free_set->starts[k1] < end; k1++)
+        removed += mm_min_u64(free_set->ends[k1], end) - mm_max_u64(free_set->starts[k1], start);
+
+    has_left = (k0 < k1 && free_set->starts[k0] < start);
+    has_right = (k0 < k1 && free_set->ends[k1 - 1] > end);
+    if (k0 < k1) {
+        free_start = free_set->starts[k0];
+        free_end = free_set->ends[k1 - 1];
+    }
+    if (has_right) {
+        free_flags = free_set->flags[k1 - 1];
+        free_id = free_set->source_ids[k1 - 1];
+    }
+
+    mm_set_replace(free_set, k0, k1, has_left + has_right);
+    if (has_left)
+        free_set->ends[k0] = start;
+    if (has_right) {
+        free_set->starts[k0 + has_left] = end;
+        free_set->ends[k0 + has_left] = free_end;
+        free_set->flags[k0 + has_left] = free_flags;
+        free_set->source_ids[k0 + has_left] = free_id;
+    }
+
+    mm_set_export(reserved, g_mm_reserved, lo);
+    mm_set_export(free_set, g_mm_free, k0);
+    mm_region_index_build(g_mm_reserved, g_mm_reserved_max_end, 0, reserved->count);
+
+    /* Zakres w jednym wolnym wpisie i bez scalenia nie przecina żadnego regionu
+     * zarezerwowanego: pełna przebudowa mapy dałaby to samo co rozcięcie wpisu */
+    n = 0;
+    if (has_left)
+        split[n++] = g_mm_free[k0];
+    split[n++] = g_mm_reserved[lo];
+    if (has_right)
+        split[n++] = g_mm_free[k0 + has_left];
+    if (absorbed || k1 != k0 + 1 || free_start > start || free_end < end ||
+        mm_pa_map_split(free_start, free_end, split, n)) {
+        err = mm_pa_map_build(g_mm_reserved, reserved->count, g_mm_free, free_set->count);
+        if (err)
+            return err;
+    }
+
+    g_mm_state.reserved_count = reserved->count;
+    g_mm_state.free_count = free_set->count;
+    g_mm_state.reserved_pages += (merged_end - merged_start - replaced) / MM_PAGE_SIZE;
+    g_mm_state.reserved_pages_in_ram += removed / MM_PAGE_SIZE;
+    g_mm_state.free_pages -= removed / MM_PAGE_SIZE;
+
+    if (start <= first_free_frame && first_free_frame < end)
+        first_free_frame = end;
+    g_mm_state.first_free_frame = first_free_frame;
+    g_mm_state.totals_ok = (g_mm_state.ram_pages ==
+                            (g_mm_state.reserved_pages_in_ram + g_mm_state.free_pages));
+    g_mm_state.first_free_ok = mm_addr_in_regions(first_free_frame, g_mm_free, free_set->count);
+
+    return 0;
+}
+
+/**
+ * Szuka regionu mapy pamięci zawierającego adres: najpierw wśród zarezerwowanych
+ * (indeks przedziałowy), potem wśród wolnych (wyszukiwanie binarne), w O(log n).
+ * Przy nakładających się regionach zarezerwowanych zwraca dowolny z nich.
+ * @param addr Adres fizyczny
+ * @return Wskaźnik do regionu albo 0, gdy adres nie należy do mapy (lub mapy jeszcze nie ma)
+ */
+const mm_region_t *mm_region_lookup(uint64_t addr)
+{
+    int i;
+
+    if (!g_mm_state.ram || addr == UINT64_MAX)
+        return 0;
+
+    i = mm_region_index_find(g_mm_reserved, g_mm_reserved_max_end, g_mm_state.reserved_count,
+                             addr, addr + 1ULL);
+    if (i >= 0)
+        return &g_mm_reserved[i];
+
+    i = mm_regions_upper_bound(g_mm_free, g_mm_state.free_count, addr);
+    if (i > 0 && addr < g_mm_free[i - 1].end)
+        return &g_mm_free[i - 1];
+
+    return 0;
+}
+
+/**
+ * Zwraca stan mapy pamięci zbudowany przez mm_stage2_build().
+ * @return Wskaźnik do stanu mapy pamięci
+ */
+const mm_state_t *mm_state(void)
+{
+    return &g_mm_state;
+}
+
+/**
+ * Zwraca statystyki alokatora buddy przechowywane w stanie mapy pamięci.
+ * Alokator aktualizuje je przy każdym podziale i scaleniu bloków.
+ * @return Wskaźnik do statystyk buddy
+ */
+mm_buddy_stats_t *mm_buddy_stats(void)
+{
+    return &g_mm_state.buddy;
+}
+
+/**
+ * Wyświetla wolne bloki buddy per rząd wraz z fragmentacją: dla rzędu k jest to
+ * procent wolnych stron, których nie da się użyć na przydział rzędu k
+ * (leżą w mniejszych blokach).
+ * @param buddy Statystyki buddy
+ */
+static void mm_dump_buddy(const mm_buddy_stats_t *buddy)
+{
+    uint64_t usable = 0;
+    int order;
+
+    uart_console_puts("[mm] buddy: managed_pages=");
+    uart_console_put_dec_u64(buddy->managed_pages);
+    uart_console_puts(" free_pages=");
+    uart_console_put_dec_u64(buddy->free_pages);
+    uart_console_puts("\n");
+
+    for (order = MM_BUDDY_MAX_ORDER; order >= 0; order--) {
+        uint64_t frag = 0;
+
+        usable += buddy->free_blocks[order] << order;
+        if (!buddy->free_blocks[order])
+            continue;
+        if (buddy->free_pages)
+            frag = ((buddy->free_pages - usable) * 100ULL) / buddy->free_pages;
+
+        uart_console_puts("[mm] buddy order=");
+        uart_console_put_dec_i32(order);
+        uart_console_puts(" blocks=");
+        uart_console_put_dec_u64(buddy->free_blocks[order]);
+        uart_console_puts(" frag=");
+        uart_console_put_dec_u64(frag);
+        uart_console_puts("%\n");
+    }
+}
+
 /**
  * Wyświetla (dump) mapę pamięci systemu na UART.
  * Funkcja używa danych zapisanych przez mm_stage2_build().
@@ -704,7 +1792,7 @@ int mm_stage2_build(const hw_state_t *hw)
  */
 int mm_stage2_dump(void)
 {
-    mm_region_t *ram = g_mm_ram;
+    mm_region_t *ram = g_mm_state.ram;
     mm_region_t *reserved = g_mm_reserved;
     mm_region_t *free_regions = g_mm_free;
     int ram_count = g_mm_state.ram_count;
@@ -756,11 +1844,18 @@ int mm_stage2_dump(void)
     uart_console_puts(" -> ");
     uart_console_puts(g_mm_state.first_free_ok ? "OK\n" : "FAIL\n");
 
+    uart_console_puts("[mm] pa_map_count=");
+    uart_console_put_dec_i32(g_mm_state.pa_map.count);
+    uart_console_puts("\n");
+
     uart_console_puts("[mm] overlap_free_reserved=");
     uart_console_put_dec_i32(g_mm_state.overlap_free_reserved);
     uart_console_puts(" -> ");
     uart_console_puts(g_mm_state.overlap_free_reserved ? "FAIL\n" : "OK\n");
 
+    if (g_mm_state.buddy.ready)
+        mm_dump_buddy(&g_mm_state.buddy);
+
     uart_console_puts("[mm] map dump end\n");
 
     return 0;
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <platform_init.h>
+#include <dtb/dtb.h>
 
 /*
  * Flagi PTE (Page Table Entry) dla RISC-V Sv39
@@ -14,6 +15,15 @@
 #define PTE_X     0x08  /* Executable - strona jest wykonywalna */
 #define PTE_U     0x10  /* User accessible - dostępne z trybu użytkownika */
 #define PTE_G     0x20  /* Global - globalny wpis */
+#define PTE_A     0x40  /* Accessed - strona była użyta */
+#define PTE_D     0x80  /* Dirty - strona była zapisana */
+#define PTE_N     (1ULL << 63)  /* NAPOT (Svnapot) - wpis należy do ciągłego bloku 64KB */
+
+/* Typ pamięci liścia (Svpbmt, bity 62..61): 0 = PMA platformy */
+#define PTE_PBMT_PMA  0ULL
+#define PTE_PBMT_NC   (1ULL << 61)  /* Non-cacheable, idempotentna - zapisy mogą się łączyć */
+#define PTE_PBMT_IO   (2ULL << 61)  /* Non-cacheable, nieidempotentna, silnie uporządkowana */
+#define PTE_PBMT_MASK (3ULL << 61)
 
 /*
  * Złożone uprawnienia dla regionów pamięci (dla PTE)
@@ -36,6 +46,7 @@
 #define MM_FLAG_BOOT          0x08  /* Region boot - krytyczny */
 #define MM_FLAG_MMIO          0x10  /* Region urządzeń MMIO - nie można alokować */
 #define MM_FLAG_DTB           0x20  /* Region DTB - krytyczny */
+#define MM_FLAG_WC            0x400 /* MMIO z łączeniem zapisów (framebuffer) - mapowany jako NC */
 
 /*
  * Flagi stanu danych dla regionów pamięci
@@ -56,6 +67,82 @@ typedef struct {
     const char *source;       /* Źródło regionu */
 } mm_region_t;
 
+/**
+ * Bufor regionów dopisywanych przy zbieraniu mapy (mm_dtb_regions_collect).
+ * Z grow != 0 pełny bufor jest podwajany w scratch memblock (jądro); bez grow
+ * (np. statyczna tablica w tools/dtb_precompile) przepełnienie daje błąd.
+ */
+typedef struct {
+    mm_region_t *regions;
+    int count;
+    int cap;
+    int grow;
+} mm_region_buf_t;
+
+/*
+ * Flagi regionu w mm_region_set_t: pte_flags w bitach 7..0, protect_flags w 23..8.
+ * Jedno porównanie flags[] zastępuje porównanie obu pól przy scalaniu.
+ */
+#define MM_SET_FLAGS(pte, prot) ((uint32_t)(pte) | ((uint32_t)(prot) << 8))
+#define MM_SET_PTE(flags)       ((uint8_t)((flags) & 0xFFU))
+#define MM_SET_PROT(flags)      ((uint16_t)((flags) >> 8))
+
+/**
+ * Zbiór regionów w układzie struktura-tablic, używany przez mm_stage2_build.
+ * Pętle przechodzące po zakresach (scalanie, sumy stron, wycinanie wolnych)
+ * czytają tylko ciągłe tablice starts[]/ends[], zamiast 32-bajtowych rekordów.
+ * source_ids[] to indeksy w tablicy nazw źródeł memory_map.c; mm_region_t
+ * odtwarza się z wpisu przy eksporcie do mm_state_t (np. dla mm_stage2_dump).
+ */
+typedef struct {
+    uint64_t *starts;
+    uint64_t *ends;
+    uint32_t *flags;
+    uint32_t *source_ids;
+    int count;
+    int cap;
+} mm_region_set_t;
+
+/* Rozmiar linii cache; wpisy per hart nie dzielą linii */
+#define MM_CACHE_LINE 64
+
+/**
+ * Ostatnie trafienie mm_pa_classify na jednym harcie. Ważne tylko, jeśli
+ * generation zgadza się z mm_pa_map_t (mapa nie była przebudowana).
+ */
+typedef struct {
+    const mm_region_t *hit;
+    uint64_t generation;
+} __attribute__((aligned(MM_CACHE_LINE))) mm_pa_cache_t;
+
+/**
+ * Płaska mapa adresów fizycznych dla mm_pa_classify: rozłączne regiony posortowane
+ * po początku, pokrywające RAM (wolne i zarezerwowane) i zarezerwowane poza RAM (MMIO).
+ * Budowana na końcu mm_stage2_build; mm_stage2_reserve rozcina ją w miejscu albo
+ * przebudowuje, zwiększając generation.
+ */
+typedef struct {
+    const mm_region_t *regions;
+    int count;
+    uint64_t generation;
+    mm_pa_cache_t *cache;
+    uint32_t cache_count;
+} mm_pa_map_t;
+
+/* Najwyższy rząd alokatora buddy: blok 2^18 stron = 1GB */
+#define MM_BUDDY_MAX_ORDER 18
+
+/**
+ * Statystyki alokatora buddy, aktualizowane na bieżąco przez kernel/buddy.c.
+ * free_blocks[k] to liczba wolnych bloków rzędu k (2^k stron).
+ */
+typedef struct {
+    int ready;
+    uint64_t managed_pages;
+    uint64_t free_pages;
+    uint64_t free_blocks[MM_BUDDY_MAX_ORDER + 1];
+} mm_buddy_stats_t;
+
 /**
  * Struktura przechowująca stan mapy pamięci.
  * Używana do przekazywania danych między mm_stage2_build() a mm_stage2_dump().
@@ -68,6 +155,10 @@ typedef struct {
     int reserved_count;
     mm_region_t *free;
     int free_count;
+
+    /* Te same regiony reserved/free w układzie SoA (źródło tablic powyżej) */
+    mm_region_set_t reserved_set;
+    mm_region_set_t free_set;
     
     /* Statystyki */
     uint64_t first_free_frame;
@@ -80,9 +171,23 @@ typedef struct {
     int totals_ok;
     int first_free_ok;
     int overlap_free_reserved;
+
+    /* Alokator stron (buddy) zasilany z listy free */
+    mm_buddy_stats_t buddy;
+
+    /* Mapa dla mm_pa_classify */
+    mm_pa_map_t pa_map;
 } mm_state_t;
 
+int mm_dtb_regions_collect(dtb_arena_t *arena, mm_region_t **ram, int *ram_count,
+                           mm_region_buf_t *reserved);
 int mm_stage2_build(const hw_state_t *hw);
+int mm_stage2_reserve(uint64_t start, uint64_t end,
+                      uint8_t pte_flags, uint16_t protect_flags, const char *source);
+const mm_region_t *mm_region_lookup(uint64_t addr);
+const mm_region_t *mm_pa_classify(uint64_t pa);
+const mm_state_t *mm_state(void);
+mm_buddy_stats_t *mm_buddy_stats(void);
 int mm_stage2_dump(void);
 int mm_stage2_build_and_dump(const hw_state_t *hw);
 
@@ -0,0 +1,63 @@
+#include <stdint.h>
+#include <hart.h>
+#include <memory_map.h>
+
+/*
+ * mm_pa_classify jest tu, a nie w memory_map.c, bo memory_map.c kompiluje się
+ * też na hosta (tools/dtb_precompile), gdzie nie ma hart_index.
+ */
+
+/**
+ * Szuka wpisu płaskiej mapy zawierającego adres (wyszukiwanie binarne).
+ * @param map Płaska mapa z mm_stage2_build
+ * @param pa Adres fizyczny
+ * @return Wskaźnik do wpisu albo 0, gdy adres nie należy do mapy
+ */
+static const mm_region_t *mm_pa_map_find(const mm_pa_map_t *map, uint64_t pa)
+{
+    int lo = 0;
+    int hi = map->count;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+
+        if (map->regions[mid].start <= pa)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo > 0 && pa < map->regions[lo - 1].end)
+        return &map->regions[lo - 1];
+
+    return 0;
+}
+
+/**
+ * Klasyfikuje adres fizyczny: zwraca region mapy pamięci, do którego należy
+ * (pte_flags, protect_flags: ALLOCATABLE dla wolnego RAM, KERNEL/DTB/BOOT/MMIO itd.,
+ * source). Najpierw sprawdzane jest ostatnie trafienie bieżącego harta, więc
+ * powtarzane zapytania o ten sam region kosztują jedno porównanie zakresu.
+ * Wynik jest ważny do następnego mm_stage2_reserve (wpisy mapy mogą się przesunąć).
+ * @param pa Adres fizyczny
+ * @return Wskaźnik do regionu albo 0, gdy adres leży poza RAM i poza znanym MMIO
+ */
+const mm_region_t *mm_pa_classify(uint64_t pa)
+{
+    const mm_pa_map_t *map = &mm_state()->pa_map;
+    uint32_t self = hart_index();
+    mm_pa_cache_t *cache = (self < map->cache_count) ? &map->cache[self] : 0;
+    const mm_region_t *r;
+
+    if (cache && cache->hit && cache->generation == map->generation &&
+        cache->hit->start <= pa && pa < cache->hit->end)
+        return cache->hit;
+
+    r = mm_pa_map_find(map, pa);
+    if (r && cache) {
+        cache->hit = r;
+        cache->generation = map->generation;
+    }
+
+    return r;
+}
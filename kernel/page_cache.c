@@ -0,0 +1,260 @@
+#include <stdint.h>
+#include <buddy.h>
+#include <hart.h>
+#include <panic.h>
+#include <page_cache.h>
+
+/* Rozmiar linii cache; magazynki różnych hartów nie dzielą linii */
+#define PAGE_CACHE_LINE 64
+
+/**
+ * Magazynek stron jednego harta. Dostęp ma tylko właściciel, więc push/pop
+ * nie potrzebują atomików; globalna pula (buddy, z własną blokadą) jest dotykana
+ * tylko paczkami.
+ */
+typedef struct {
+    uint64_t pages[PAGE_CACHE_CAP];
+    uint32_t count;
+} __attribute__((aligned(PAGE_CACHE_LINE))) page_cache_hart_t;
+
+static page_cache_hart_t *g_page_caches;
+static uint32_t g_page_cache_count;
+static int g_page_cache_ready;
+
+/**
+ * Dobiera paczkę PAGE_CACHE_BATCH stron z buddy do magazynku.
+ * Najpierw próbuje jednego ciągłego przydziału (jedna operacja na puli),
+ * przy fragmentacji bierze strony pojedynczo.
+ * @param c Magazynek harta
+ * @return 0 jeśli magazynek nie jest pusty, PAGE_CACHE_ERR_NO_MEMORY w przeciwnym razie
+ */
+static int page_cache_refill(page_cache_hart_t *c)
+{
+    uint64_t pa;
+    uint32_t i;
+
+    if (!buddy_alloc_pages(PAGE_CACHE_BATCH, &pa)) {
+        /* Odwrotna kolejność: pop wydaje strony rosnąco */
+        for (i = PAGE_CACHE_BATCH; i > 0; i--)
+            c->pages[c->count++] = pa + (uint64_t)(i - 1) * BUDDY_PAGE_SIZE;
+    } else {
+        c->count += buddy_alloc_batch(&c->pages[c->count], PAGE_CACHE_BATCH);
+    }
+
+    return c->count ? 0 : PAGE_CACHE_ERR_NO_MEMORY;
+}
+
+/**
+ * Oddaje do buddy count najstarszych stron z dna magazynku (świeżo zwolnione,
+ * jeszcze ciepłe w cache strony zostają na szczycie). Strona odrzucona przez buddy
+ * oznacza, że page_free przyjął zły adres albo podwójne zwolnienie przez dwa harty;
+ * page_free już zwrócił sukces, więc nie ma komu zgłosić błędu i jądro się zatrzymuje.
+ * @param c Magazynek harta
+ * @param count Liczba stron do oddania
+ */
+static void page_cache_flush(page_cache_hart_t *c, uint32_t count)
+{
+    uint32_t i;
+
+    if (count > c->count)
+        count = c->count;
+
+    if (buddy_free_batch(c->pages, count))
+        panic("page cache: buddy rejected pages flushed from a magazine");
+
+    for (i = count; i < c->count; i++)
+        c->pages[i - count] = c->pages[i];
+    c->count -= count;
+}
+
+/**
+ * Sprawdza, czy strona już leży w magazynku (podwójne page_free na tym samym harcie).
+ * Magazynek ma najwyżej PAGE_CACHE_CAP wpisów w liniach, które page_free i tak dotyka.
+ * @param c Magazynek harta
+ * @param pa Adres fizyczny strony
+ * @return 1 jeśli strona jest w magazynku, 0 w przeciwnym razie
+ */
+static int page_cache_holds(const page_cache_hart_t *c, uint64_t pa)
+{
+    uint32_t i;
+
+    for (i = 0; i < c->count; i++) {
+        if (c->pages[i] == pa)
+            return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Zwraca magazynek bieżącego harta albo 0, gdy hart nie ma własnego
+ * (indeks spoza cpu_count) i musi iść do globalnej puli pod blokadą.
+ */
+static page_cache_hart_t *page_cache_local(void)
+{
+    uint32_t index = hart_index();
+
+    return (index < g_page_cache_count) ? &g_page_caches[index] : 0;
+}
+
+/**
+ * Tworzy magazynki stron dla hw->cpu_count hartów; tablica magazynków pochodzi z buddy.
+ * @param hw Stan sprzętowy z init_dtb (cpu_count)
+ * @return 0 jeśli sukces, PAGE_CACHE_ERR_* w przeciwnym razie
+ */
+int page_cache_init(const hw_state_t *hw)
+{
+    uint64_t bytes;
+    uint64_t pa;
+    int i;
+
+    if (!hw || hw->cpu_count <= 0)
+        return PAGE_CACHE_ERR_BADVALUE;
+    if (!buddy_ready())
+        return PAGE_CACHE_ERR_NOT_READY;
+
+    bytes = (uint64_t)hw->cpu_count * sizeof(page_cache_hart_t);
+    if (buddy_alloc_pages((bytes + BUDDY_PAGE_SIZE - 1ULL) / BUDDY_PAGE_SIZE, &pa))
+        return PAGE_CACHE_ERR_NO_MEMORY;
+
+    g_page_caches = (page_cache_hart_t *)(uintptr_t)pa;
+    for (i = 0; i < hw->cpu_count; i++)
+        g_page_caches[i].count = 0;
+
+    g_page_cache_count = (uint32_t)hw->cpu_count;
+    g_page_cache_ready = 1;
+    return 0;
+}
+
+/**
+ * Przydziela jedną stronę z magazynku bieżącego harta. Gorąca ścieżka dotyka
+ * tylko danych harta; pusty magazynek dobiera paczkę z buddy pod blokadą.
+ * @param pa Adres fizyczny strony (wyjście)
+ * @return 0 jeśli sukces, PAGE_CACHE_ERR_* w przeciwnym razie
+ */
+int page_alloc(uint64_t *pa)
+{
+    page_cache_hart_t *c;
+
+    if (!pa)
+        return PAGE_CACHE_ERR_BADVALUE;
+    if (!g_page_cache_ready)
+        return PAGE_CACHE_ERR_NOT_READY;
+
+    c = page_cache_local();
+    if (!c)
+        return buddy_alloc(0, pa) ? PAGE_CACHE_ERR_NO_MEMORY : 0;
+
+    if (!c->count && page_cache_refill(c))
+        return PAGE_CACHE_ERR_NO_MEMORY;
+
+    *pa = c->pages[--c->count];
+    return 0;
+}
+
+/**
+ * Zwalnia stronę do magazynku bieżącego harta (strona może pochodzić z dowolnego harta).
+ * Pełny magazynek oddaje najpierw paczkę PAGE_CACHE_BATCH stron do buddy.
+ * Podwójne zwolnienie strony, która jeszcze leży w magazynku, jest odrzucane od razu.
+ * Z DEBUG strona musi też być przydzieloną stroną buddy (stan głowy rzędu 0); bez
+ * DEBUG resztę adresów sprawdza dopiero buddy przy oddawaniu paczki.
+ * @param pa Adres fizyczny strony
+ * @return 0 jeśli sukces, PAGE_CACHE_ERR_* w przeciwnym razie
+ */
+int page_free(uint64_t pa)
+{
+    page_cache_hart_t *c;
+#ifdef DEBUG
+    uint64_t head;
+    int order;
+#endif
+
+    if (!pa || (pa & (BUDDY_PAGE_SIZE - 1ULL)))
+        return PAGE_CACHE_ERR_BADVALUE;
+    if (!g_page_cache_ready)
+        return PAGE_CACHE_ERR_NOT_READY;
+
+    c = page_cache_local();
+    if (!c)
+        return buddy_free(pa, 0);
+
+    if (page_cache_holds(c, pa))
+        return PAGE_CACHE_ERR_DOUBLE_FREE;
+#ifdef DEBUG
+    if (buddy_block_of(pa, &head, &order) || head != pa || order)
+        return PAGE_CACHE_ERR_NOT_OWNED;
+#endif
+
+    if (c->count == PAGE_CACHE_CAP)
+        page_cache_flush(c, PAGE_CACHE_BATCH);
+
+    c->pages[c->count++] = pa;
+    return 0;
+}
+
+/**
+ * Przydziela blok 2^order stron. Rząd 0 idzie przez magazynek harta,
+ * większe bloki bezpośrednio z buddy (pod jego blokadą).
+ * @param order Rząd bloku
+ * @param pa Adres fizyczny bloku (wyjście)
+ * @return 0 jeśli sukces, PAGE_CACHE_ERR_* w przeciwnym razie
+ */
+int page_alloc_order(int order, uint64_t *pa)
+{
+    if (!order)
+        return page_alloc(pa);
+    if (!pa || order < 0 || order > BUDDY_MAX_ORDER)
+        return PAGE_CACHE_ERR_BADVALUE;
+    if (!g_page_cache_ready)
+        return PAGE_CACHE_ERR_NOT_READY;
+
+    return buddy_alloc(order, pa) ? PAGE_CACHE_ERR_NO_MEMORY : 0;
+}
+
+/**
+ * Zwalnia blok przydzielony przez page_alloc_order z tym samym rzędem.
+ * @param pa Adres fizyczny bloku
+ * @param order Rząd bloku
+ * @return 0 jeśli sukces, kod błędu w przeciwnym razie
+ */
+int page_free_order(uint64_t pa, int order)
+{
+    if (!order)
+        return page_free(pa);
+    if (!g_page_cache_ready)
+        return PAGE_CACHE_ERR_NOT_READY;
+
+    return buddy_free(pa, order);
+}
+
+/**
+ * Oddaje do buddy wszystkie strony z magazynku bieżącego harta (np. przed jego wyłączeniem).
+ * @return 0 jeśli sukces, PAGE_CACHE_ERR_NOT_READY przed page_cache_init
+ */
+int page_cache_drain(void)
+{
+    page_cache_hart_t *c;
+
+    if (!g_page_cache_ready)
+        return PAGE_CACHE_ERR_NOT_READY;
+
+    c = page_cache_local();
+    if (c)
+        page_cache_flush(c, c->count);
+    return 0;
+}
+
+/**
+ * Zwraca liczbę stron trzymanych we wszystkich magazynkach (liczonych przez buddy jako zajęte).
+ * Odczyt liczników innych hartów jest tylko przybliżeniem.
+ */
+uint64_t page_cache_pages(void)
+{
+    uint64_t total = 0;
+    uint32_t i;
+
+    for (i = 0; i < g_page_cache_count; i++)
+        total += g_page_caches[i].count;
+
+    return total;
+}
@@ -0,0 +1,31 @@
+#ifndef KERNEL_PAGE_CACHE_H
+#define KERNEL_PAGE_CACHE_H
+
+#include <stdint.h>
+#include <platform_init.h>
+
+/* Liczba stron przenoszonych naraz między magazynkiem harta a globalną pulą */
+#ifndef PAGE_CACHE_BATCH
+#define PAGE_CACHE_BATCH 32
+#endif
+
+/* Pojemność magazynku harta (dwie paczki: pełny magazynek oddaje jedną, pusty bierze jedną) */
+#define PAGE_CACHE_CAP (2 * PAGE_CACHE_BATCH)
+
+enum {
+    PAGE_CACHE_ERR_BADVALUE = -9000,
+    PAGE_CACHE_ERR_NOT_READY,
+    PAGE_CACHE_ERR_NO_MEMORY,
+    PAGE_CACHE_ERR_DOUBLE_FREE,
+    PAGE_CACHE_ERR_NOT_OWNED,
+};
+
+int page_cache_init(const hw_state_t *hw);
+int page_alloc(uint64_t *pa);
+int page_free(uint64_t pa);
+int page_alloc_order(int order, uint64_t *pa);
+int page_free_order(uint64_t pa, int order);
+int page_cache_drain(void);
+uint64_t page_cache_pages(void);
+
+#endif
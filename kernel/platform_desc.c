@@ -0,0 +1,73 @@
+#include <libfdt.h>
+#include <stdint.h>
+#include <platform_desc.h>
+
+#define PLATFORM_DESC_FNV_OFFSET 0xcbf29ce484222325ULL
+#define PLATFORM_DESC_FNV_PRIME  0x100000001b3ULL
+
+#ifdef PLATFORM_DESC
+/* Definicja w pliku wygenerowanym przez tools/dtb_precompile */
+extern const platform_desc_t g_platform_desc;
+#endif
+
+static const platform_desc_t *g_platform_desc_active;
+
+/**
+ * Liczy 64-bitowy hash FNV-1a bufora.
+ * Ta sama funkcja jest używana przez dtb_precompile przy budowaniu i przez jądro przy starcie.
+ * @param buf Bufor wejściowy
+ * @param len Długość bufora w bajtach
+ * @return Hash bufora
+ */
+uint64_t platform_desc_hash(const void *buf, uint64_t len)
+{
+    const uint8_t *p = buf;
+    uint64_t hash = PLATFORM_DESC_FNV_OFFSET;
+    uint64_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= PLATFORM_DESC_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/**
+ * Sprawdza, czy wbudowany opis platformy pasuje do bloba przekazanego przy starcie.
+ * Porównywany jest rozmiar, hart startowy i hash całego bloba, więc każda zmiana
+ * drzewa (np. fixupy firmware) kieruje start z powrotem na parsowanie DTB.
+ * @param dtb Blob DTB od firmware
+ * @param hartid Identyfikator harta startowego
+ * @return 0 jeśli opis pasuje i został wybrany, PLATFORM_DESC_ERR_* w przeciwnym razie
+ */
+int platform_desc_select(const void *dtb, uint32_t hartid)
+{
+    const platform_desc_t *desc = 0;
+
+    g_platform_desc_active = 0;
+
+#ifdef PLATFORM_DESC
+    desc = &g_platform_desc;
+#endif
+    if (!desc)
+        return PLATFORM_DESC_ERR_NONE;
+    if (!dtb || fdt_magic(dtb) != FDT_MAGIC)
+        return PLATFORM_DESC_ERR_BADVALUE;
+    if (fdt_totalsize(dtb) != desc->dtb_size || desc->hw.boot_hartid != hartid)
+        return PLATFORM_DESC_ERR_MISMATCH;
+    if (platform_desc_hash(dtb, desc->dtb_size) != desc->dtb_hash)
+        return PLATFORM_DESC_ERR_MISMATCH;
+
+    g_platform_desc_active = desc;
+    return 0;
+}
+
+/**
+ * Zwraca opis wybrany przez platform_desc_select.
+ * @return Wskaźnik do opisu lub 0, gdy start idzie przez parsowanie DTB
+ */
+const platform_desc_t *platform_desc(void)
+{
+    return g_platform_desc_active;
+}
@@ -0,0 +1,37 @@
+#ifndef KERNEL_PLATFORM_DESC_H
+#define KERNEL_PLATFORM_DESC_H
+
+#include <stdint.h>
+#include <platform_init.h>
+#include <memory_map.h>
+#include <uart/uart_console.h>
+
+/*
+ * Prekompilowany opis platformy (make PLATFORM_DTB=board.dtb).
+ * tools/dtb_precompile uruchamia przy budowaniu te same ekstrakcje co start jądra
+ * (platform_probe_dtb, uart_console_probe_from_dtb, mm_dtb_regions_collect) i zapisuje
+ * wynik jako stałą g_platform_desc w .rodata. Przy starcie jądro liczy tylko hash bloba;
+ * jeśli się zgadza, używa opisu zamiast parsować drzewo.
+ */
+typedef struct {
+    uint64_t dtb_hash;              /* FNV-1a 64 po fdt_totalsize bajtach bloba */
+    uint32_t dtb_size;              /* fdt_totalsize bloba */
+    hw_state_t hw;                  /* wynik platform_probe_dtb dla hw.boot_hartid */
+    uart_console_info_t uart;       /* wynik uart_console_probe_from_dtb */
+    const mm_region_t *ram;         /* banki RAM z DTB, po scaleniu */
+    int ram_count;
+    const mm_region_t *reserved;    /* reserved-memory i MMIO urządzeń z DTB */
+    int reserved_count;
+} platform_desc_t;
+
+enum {
+    PLATFORM_DESC_ERR_BADVALUE = -6000,
+    PLATFORM_DESC_ERR_NONE,
+    PLATFORM_DESC_ERR_MISMATCH,
+};
+
+uint64_t platform_desc_hash(const void *buf, uint64_t len);
+int platform_desc_select(const void *dtb, uint32_t hartid);
+const platform_desc_t *platform_desc(void);
+
+#endif
@@ -7,6 +7,7 @@
 #include <panic.h>
 #include <uart/uart_console.h>
 #include <platform_init.h>
+#include <platform_desc.h>
 
 void init_sbi(const hw_state_t *hw)
 {
@@ -34,36 +35,15 @@ void init_dtb(hw_state_t *hw, void *dtb, uint64_t hartid)
     if (err)
         panic("dtb_init failed");
 
-    err = dtb_get_cpu_count(&hw->cpu_count);
-    if (err || hw->cpu_count <= 0)
-        panic("There is no CPU in DTB");
-
-    err = dtb_cpu_find_hart((uint32_t)hartid, &hw->boot_cpu_node);
-    if (err)
-        panic("Boot hart nie istnieje w DTB");
-
-    err = dtb_get_memory(&hw->mem_base, &hw->mem_size);
-    if (err)
-        panic("There is no DTB memory node");
-
-    err = dtb_memory_total(&hw->mem_total);
-    if (err)
-        panic("Error getting total size of RAM");
-
-    err = dtb_get_timebase(&hw->timebase_hz);
-    if (err || !hw->timebase_hz)
-        panic("There is no timebase-frequency");
+    /* Prekompilowany opis pasuje do tego bloba: bez parsowania */
+    if (!platform_desc_select(dtb, (uint32_t)hartid)) {
+        *hw = platform_desc()->hw;
+        return;
+    }
 
-    err = dtb_get_timer_node(&hw->timer_node);
+    err = platform_probe_dtb(hw, hartid);
     if (err)
-        panic("There is no timer node in DTB");
-
-    hw->plic_node = -1;
-    hw->clint_node = -1;
-    hw->imsic_node = -1;
-    dtb_detect_plic(&hw->plic_node);
-    dtb_detect_clint(&hw->clint_node);
-    dtb_detect_imsic(&hw->imsic_node);
+        panic(platform_strerror(err));
 }
 
 void init_timer(void)
@@ -17,6 +17,18 @@ typedef struct {
     int imsic_node;
 } hw_state_t;
 
+enum {
+    PLATFORM_ERR_BADVALUE = -5000,
+    PLATFORM_ERR_NO_CPU,
+    PLATFORM_ERR_NO_BOOT_HART,
+    PLATFORM_ERR_NO_MEMORY,
+    PLATFORM_ERR_MEMORY_TOTAL,
+    PLATFORM_ERR_NO_TIMEBASE,
+    PLATFORM_ERR_NO_TIMER,
+};
+
+int platform_probe_dtb(hw_state_t *hw, uint64_t hartid);
+const char *platform_strerror(int err);
 void init_sbi(const hw_state_t *hw);
 void init_dtb(hw_state_t *hw, void *dtb, uint64_t hartid);
 void init_timer(void);
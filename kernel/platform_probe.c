@@ -0,0 +1,83 @@
+#include <stdint.h>
+#include <dtb/dtb.h>
+#include <platform_init.h>
+
+/**
+ * Wypełnia hw_state_t z zainicjalizowanego DTB, bez panikowania.
+ * To ta sama ekstrakcja, której używa init_dtb przy starcie i host-owy
+ * dtb_precompile przy budowaniu prekompilowanego opisu platformy.
+ * @param hw Struktura stanu sprzętowego do wypełnienia
+ * @param hartid Identyfikator harta startowego
+ * @return 0 jeśli sukces, PLATFORM_ERR_* w przeciwnym razie
+ */
+int platform_probe_dtb(hw_state_t *hw, uint64_t hartid)
+{
+    int err;
+
+    if (!hw)
+        return PLATFORM_ERR_BADVALUE;
+
+    hw->boot_hartid = (uint32_t)hartid;
+
+    err = dtb_get_cpu_count(&hw->cpu_count);
+    if (err || hw->cpu_count <= 0)
+        return PLATFORM_ERR_NO_CPU;
+
+    err = dtb_cpu_find_hart((uint32_t)hartid, &hw->boot_cpu_node);
+    if (err)
+        return PLATFORM_ERR_NO_BOOT_HART;
+
+    err = dtb_get_memory(&hw->mem_base, &hw->mem_size);
+    if (err)
+        return PLATFORM_ERR_NO_MEMORY;
+
+    err = dtb_memory_total(&hw->mem_total);
+    if (err)
+        return PLATFORM_ERR_MEMORY_TOTAL;
+
+    err = dtb_get_timebase(&hw->timebase_hz);
+    if (err || !hw->timebase_hz)
+        return PLATFORM_ERR_NO_TIMEBASE;
+
+    err = dtb_get_timer_node(&hw->timer_node);
+    if (err)
+        return PLATFORM_ERR_NO_TIMER;
+
+    hw->plic_node = -1;
+    hw->clint_node = -1;
+    hw->imsic_node = -1;
+    dtb_detect_plic(&hw->plic_node);
+    dtb_detect_clint(&hw->clint_node);
+    dtb_detect_imsic(&hw->imsic_node);
+
+    return 0;
+}
+
+/**
+ * Zwraca opis błędu platform_probe_dtb (te same komunikaty co dawne panic w init_dtb).
+ * @param err Kod błędu PLATFORM_ERR_*
+ * @return Tekstowy opis błędu
+ */
+const char *platform_strerror(int err)
+{
+    switch (err) {
+    case 0:
+        return "OK";
+    case PLATFORM_ERR_BADVALUE:
+        return "Bad argument";
+    case PLATFORM_ERR_NO_CPU:
+        return "There is no CPU in DTB";
+    case PLATFORM_ERR_NO_BOOT_HART:
+        return "Boot hart nie istnieje w DTB";
+    case PLATFORM_ERR_NO_MEMORY:
+        return "There is no DTB memory node";
+    case PLATFORM_ERR_MEMORY_TOTAL:
+        return "Error getting total size of RAM";
+    case PLATFORM_ERR_NO_TIMEBASE:
+        return "There is no timebase-frequency";
+    case PLATFORM_ERR_NO_TIMER:
+        return "There is no timer node in DTB";
+    default:
+        return "Unknown platform error";
+    }
+}
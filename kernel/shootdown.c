@@ -0,0 +1,405 @@
+#include <stdint.h>
+#include <sbi/sbi.h>
+#include <sbi/sbi_reference_extension.h>
+#include <uart/uart_console.h>
+#include <hart.h>
+#include <kmalloc.h>
+#include <tlb.h>
+#include <shootdown.h>
+
+#define SHOOTDOWN_MASK_BITS 64
+
+/* size dla SBI RFENCE oznaczający całą przestrzeń adresową */
+#define SHOOTDOWN_FLUSH_ALL ((uint64_t)-1)
+
+/**
+ * Liczniki silnika; aktualizowane atomowo, bo shootdown może wołać każdy hart.
+ * rfence_calls to faktyczne wywołania SBI, skipped_harts to harty pominięte, bo
+ * nie uruchomiły danego ASID.
+ */
+typedef struct {
+    uint64_t commits;
+    uint64_t ranges;
+    uint64_t full_flushes;
+    uint64_t rfence_calls;
+    uint64_t skipped_harts;
+} shootdown_stats_t;
+
+/*
+ * Maski hartów (g_shootdown_words słów po 64 bity, bit = gęsty indeks z hart_index()):
+ * online - harty z włączonym stronicowaniem (tylko one mają cokolwiek w TLB),
+ * asid_harts[slot] - harty, które uruchomiły któryś ASID ze slotu.
+ */
+static uint64_t *g_shootdown_online;
+static uint64_t *g_shootdown_asid_harts;
+static uint32_t g_shootdown_words;
+static uint32_t g_shootdown_harts;
+static int g_shootdown_ready;
+static shootdown_stats_t g_shootdown_stats;
+
+static void shootdown_stat_add(uint64_t *counter, uint64_t value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static uint64_t *shootdown_asid_mask(uint32_t asid)
+{
+    return &g_shootdown_asid_harts[(uint64_t)(asid & (SHOOTDOWN_ASID_SLOTS - 1)) * g_shootdown_words];
+}
+
+/**
+ * Ustawia bit bieżącego harta w masce. Indeks jest gęsty (hart_table_init), więc
+ * mieści się w cpu_count dla każdego harta z /cpus; warunek chroni tylko przed
+ * hartem startującym z niepoprawnym tp.
+ */
+static void shootdown_mark_self(uint64_t *mask)
+{
+    uint32_t self = hart_index();
+
+    if (self >= g_shootdown_harts)
+        return;
+
+    __atomic_fetch_or(&mask[self / SHOOTDOWN_MASK_BITS], 1ULL << (self % SHOOTDOWN_MASK_BITS),
+                      __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Tworzy maski hartów dla hw->cpu_count hartów (z kmalloc, więc po kmalloc_init).
+ * @param hw Stan sprzętowy z init_dtb (cpu_count)
+ * @return 0 jeśli sukces, SHOOTDOWN_ERR_* w przeciwnym razie
+ */
+int shootdown_init(const hw_state_t *hw)
+{
+    uint64_t words;
+    uint64_t i;
+
+    if (!hw || hw->cpu_count <= 0)
+        return SHOOTDOWN_ERR_BADVALUE;
+
+    words = ((uint64_t)hw->cpu_count + SHOOTDOWN_MASK_BITS - 1) / SHOOTDOWN_MASK_BITS;
+    g_shootdown_online = kmalloc(words * sizeof(uint64_t));
+    g_shootdown_asid_harts = kmalloc(SHOOTDOWN_ASID_SLOTS * words * sizeof(uint64_t));
+    if (!g_shootdown_online || !g_shootdown_asid_harts)
+        return SHOOTDOWN_ERR_NO_MEMORY;
+
+    for (i = 0; i < words; i++)
+        g_shootdown_online[i] = 0;
+    for (i = 0; i < SHOOTDOWN_ASID_SLOTS * words; i++)
+        g_shootdown_asid_harts[i] = 0;
+
+    g_shootdown_words = (uint32_t)words;
+    g_shootdown_harts = (uint32_t)hw->cpu_count;
+    g_shootdown_ready = 1;
+    return 0;
+}
+
+/**
+ * Oznacza bieżący hart jako mający włączone stronicowanie. Od tej chwili dostaje
+ * unieważnienia mapowań globalnych (TLB_ASID_ALL). Wołane po zapisie satp.
+ */
+void shootdown_hart_online(void)
+{
+    if (g_shootdown_ready)
+        shootdown_mark_self(g_shootdown_online);
+}
+
+/**
+ * Zapisuje, że bieżący hart uruchamia asid. Musi być wołane przed zapisem satp
+ * z tym ASID, żeby równoległy shootdown nie pominął harta.
+ * @param asid ASID
+ */
+void shootdown_note_asid(uint32_t asid)
+{
+    if (g_shootdown_ready && asid != TLB_ASID_ALL)
+        shootdown_mark_self(shootdown_asid_mask(asid));
+}
+
+/**
+ * Czyści paczkę.
+ */
+void shootdown_batch_init(shootdown_batch_t *batch)
+{
+    if (!batch)
+        return;
+
+    batch->count = 0;
+    batch->overflow = 0;
+}
+
+/**
+ * Dopisuje zakres do paczki. Zakres przylegający do ostatniego (ten sam ASID) jest
+ * z nim łączony od razu, więc sekwencyjne usuwanie stron zajmuje jeden wpis.
+ * @param batch Paczka
+ * @param va Adres początkowy
+ * @param size Rozmiar w bajtach (0 = nic)
+ * @param asid ASID albo TLB_ASID_ALL
+ */
+void shootdown_add(shootdown_batch_t *batch, uint64_t va, uint64_t size, uint32_t asid)
+{
+    shootdown_range_t *last;
+
+    if (!batch || !size || batch->overflow)
+        return;
+
+    if (batch->count) {
+        last = &batch->ranges[batch->count - 1];
+        if (last->asid == asid && va <= last->start + last->size && last->start <= va + size) {
+            uint64_t end = last->start + last->size;
+
+            if (va + size > end)
+                end = va + size;
+            if (va < last->start)
+                last->start = va;
+            last->size = end - last->start;
+            return;
+        }
+    }
+
+    if (batch->count == SHOOTDOWN_BATCH_CAP) {
+        batch->overflow = 1;
+        return;
+    }
+
+    batch->ranges[batch->count].start = va;
+    batch->ranges[batch->count].size = size;
+    batch->ranges[batch->count].asid = asid;
+    batch->count++;
+}
+
+/**
+ * Sortuje zakresy paczki po (asid, start) i scala nakładające się lub przylegające.
+ */
+static void shootdown_coalesce(shootdown_batch_t *batch)
+{
+    uint32_t i;
+    uint32_t j;
+    uint32_t out;
+
+    for (i = 1; i < batch->count; i++) {
+        shootdown_range_t key = batch->ranges[i];
+
+        for (j = i; j > 0; j--) {
+            const shootdown_range_t *prev = &batch->ranges[j - 1];
+
+            if (prev->asid < key.asid || (prev->asid == key.asid && prev->start <= key.start))
+                break;
+            batch->ranges[j] = batch->ranges[j - 1];
+        }
+        batch->ranges[j] = key;
+    }
+
+    for (i = 1, out = 0; i < batch->count; i++) {
+        shootdown_range_t *cur = &batch->ranges[out];
+        const shootdown_range_t *next = &batch->ranges[i];
+
+        if (next->asid == cur->asid && next->start <= cur->start + cur->size) {
+            if (next->start + next->size > cur->start + cur->size)
+                cur->size = next->start + next->size - cur->start;
+            continue;
+        }
+        batch->ranges[++out] = *next;
+    }
+
+    if (batch->count)
+        batch->count = out + 1;
+}
+
+/**
+ * Unieważnia zakres w TLB bieżącego harta.
+ * @param start Adres początkowy (ignorowany przy SHOOTDOWN_FLUSH_ALL)
+ * @param size Rozmiar albo SHOOTDOWN_FLUSH_ALL
+ * @param asid ASID albo TLB_ASID_ALL
+ */
+static void shootdown_local(uint64_t start, uint64_t size, uint32_t asid)
+{
+    if (size == SHOOTDOWN_FLUSH_ALL)
+        tlb_flush_asid(asid);
+    else
+        tlb_flush_range(start, size, asid);
+}
+
+/**
+ * Jedno wywołanie SBI RFENCE dla okna 64 hartid zaczynającego się od base.
+ * @return 0 jeśli sukces, SHOOTDOWN_ERR_SBI gdy RFENCE zwróci błąd
+ */
+static int shootdown_rfence(uint64_t mask, unsigned long base, uint64_t start, uint64_t size,
+                            uint32_t asid)
+{
+    struct sbiret ret;
+
+    if (asid == TLB_ASID_ALL)
+        ret = sbi_remote_sfence_vma(mask, base, start, size);
+    else
+        ret = sbi_remote_sfence_vma_asid(mask, base, start, size, asid);
+    shootdown_stat_add(&g_shootdown_stats.rfence_calls, 1);
+
+    return ret.error ? SHOOTDOWN_ERR_SBI : 0;
+}
+
+/**
+ * Unieważnia zakres na pozostałych hartach, które mogą go mieć w TLB: online dla
+ * TLB_ASID_ALL, online i z bitem w slocie ASID w przeciwnym razie. Maski są po
+ * gęstym indeksie, a hart_mask SBI po hartid, więc cele są przepisywane przez
+ * hart_id_of do okien 64 kolejnych hartid; jedno RFENCE na okno (zwykle jedno,
+ * gdy hartid są zwarte).
+ * @param start Adres początkowy (ignorowany przy SHOOTDOWN_FLUSH_ALL)
+ * @param size Rozmiar albo SHOOTDOWN_FLUSH_ALL
+ * @param asid ASID albo TLB_ASID_ALL
+ * @return 0 jeśli sukces, SHOOTDOWN_ERR_SBI gdy RFENCE zwróci błąd
+ */
+static int shootdown_remote(uint64_t start, uint64_t size, uint32_t asid)
+{
+    uint32_t self = hart_index();
+    uint64_t hart_mask = 0;
+    unsigned long hart_base = 0;
+    uint32_t w;
+    int err;
+
+    for (w = 0; w < g_shootdown_words; w++) {
+        uint64_t others = __atomic_load_n(&g_shootdown_online[w], __ATOMIC_RELAXED);
+        uint64_t mask;
+
+        if (self / SHOOTDOWN_MASK_BITS == w)
+            others &= ~(1ULL << (self % SHOOTDOWN_MASK_BITS));
+
+        mask = others;
+        if (asid != TLB_ASID_ALL)
+            mask &= __atomic_load_n(&shootdown_asid_mask(asid)[w], __ATOMIC_RELAXED);
+        if (mask != others)
+            shootdown_stat_add(&g_shootdown_stats.skipped_harts,
+                               (uint64_t)__builtin_popcountll(others & ~mask));
+
+        while (mask) {
+            uint32_t hartid = hart_id_of(w * SHOOTDOWN_MASK_BITS + (uint32_t)__builtin_ctzll(mask));
+
+            mask &= mask - 1ULL;
+            if (hartid == HART_NONE)
+                continue;
+
+            if (hart_mask && (hartid < hart_base || hartid - hart_base >= SHOOTDOWN_MASK_BITS)) {
+                err = shootdown_rfence(hart_mask, hart_base, start, size, asid);
+                if (err)
+                    return err;
+                hart_mask = 0;
+            }
+            if (!hart_mask)
+                hart_base = hartid & ~(unsigned long)(SHOOTDOWN_MASK_BITS - 1);
+            hart_mask |= 1ULL << (hartid - hart_base);
+        }
+    }
+
+    return hart_mask ? shootdown_rfence(hart_mask, hart_base, start, size, asid) : 0;
+}
+
+/**
+ * Wysyła paczkę. Zakresy są scalane i unieważniane lokalnie każdy osobno, a do
+ * pozostałych hartów idzie jedno RFENCE na całą paczkę: sam zakres, gdy został
+ * jeden; zakres obejmujący wszystkie, gdy mają ten sam ASID (SBI sam przechodzi
+ * na pełne unieważnienie powyżej swojego progu); pełne unieważnienie wszystkich
+ * ASID, gdy ASID są różne. Przepełniona paczka staje się jednym pełnym
+ * unieważnieniem. Przed shootdown_init unieważnia tylko lokalnie. Paczka jest potem pusta.
+ * @param batch Paczka
+ * @return 0 jeśli sukces, SHOOTDOWN_ERR_* w przeciwnym razie
+ */
+int shootdown_commit(shootdown_batch_t *batch)
+{
+    uint64_t start;
+    uint64_t end;
+    uint32_t asid;
+    uint32_t i;
+    int err;
+
+    if (!batch)
+        return SHOOTDOWN_ERR_BADVALUE;
+    if (!batch->count && !batch->overflow)
+        return 0;
+
+    if (!g_shootdown_ready) {
+        if (batch->overflow)
+            tlb_flush_all();
+        for (i = 0; !batch->overflow && i < batch->count; i++)
+            tlb_flush_range(batch->ranges[i].start, batch->ranges[i].size, batch->ranges[i].asid);
+        shootdown_batch_init(batch);
+        return 0;
+    }
+
+    shootdown_stat_add(&g_shootdown_stats.commits, 1);
+    if (batch->overflow) {
+        start = 0;
+        end = SHOOTDOWN_FLUSH_ALL;
+        asid = TLB_ASID_ALL;
+        shootdown_local(0, SHOOTDOWN_FLUSH_ALL, TLB_ASID_ALL);
+    } else {
+        shootdown_coalesce(batch);
+        shootdown_stat_add(&g_shootdown_stats.ranges, batch->count);
+
+        start = batch->ranges[0].start;
+        end = start;
+        asid = batch->ranges[0].asid;
+        for (i = 0; i < batch->count; i++) {
+            const shootdown_range_t *r = &batch->ranges[i];
+
+            shootdown_local(r->start, r->size, r->asid);
+            if (r->asid != asid) {
+                start = 0;
+                end = SHOOTDOWN_FLUSH_ALL;
+                asid = TLB_ASID_ALL;
+            } else if (r->size == SHOOTDOWN_FLUSH_ALL) {
+                start = 0;
+                end = SHOOTDOWN_FLUSH_ALL;
+            } else if (end != SHOOTDOWN_FLUSH_ALL) {
+                if (r->start < start)
+                    start = r->start;
+                if (r->start + r->size > end)
+                    end = r->start + r->size;
+            }
+        }
+    }
+
+    /* Zapisy PTE muszą być widoczne, zanim inne harty zaczną unieważniać */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (end == SHOOTDOWN_FLUSH_ALL)
+        shootdown_stat_add(&g_shootdown_stats.full_flushes, 1);
+    err = shootdown_remote(start, (end == SHOOTDOWN_FLUSH_ALL) ? SHOOTDOWN_FLUSH_ALL : end - start, asid);
+
+    shootdown_batch_init(batch);
+    return err;
+}
+
+/**
+ * Unieważnia jeden zakres na wszystkich hartach, które mogą go mieć w TLB.
+ * @param va Adres początkowy
+ * @param size Rozmiar w bajtach
+ * @param asid ASID albo TLB_ASID_ALL
+ * @return 0 jeśli sukces, SHOOTDOWN_ERR_* w przeciwnym razie
+ */
+int shootdown_range(uint64_t va, uint64_t size, uint32_t asid)
+{
+    shootdown_batch_t batch;
+
+    shootdown_batch_init(&batch);
+    shootdown_add(&batch, va, size, asid);
+    return shootdown_commit(&batch);
+}
+
+/**
+ * Wyświetla liczniki silnika shootdown.
+ */
+void shootdown_dump(void)
+{
+    if (!uart_console_is_ready())
+        return;
+
+    uart_console_puts("[shootdown] commits=");
+    uart_console_put_dec_u64(g_shootdown_stats.commits);
+    uart_console_puts(" ranges=");
+    uart_console_put_dec_u64(g_shootdown_stats.ranges);
+    uart_console_puts(" full=");
+    uart_console_put_dec_u64(g_shootdown_stats.full_flushes);
+    uart_console_puts(" rfence=");
+    uart_console_put_dec_u64(g_shootdown_stats.rfence_calls);
+    uart_console_puts(" skipped_harts=");
+    uart_console_put_dec_u64(g_shootdown_stats.skipped_harts);
+    uart_console_puts("\n");
+}
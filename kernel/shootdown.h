@@ -0,0 +1,53 @@
+#ifndef KERNEL_SHOOTDOWN_H
+#define KERNEL_SHOOTDOWN_H
+
+#include <stdint.h>
+#include <platform_init.h>
+
+/* Liczba zakresów w jednej paczce; nadmiar zamienia paczkę w pełne unieważnienie */
+#ifndef SHOOTDOWN_BATCH_CAP
+#define SHOOTDOWN_BATCH_CAP 16
+#endif
+
+/*
+ * Liczba slotów śledzenia ASID (potęga dwójki). Slot asid & (SLOTS - 1) trzyma maskę
+ * hartów, które kiedykolwiek uruchomiły któryś z ASID tego slotu, więc kolizje
+ * dają tylko nadmiarowe (nigdy brakujące) unieważnienia.
+ */
+#ifndef SHOOTDOWN_ASID_SLOTS
+#define SHOOTDOWN_ASID_SLOTS 64
+#endif
+
+enum {
+    SHOOTDOWN_ERR_BADVALUE = -13000,
+    SHOOTDOWN_ERR_NOT_READY,
+    SHOOTDOWN_ERR_NO_MEMORY,
+    SHOOTDOWN_ERR_SBI,
+};
+
+typedef struct {
+    uint64_t start;
+    uint64_t size;
+    uint32_t asid;
+} shootdown_range_t;
+
+/**
+ * Paczka unieważnień zbierana przez wołającego (np. na stosie) i wysyłana jednym
+ * shootdown_commit(). overflow oznacza, że zakresów było więcej niż SHOOTDOWN_BATCH_CAP.
+ */
+typedef struct {
+    shootdown_range_t ranges[SHOOTDOWN_BATCH_CAP];
+    uint32_t count;
+    int overflow;
+} shootdown_batch_t;
+
+int shootdown_init(const hw_state_t *hw);
+void shootdown_hart_online(void);
+void shootdown_note_asid(uint32_t asid);
+void shootdown_batch_init(shootdown_batch_t *batch);
+void shootdown_add(shootdown_batch_t *batch, uint64_t va, uint64_t size, uint32_t asid);
+int shootdown_commit(shootdown_batch_t *batch);
+int shootdown_range(uint64_t va, uint64_t size, uint32_t asid);
+void shootdown_dump(void);
+
+#endif
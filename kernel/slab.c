@@ -0,0 +1,451 @@
+#include <stdint.h>
+#include <uart/uart_console.h>
+#include <hart.h>
+#include <spinlock.h>
+#include <buddy.h>
+#include <page_cache.h>
+#include <slab.h>
+
+/**
+ * Lista wolnych obiektów jednego harta. Dostęp ma tylko właściciel, więc
+ * alloc/free nie potrzebują atomików; lista cache jest dotykana tylko paczkami.
+ */
+typedef struct {
+    void *free;
+    uint32_t count;
+} __attribute__((aligned(KMEM_CACHE_LINE))) kmem_cpu_t;
+
+/**
+ * Nagłówek slaba, zapisany na początku bloku 2^order stron. Blok z buddy jest
+ * wyrównany do swojego rozmiaru, więc nagłówek obiektu to obj & ~(bajty slaba - 1).
+ */
+typedef struct {
+    kmem_cache_t *cache;
+} kmem_slab_t;
+
+/**
+ * Cache obiektów jednego rozmiaru. Deskryptory cache są obiektami cache
+ * "kmem_cache", więc tablica cpu[] ma długość cpu_count z DTB, a nie stałą z makra.
+ */
+struct kmem_cache {
+    const char *name;       /* Nazwa do dumpa; musi żyć tak długo jak cache */
+    uint64_t size;          /* Rozmiar obiektu podany przez wywołującego */
+    uint64_t stride;        /* Odstęp między obiektami w slabie (wyrównany) */
+    uint64_t link;          /* Przesunięcie wskaźnika listy wolnych w obiekcie */
+    uint64_t first;         /* Przesunięcie pierwszego obiektu w slabie */
+    uint32_t per_slab;
+    uint32_t batch;         /* Paczka lista harta <-> lista cache, najwyżej jeden slab */
+    int order;
+    kmem_ctor_t ctor;
+
+    spinlock_t lock;        /* Chroni free, free_count i slabs */
+    void *free;
+    uint64_t free_count;
+    uint64_t slabs;
+
+    struct kmem_cache *next;
+    uint32_t cpu_count;
+    kmem_cpu_t cpu[];
+};
+
+static kmem_cache_t *g_kmem_cache_cache;
+static kmem_cache_t *g_kmem_caches;
+static spinlock_t g_kmem_list_lock = SPINLOCK_INIT;
+static uint32_t g_kmem_cpu_count;
+static int g_kmem_ready;
+
+static uint64_t kmem_align_up(uint64_t value, uint64_t align)
+{
+    return (value + align - 1ULL) & ~(align - 1ULL);
+}
+
+/**
+ * Zwraca miejsce wskaźnika listy wolnych w obiekcie. Bez konstruktora jest to
+ * pierwsze słowo obiektu; z konstruktorem słowo za obiektem, żeby wolny obiekt
+ * zachował stan nadany przez konstruktor.
+ */
+static void **kmem_link(const kmem_cache_t *cache, void *obj)
+{
+    return (void **)((uint8_t *)obj + cache->link);
+}
+
+static uint64_t kmem_slab_bytes(const kmem_cache_t *cache)
+{
+    return BUDDY_PAGE_SIZE << cache->order;
+}
+
+/**
+ * Zwraca listę bieżącego harta albo 0, gdy hart nie ma własnej
+ * (indeks spoza cpu_count) i musi iść do listy cache pod blokadą.
+ */
+static kmem_cpu_t *kmem_cpu_local(kmem_cache_t *cache)
+{
+    uint32_t index = hart_index();
+
+    return (index < cache->cpu_count) ? &cache->cpu[index] : 0;
+}
+
+/**
+ * Wylicza układ obiektów w slabie i zeruje listy wolnych.
+ * Rząd slaba jest najmniejszym, który mieści KMEM_SLAB_MIN_OBJECTS obiektów
+ * (albo KMEM_SLAB_MAX_ORDER dla dużych obiektów).
+ * @return 0 jeśli sukces, SLAB_ERR_BADVALUE gdy obiekt nie mieści się w slabie
+ */
+static int kmem_cache_setup(kmem_cache_t *cache, const char *name, uint64_t size,
+                            uint64_t align, uint32_t flags, kmem_ctor_t ctor)
+{
+    uint64_t bytes = 0;
+    uint32_t i;
+    int order;
+
+    if (align < sizeof(void *))
+        align = sizeof(void *);
+    if ((flags & KMEM_CACHE_HWALIGN) && align < KMEM_CACHE_LINE)
+        align = KMEM_CACHE_LINE;
+    if (align > (BUDDY_PAGE_SIZE << KMEM_SLAB_MAX_ORDER) / 2)
+        return SLAB_ERR_BADVALUE;
+
+    cache->name = name;
+    cache->size = size;
+    cache->ctor = ctor;
+    cache->link = ctor ? kmem_align_up(size, sizeof(void *)) : 0;
+    cache->stride = kmem_align_up(ctor ? cache->link + sizeof(void *)
+                                       : (size < sizeof(void *) ? sizeof(void *) : size), align);
+    cache->first = kmem_align_up(sizeof(kmem_slab_t), align);
+
+    for (order = 0; order <= KMEM_SLAB_MAX_ORDER; order++) {
+        bytes = BUDDY_PAGE_SIZE << order;
+        if ((bytes - cache->first) / cache->stride >= KMEM_SLAB_MIN_OBJECTS)
+            break;
+    }
+    if (order > KMEM_SLAB_MAX_ORDER)
+        order = KMEM_SLAB_MAX_ORDER;
+    if (bytes < cache->first + cache->stride)
+        return SLAB_ERR_BADVALUE;
+
+    cache->order = order;
+    cache->per_slab = (uint32_t)((bytes - cache->first) / cache->stride);
+    cache->batch = (cache->per_slab < KMEM_CPU_BATCH) ? cache->per_slab : KMEM_CPU_BATCH;
+    cache->lock.locked = 0;
+    cache->free = 0;
+    cache->free_count = 0;
+    cache->slabs = 0;
+    cache->next = 0;
+    cache->cpu_count = g_kmem_cpu_count;
+    for (i = 0; i < cache->cpu_count; i++) {
+        cache->cpu[i].free = 0;
+        cache->cpu[i].count = 0;
+    }
+
+    return 0;
+}
+
+/**
+ * Dokłada do listy cache nowy slab: blok 2^order stron z page_alloc_order,
+ * każdy obiekt przechodzi raz przez konstruktor. Wołane pod cache->lock.
+ * @return 0 jeśli sukces, SLAB_ERR_NO_MEMORY gdy brak stron
+ */
+static int kmem_cache_grow(kmem_cache_t *cache)
+{
+    kmem_slab_t *slab;
+    uint8_t *obj;
+    uint64_t pa;
+    uint32_t i;
+
+    if (page_alloc_order(cache->order, &pa))
+        return SLAB_ERR_NO_MEMORY;
+
+    slab = (kmem_slab_t *)(uintptr_t)pa;
+    slab->cache = cache;
+
+    /* Od końca, żeby lista wydawała obiekty rosnąco */
+    for (i = cache->per_slab; i > 0; i--) {
+        obj = (uint8_t *)slab + cache->first + (uint64_t)(i - 1) * cache->stride;
+        if (cache->ctor)
+            cache->ctor(obj);
+        *kmem_link(cache, obj) = cache->free;
+        cache->free = obj;
+    }
+
+    cache->free_count += cache->per_slab;
+    cache->slabs++;
+    return 0;
+}
+
+/**
+ * Zdejmuje jeden obiekt z listy cache, w razie potrzeby dokładając slab.
+ * Wołane pod cache->lock.
+ */
+static void *kmem_shared_pop(kmem_cache_t *cache)
+{
+    void *obj;
+
+    if (!cache->free && kmem_cache_grow(cache))
+        return 0;
+
+    obj = cache->free;
+    cache->free = *kmem_link(cache, obj);
+    cache->free_count--;
+    return obj;
+}
+
+/**
+ * Przenosi paczkę cache->batch obiektów z listy cache na listę harta.
+ * @return 0 jeśli lista harta nie jest pusta, SLAB_ERR_NO_MEMORY w przeciwnym razie
+ */
+static int kmem_cpu_refill(kmem_cache_t *cache, kmem_cpu_t *c)
+{
+    void *obj;
+    uint32_t i;
+
+    spin_lock(&cache->lock);
+    for (i = 0; i < cache->batch; i++) {
+        obj = kmem_shared_pop(cache);
+        if (!obj)
+            break;
+        *kmem_link(cache, obj) = c->free;
+        c->free = obj;
+        c->count++;
+    }
+    spin_unlock(&cache->lock);
+
+    return c->count ? 0 : SLAB_ERR_NO_MEMORY;
+}
+
+/**
+ * Zostawia na liście harta cache->batch ostatnio zwolnionych (ciepłych)
+ * obiektów, resztę dopina w całości do listy cache.
+ */
+static void kmem_cpu_flush(kmem_cache_t *cache, kmem_cpu_t *c)
+{
+    void *keep_tail = c->free;
+    void *cold;
+    void *tail;
+    uint32_t moved;
+    uint32_t i;
+
+    for (i = 1; i < cache->batch; i++)
+        keep_tail = *kmem_link(cache, keep_tail);
+
+    cold = *kmem_link(cache, keep_tail);
+    *kmem_link(cache, keep_tail) = 0;
+
+    tail = cold;
+    for (moved = 1; *kmem_link(cache, tail); moved++)
+        tail = *kmem_link(cache, tail);
+
+    spin_lock(&cache->lock);
+    *kmem_link(cache, tail) = cache->free;
+    cache->free = cold;
+    cache->free_count += moved;
+    spin_unlock(&cache->lock);
+
+    c->count -= moved;
+}
+
+/**
+ * Przygotowuje alokator slab: cache "kmem_cache" na deskryptory pozostałych cache.
+ * Deskryptor każdego cache ma listę wolnych dla hw->cpu_count hartów.
+ * @param hw Stan sprzętowy z init_dtb (cpu_count)
+ * @return 0 jeśli sukces, SLAB_ERR_* w przeciwnym razie
+ */
+int kmem_init(const hw_state_t *hw)
+{
+    uint64_t bytes;
+    uint64_t pa;
+    int order = 0;
+
+    if (!hw || hw->cpu_count <= 0)
+        return SLAB_ERR_BADVALUE;
+
+    g_kmem_cpu_count = (uint32_t)hw->cpu_count;
+    bytes = sizeof(kmem_cache_t) + (uint64_t)g_kmem_cpu_count * sizeof(kmem_cpu_t);
+    while (order < KMEM_SLAB_MAX_ORDER && (BUDDY_PAGE_SIZE << order) < bytes)
+        order++;
+    if ((BUDDY_PAGE_SIZE << order) < bytes)
+        return SLAB_ERR_BADVALUE;
+    if (page_alloc_order(order, &pa))
+        return SLAB_ERR_NO_MEMORY;
+
+    g_kmem_cache_cache = (kmem_cache_t *)(uintptr_t)pa;
+    if (kmem_cache_setup(g_kmem_cache_cache, "kmem_cache", bytes, KMEM_CACHE_LINE, 0, 0)) {
+        page_free_order(pa, order);
+        return SLAB_ERR_BADVALUE;
+    }
+
+    g_kmem_caches = g_kmem_cache_cache;
+    g_kmem_ready = 1;
+    return 0;
+}
+
+/**
+ * Tworzy nazwany cache obiektów o stałym rozmiarze.
+ * @param name Nazwa do dumpa (np. literał); nie jest kopiowana
+ * @param size Rozmiar obiektu w bajtach
+ * @param align Wymagane wyrównanie (potęga dwójki lub 0)
+ * @param flags KMEM_CACHE_HWALIGN wyrównuje obiekty do linii cache
+ * @param ctor Konstruktor wołany raz na obiekt przy tworzeniu slaba (lub 0).
+ *             Obiekt zwracany do cache musi być z powrotem w stanie po konstruktorze.
+ * @return Wskaźnik do cache albo 0 przy błędzie
+ */
+kmem_cache_t *kmem_cache_create(const char *name, uint64_t size, uint64_t align,
+                                uint32_t flags, kmem_ctor_t ctor)
+{
+    kmem_cache_t *cache;
+
+    if (!g_kmem_ready || !name || !size || (align & (align - 1ULL)))
+        return 0;
+
+    cache = kmem_cache_alloc(g_kmem_cache_cache);
+    if (!cache)
+        return 0;
+    if (kmem_cache_setup(cache, name, size, align, flags, ctor)) {
+        kmem_cache_free(g_kmem_cache_cache, cache);
+        return 0;
+    }
+
+    spin_lock(&g_kmem_list_lock);
+    cache->next = g_kmem_caches;
+    g_kmem_caches = cache;
+    spin_unlock(&g_kmem_list_lock);
+
+    return cache;
+}
+
+/**
+ * Przydziela obiekt z listy bieżącego harta. Gorąca ścieżka dotyka tylko danych
+ * harta; pusta lista dobiera paczkę z listy cache pod blokadą.
+ * @param cache Cache z kmem_cache_create
+ * @return Wskaźnik do obiektu albo 0 przy braku pamięci
+ */
+void *kmem_cache_alloc(kmem_cache_t *cache)
+{
+    kmem_cpu_t *c;
+    void *obj;
+
+    if (!cache)
+        return 0;
+
+    c = kmem_cpu_local(cache);
+    if (!c) {
+        spin_lock(&cache->lock);
+        obj = kmem_shared_pop(cache);
+        spin_unlock(&cache->lock);
+        return obj;
+    }
+
+    if (!c->count && kmem_cpu_refill(cache, c))
+        return 0;
+
+    obj = c->free;
+    c->free = *kmem_link(cache, obj);
+    c->count--;
+    return obj;
+}
+
+/**
+ * Zwalnia obiekt na listę bieżącego harta (obiekt może pochodzić z dowolnego harta).
+ * Przynależność sprawdzana jest przez nagłówek slaba i położenie obiektu w slabie.
+ * @param cache Cache, z którego obiekt przydzielono
+ * @param obj Obiekt
+ * @return 0 jeśli sukces, SLAB_ERR_* w przeciwnym razie
+ */
+int kmem_cache_free(kmem_cache_t *cache, void *obj)
+{
+    const kmem_slab_t *slab;
+    kmem_cpu_t *c;
+    uint64_t offset;
+
+    if (!cache || !obj)
+        return SLAB_ERR_BADVALUE;
+
+    slab = (const kmem_slab_t *)((uintptr_t)obj & ~(uintptr_t)(kmem_slab_bytes(cache) - 1ULL));
+    offset = (uint64_t)((uintptr_t)obj - (uintptr_t)slab);
+    if (slab->cache != cache || offset < cache->first ||
+        (offset - cache->first) % cache->stride ||
+        (offset - cache->first) / cache->stride >= cache->per_slab)
+        return SLAB_ERR_NOT_OWNED;
+
+    c = kmem_cpu_local(cache);
+    if (!c) {
+        spin_lock(&cache->lock);
+        *kmem_link(cache, obj) = cache->free;
+        cache->free = obj;
+        cache->free_count++;
+        spin_unlock(&cache->lock);
+        return 0;
+    }
+
+    *kmem_link(cache, obj) = c->free;
+    c->free = obj;
+    c->count++;
+    if (c->count > KMEM_CPU_LIMIT_SCALE * cache->batch)
+        kmem_cpu_flush(cache, c);
+    return 0;
+}
+
+/**
+ * Zwraca rozmiar obiektu cache (podany przy tworzeniu).
+ */
+uint64_t kmem_cache_size(const kmem_cache_t *cache)
+{
+    return cache ? cache->size : 0;
+}
+
+/**
+ * Zwraca cache, do którego należy obiekt, na podstawie nagłówka slaba.
+ * Slab jest blokiem buddy, a obiekt nigdy nie leży na jego początku.
+ * @param obj Obiekt z kmem_cache_alloc
+ * @return Cache obiektu albo 0, gdy adres nie leży wewnątrz przydzielonego bloku
+ */
+kmem_cache_t *kmem_cache_of(const void *obj)
+{
+    uint64_t head;
+    int order;
+
+    if (!obj || buddy_block_of((uint64_t)(uintptr_t)obj, &head, &order) ||
+        head == (uint64_t)(uintptr_t)obj)
+        return 0;
+
+    return ((const kmem_slab_t *)(uintptr_t)head)->cache;
+}
+
+/**
+ * Wyświetla cache, które mają choć jeden slab: rozmiar, układ slaba i zajętość.
+ * Liczniki list innych hartów czytane są bez blokady, więc wynik jest przybliżony.
+ */
+void kmem_cache_dump(void)
+{
+    const kmem_cache_t *cache;
+    uint64_t objects;
+    uint64_t free;
+    uint32_t i;
+
+    if (!g_kmem_ready || !uart_console_is_ready())
+        return;
+
+    for (cache = g_kmem_caches; cache; cache = cache->next) {
+        if (!cache->slabs)
+            continue;
+        objects = cache->slabs * cache->per_slab;
+        free = cache->free_count;
+        for (i = 0; i < cache->cpu_count; i++)
+            free += cache->cpu[i].count;
+
+        uart_console_puts("[kmem] cache=");
+        uart_console_puts(cache->name);
+        uart_console_puts(" size=");
+        uart_console_put_dec_u64(cache->size);
+        uart_console_puts(" stride=");
+        uart_console_put_dec_u64(cache->stride);
+        uart_console_puts(" order=");
+        uart_console_put_dec_i32(cache->order);
+        uart_console_puts(" slabs=");
+        uart_console_put_dec_u64(cache->slabs);
+        uart_console_puts(" objects=");
+        uart_console_put_dec_u64(objects);
+        uart_console_puts(" in_use=");
+        uart_console_put_dec_u64(objects - free);
+        uart_console_puts("\n");
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef KERNEL_SLAB_H
+#define KERNEL_SLAB_H
+
+#include <stdint.h>
+#include <platform_init.h>
+
+/* Rozmiar linii cache; obiekty z KMEM_CACHE_HWALIGN nie dzielą linii */
+#define KMEM_CACHE_LINE 64
+
+/* Największy slab: 2^KMEM_SLAB_MAX_ORDER stron (64KB) */
+#define KMEM_SLAB_MAX_ORDER 4
+
+/* Minimalna liczba obiektów w slabie, według niej dobierany jest rząd slaba */
+#define KMEM_SLAB_MIN_OBJECTS 8
+
+/* Liczba obiektów przenoszonych naraz między listą harta a listą cache */
+#ifndef KMEM_CPU_BATCH
+#define KMEM_CPU_BATCH 16
+#endif
+
+/* Limit listy harta w paczkach; powyżej nadmiar wraca do listy cache.
+ * Paczka dużych obiektów jest mniejsza (najwyżej jeden slab), więc hart nie trzyma wielu stron. */
+#define KMEM_CPU_LIMIT_SCALE 4
+
+/* Flagi kmem_cache_create */
+#define KMEM_CACHE_HWALIGN (1u << 0)
+
+enum {
+    SLAB_ERR_BADVALUE = -10000,
+    SLAB_ERR_NOT_READY,
+    SLAB_ERR_NO_MEMORY,
+    SLAB_ERR_NOT_OWNED,
+};
+
+typedef struct kmem_cache kmem_cache_t;
+
+/* Konstruktor wołany raz dla każdego obiektu przy tworzeniu slaba */
+typedef void (*kmem_ctor_t)(void *obj);
+
+int kmem_init(const hw_state_t *hw);
+kmem_cache_t *kmem_cache_create(const char *name, uint64_t size, uint64_t align,
+                                uint32_t flags, kmem_ctor_t ctor);
+void *kmem_cache_alloc(kmem_cache_t *cache);
+int kmem_cache_free(kmem_cache_t *cache, void *obj);
+uint64_t kmem_cache_size(const kmem_cache_t *cache);
+kmem_cache_t *kmem_cache_of(const void *obj);
+void kmem_cache_dump(void);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef KERNEL_SPINLOCK_H
+#define KERNEL_SPINLOCK_H
+
+#include <stdint.h>
+
+/*
+ * Prosty spinlock test-and-test-and-set na amoswap (rozszerzenie A).
+ * Używany tylko poza gorącą ścieżką, np. przy dostępie do globalnej puli stron.
+ */
+typedef struct {
+    volatile uint32_t locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0 }
+
+static inline void spin_lock(spinlock_t *lock)
+{
+    while (__atomic_exchange_n(&lock->locked, 1u, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED))
+            ;
+    }
+}
+
+static inline void spin_unlock(spinlock_t *lock)
+{
+    __atomic_store_n(&lock->locked, 0u, __ATOMIC_RELEASE);
+}
+
+#endif
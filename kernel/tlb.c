@@ -0,0 +1,111 @@
+#include <stdint.h>
+#include <dtb/dtb.h>
+#include <csr.h>
+#include <tlb.h>
+
+#define TLB_PAGE_SIZE 0x1000ULL
+
+/* Rozszerzenie z riscv,isa; starsze DTB mają zamiast tego właściwość riscv,svinval */
+#define TLB_ISA_SVINVAL "svinval"
+
+static int g_tlb_svinval;
+
+/**
+ * Wykrywa Svinval na harcie startowym (riscv,svinval albo svinval w riscv,isa).
+ * Bez DTB (albo bez węzła CPU) zostaje ścieżka sfence.vma.
+ * @param hw Stan sprzętu (boot_cpu_node)
+ */
+void tlb_init(const hw_state_t *hw)
+{
+    dtb_cpu_t cpu;
+
+    g_tlb_svinval = 0;
+    if (!hw || hw->boot_cpu_node < 0 || dtb_cpu_read(hw->boot_cpu_node, &cpu))
+        return;
+
+    g_tlb_svinval = cpu.svinval || dtb_cpu_has_ext(&cpu, TLB_ISA_SVINVAL);
+}
+
+/**
+ * Zwraca 1, jeśli unieważnienia zakresów idą przez sinval.vma.
+ */
+int tlb_has_svinval(void)
+{
+    return g_tlb_svinval;
+}
+
+/**
+ * Unieważnia cały TLB bieżącego harta.
+ */
+void tlb_flush_all(void)
+{
+    sfence_vma_all();
+}
+
+/**
+ * Unieważnia wszystkie nieglobalne wpisy ASID na bieżącym harcie.
+ * @param asid ASID albo TLB_ASID_ALL (wtedy pełne sfence.vma)
+ */
+void tlb_flush_asid(uint32_t asid)
+{
+    if (asid == TLB_ASID_ALL)
+        sfence_vma_all();
+    else
+        sfence_vma_asid(asid);
+}
+
+/**
+ * Unieważnia wpisy jednej strony na bieżącym harcie.
+ * @param va Adres wirtualny (dowolny w obrębie strony)
+ * @param asid ASID albo TLB_ASID_ALL (wszystkie ASID i wpisy globalne)
+ */
+void tlb_flush_page(uint64_t va, uint32_t asid)
+{
+    if (asid == TLB_ASID_ALL)
+        sfence_vma_va(va);
+    else
+        sfence_vma_va_asid(va, asid);
+}
+
+/**
+ * Unieważnia wpisy zakresu na bieżącym harcie. Z Svinval strony są unieważniane
+ * partią sinval.vma między jedną parą barier, bez niego osobnym sfence.vma na
+ * stronę. Zakres dłuższy niż próg (TLB_SVINVAL_MAX_PAGES / TLB_FLUSH_MAX_PAGES)
+ * unieważnia cały ASID, bo kolejne bariery kosztowałyby więcej niż ponowne
+ * napełnienie TLB. Wpis dużego liścia znika, gdy unieważnia się dowolny adres
+ * w jego zakresie, więc krok 4KB zawsze wystarcza.
+ * @param va Adres początkowy
+ * @param size Rozmiar w bajtach (0 = nic)
+ * @param asid ASID albo TLB_ASID_ALL (wszystkie ASID i wpisy globalne)
+ */
+void tlb_flush_range(uint64_t va, uint64_t size, uint32_t asid)
+{
+    uint64_t start = va & ~(TLB_PAGE_SIZE - 1ULL);
+    uint64_t pages;
+    uint64_t i;
+
+    if (!size)
+        return;
+
+    pages = (((va + size - 1ULL) & ~(TLB_PAGE_SIZE - 1ULL)) - start) / TLB_PAGE_SIZE + 1ULL;
+
+    if (pages > (g_tlb_svinval ? TLB_SVINVAL_MAX_PAGES : TLB_FLUSH_MAX_PAGES)) {
+        tlb_flush_asid(asid);
+        return;
+    }
+
+    if (!g_tlb_svinval) {
+        for (i = 0; i < pages; i++)
+            tlb_flush_page(start + i * TLB_PAGE_SIZE, asid);
+        return;
+    }
+
+    sfence_w_inval();
+    for (i = 0; i < pages; i++) {
+        if (asid == TLB_ASID_ALL)
+            sinval_vma_va(start + i * TLB_PAGE_SIZE);
+        else
+            sinval_vma(start + i * TLB_PAGE_SIZE, asid);
+    }
+    sfence_inval_ir();
+}
@@ -0,0 +1,31 @@
+#ifndef KERNEL_TLB_H
+#define KERNEL_TLB_H
+
+#include <stdint.h>
+#include <platform_init.h>
+
+/*
+ * Progi, powyżej których unieważnienie zakresu zamienia się w pełne sfence.vma
+ * (dla jednego ASID: sfence.vma zero, asid). Bez Svinval każda strona to osobna
+ * bariera, więc próg jest niski; sinval.vma nie serializuje potoku, więc partia
+ * może być dłuższa.
+ */
+#ifndef TLB_FLUSH_MAX_PAGES
+#define TLB_FLUSH_MAX_PAGES 32
+#endif
+
+#ifndef TLB_SVINVAL_MAX_PAGES
+#define TLB_SVINVAL_MAX_PAGES 256
+#endif
+
+/* ASID oznaczający wszystkie przestrzenie adresowe, łącznie z wpisami globalnymi */
+#define TLB_ASID_ALL ((uint32_t)-1)
+
+void tlb_init(const hw_state_t *hw);
+int tlb_has_svinval(void);
+void tlb_flush_all(void);
+void tlb_flush_page(uint64_t va, uint32_t asid);
+void tlb_flush_range(uint64_t va, uint64_t size, uint32_t asid);
+void tlb_flush_asid(uint32_t asid);
+
+#endif
@@ -0,0 +1,769 @@
+#include <libfdt.h>
+#include <stdint.h>
+#include <dtb/dtb.h>
+#include <uart/uart_console.h>
+#include <memory_map.h>
+#include <page_cache.h>
+#include <csr.h>
+#include <tlb.h>
+#include <shootdown.h>
+#include <vm.h>
+
+extern char _text_start[];
+extern char _rodata_start[];
+extern char _data_start[];
+extern char _kernel_start[];
+extern char _kernel_image_end[];
+
+/* PPN w PTE zajmuje bity 10..53 */
+#define VM_PTE_PPN_SHIFT 10
+#define VM_PTE_PPN_MASK  ((1ULL << 44) - 1ULL)
+#define VM_PTE_PERM      (PTE_R | PTE_W | PTE_X)
+
+/* Bity liścia poza PPN, które przechodzą przez podział (flagi i typ pamięci, bez N) */
+#define VM_PTE_LEAF_ATTR (((1ULL << VM_PTE_PPN_SHIFT) - 1ULL) | PTE_PBMT_MASK)
+
+/* Dolna połowa przestrzeni wirtualnej przy danej liczbie poziomów (adresy fizyczne 1:1) */
+#define VM_VA_LIMIT(levels) (1ULL << (12 + 9 * (levels) - 1))
+
+/* mmu-type z DTB, dla którego nie ma stronicowania */
+#define VM_DTB_MMU_NONE "riscv,none"
+
+/* Rozszerzenia z riscv,isa (po '_', np. "rv64imac_svnapot") */
+#define VM_ISA_SVNAPOT "svnapot"
+#define VM_ISA_SVPBMT  "svpbmt"
+
+/*
+ * Tryb stronicowania. walk i map_one są wersjami vm_walk_levels/vm_map_one_levels
+ * ze stałą liczbą poziomów (VM_MODE_WALKERS), więc pętla po tablicach nie sprawdza
+ * trybu przy każdym kroku; tryb wybiera się raz, przez wskaźnik g_vm_mode.
+ */
+typedef struct {
+    const char *name;
+    const char *dtb_name;
+    uint64_t satp_mode;
+    int levels;
+    uint64_t va_limit;
+    pte_t *(*walk)(const pte_t *root, uint64_t va, int *level);
+    int (*map_one)(pte_t *root, uint64_t va, uint64_t pa, int *level, uint64_t flags);
+} vm_mode_t;
+
+static pte_t *g_vm_kernel_root;
+static vm_stats_t g_vm_stats;
+static int g_vm_enabled;
+static int g_vm_napot;
+static int g_vm_pbmt;
+
+static uint64_t vm_level_size(int level)
+{
+    return VM_PAGE_SIZE << (9 * level);
+}
+
+static uint32_t vm_index(uint64_t va, int level)
+{
+    return (uint32_t)((va >> (12 + 9 * level)) & (VM_PTES_PER_TABLE - 1));
+}
+
+static int vm_pte_is_leaf(pte_t pte)
+{
+    return (pte & VM_PTE_PERM) != 0;
+}
+
+static uint64_t vm_pte_pa(pte_t pte)
+{
+    return ((pte >> VM_PTE_PPN_SHIFT) & VM_PTE_PPN_MASK) * VM_PAGE_SIZE;
+}
+
+static pte_t vm_pte_make(uint64_t pa, uint64_t flags)
+{
+    return ((pa / VM_PAGE_SIZE) << VM_PTE_PPN_SHIFT) | flags;
+}
+
+static pte_t *vm_pte_table(pte_t pte)
+{
+    return (pte_t *)(uintptr_t)vm_pte_pa(pte);
+}
+
+/**
+ * Przydziela wyzerowaną stronę na tablicę stron.
+ * @param table Wskaźnik na tablicę (wyjście)
+ * @return 0 jeśli sukces, VM_ERR_NO_MEMORY w przeciwnym razie
+ */
+static int vm_table_alloc(pte_t **table)
+{
+    uint64_t pa;
+    uint32_t i;
+
+    if (page_alloc(&pa))
+        return VM_ERR_NO_MEMORY;
+
+    *table = (pte_t *)(uintptr_t)pa;
+    for (i = 0; i < VM_PTES_PER_TABLE; i++)
+        (*table)[i] = 0;
+
+    g_vm_stats.tables++;
+    return 0;
+}
+
+/**
+ * Zwalnia tablicę razem z tablicami niższych poziomów i odejmuje ich liście
+ * ze statystyk. Tylko dla tablic, które nie są aktywne w satp.
+ * @param table Tablica poziomu level
+ * @param level Poziom tablicy
+ */
+static void vm_table_free(pte_t *table, int level)
+{
+    uint32_t i;
+
+    for (i = 0; i < VM_PTES_PER_TABLE; i++) {
+        pte_t pte = table[i];
+
+        if (!(pte & PTE_V))
+            continue;
+        if (pte & PTE_N) {
+            if (!(i & (VM_NAPOT_PTES - 1)))
+                g_vm_stats.napot--;
+        } else if (vm_pte_is_leaf(pte)) {
+            g_vm_stats.leaves[level]--;
+        } else if (level > 0) {
+            vm_table_free(vm_pte_table(pte), level - 1);
+        }
+    }
+
+    page_free((uint64_t)(uintptr_t)table);
+    g_vm_stats.tables--;
+}
+
+/**
+ * Schodzi po tablicach do liścia albo dziury dla va.
+ * @param root Tablica najwyższego poziomu
+ * @param va Adres wirtualny
+ * @param level Poziom zwróconego wpisu (wyjście)
+ * @param levels Liczba poziomów trybu (stała w wersjach specjalizowanych)
+ * @return Wpis: liść, niepoprawny wpis albo wpis poziomu 0
+ */
+static inline __attribute__((always_inline))
+pte_t *vm_walk_levels(const pte_t *root, uint64_t va, int *level, const int levels)
+{
+    const pte_t *table = root;
+    const pte_t *pte;
+    int l;
+
+    for (l = levels - 1; ; l--) {
+        pte = &table[vm_index(va, l)];
+        if (l == 0 || !(*pte & PTE_V) || vm_pte_is_leaf(*pte))
+            break;
+        table = vm_pte_table(*pte);
+    }
+
+    *level = l;
+    return (pte_t *)pte;
+}
+
+/**
+ * Wpisuje jeden liść dla va. Brakujące tablice pośrednie są tworzone; jeśli na
+ * poziomie docelowym jest już tablica (drobniejsze mapowanie), liść schodzi niżej.
+ * @param root Tablica najwyższego poziomu
+ * @param va Adres wirtualny
+ * @param pa Adres fizyczny
+ * @param level Poziom liścia (wejście), faktycznie użyty poziom (wyjście)
+ * @param flags Flagi PTE liścia (bez V)
+ * @param levels Liczba poziomów trybu (stała w wersjach specjalizowanych)
+ * @return 0 jeśli sukces, VM_ERR_EXISTS gdy adres jest już zmapowany
+ */
+static inline __attribute__((always_inline))
+int vm_map_one_levels(pte_t *root, uint64_t va, uint64_t pa, int *level, uint64_t flags,
+                      const int levels)
+{
+    pte_t *table = root;
+    pte_t *pte;
+    int l;
+    int err;
+
+    for (l = levels - 1; ; l--) {
+        pte = &table[vm_index(va, l)];
+
+        if (l == *level) {
+            if (!(*pte & PTE_V)) {
+                *pte = vm_pte_make(pa, flags | PTE_V);
+                g_vm_stats.leaves[l]++;
+                return 0;
+            }
+            if (vm_pte_is_leaf(*pte) || l == 0)
+                return VM_ERR_EXISTS;
+            (*level)--;
+        } else if (!(*pte & PTE_V)) {
+            pte_t *next;
+
+            err = vm_table_alloc(&next);
+            if (err)
+                return err;
+            *pte = vm_pte_make((uint64_t)(uintptr_t)next, PTE_V);
+        } else if (vm_pte_is_leaf(*pte)) {
+            return VM_ERR_EXISTS;
+        }
+
+        table = vm_pte_table(*pte);
+    }
+}
+
+#define VM_MODE_WALKERS(name, levels)                                               \
+    static pte_t *vm_walk_##name(const pte_t *root, uint64_t va, int *level)        \
+    {                                                                               \
+        return vm_walk_levels(root, va, level, levels);                             \
+    }                                                                               \
+    static int vm_map_one_##name(pte_t *root, uint64_t va, uint64_t pa, int *level, \
+                                 uint64_t flags)                                    \
+    {                                                                               \
+        return vm_map_one_levels(root, va, pa, level, flags, levels);               \
+    }
+
+VM_MODE_WALKERS(sv39, VM_LEVELS_SV39)
+VM_MODE_WALKERS(sv48, VM_LEVELS_SV48)
+VM_MODE_WALKERS(sv57, VM_LEVELS_SV57)
+
+/* Od najszerszego trybu; sonda w vm_init schodzi w dół tej listy */
+static const vm_mode_t g_vm_modes[] = {
+    { "sv57", "riscv,sv57", SATP_MODE_SV57, VM_LEVELS_SV57, VM_VA_LIMIT(VM_LEVELS_SV57),
+      vm_walk_sv57, vm_map_one_sv57 },
+    { "sv48", "riscv,sv48", SATP_MODE_SV48, VM_LEVELS_SV48, VM_VA_LIMIT(VM_LEVELS_SV48),
+      vm_walk_sv48, vm_map_one_sv48 },
+    { "sv39", "riscv,sv39", SATP_MODE_SV39, VM_LEVELS_SV39, VM_VA_LIMIT(VM_LEVELS_SV39),
+      vm_walk_sv39, vm_map_one_sv39 },
+};
+
+#define VM_MODE_COUNT   ((int)(sizeof(g_vm_modes) / sizeof(g_vm_modes[0])))
+#define VM_MODE_DEFAULT (VM_MODE_COUNT - 1)
+
+/* Tryb, w którym interpretowane są wszystkie tablice; do vm_init() Sv39 */
+static const vm_mode_t *g_vm_mode = &g_vm_modes[VM_MODE_DEFAULT];
+
+/**
+ * Unieważnia TLB dla zakresu po usunięciu mapowań, jeśli stronicowanie jest już włączone,
+ * na wszystkich hartach, które mają stronicowanie. Mapowania jądra są globalne,
+ * więc unieważnienie obejmuje wszystkie ASID.
+ * @return 0 jeśli sukces, VM_ERR_SHOOTDOWN gdy RFENCE się nie powiodło
+ */
+static int vm_flush(uint64_t va, uint64_t size)
+{
+    if (g_vm_enabled && shootdown_range(va, size, TLB_ASID_ALL))
+        return VM_ERR_SHOOTDOWN;
+    return 0;
+}
+
+/**
+ * Wybiera największy liść, który mieści się w zakresie i na który pozwala
+ * wyrównanie va i pa.
+ * @param max_level Najwyższy poziom, na którym wolno położyć liść
+ * @return Poziom liścia (0 = 4KB, 1 = 2MB, 2 = 1GB, ...)
+ */
+static int vm_leaf_level(uint64_t va, uint64_t pa, uint64_t size, int max_level)
+{
+    int level;
+
+    for (level = max_level; level > 0; level--) {
+        uint64_t block = vm_level_size(level);
+
+        if (!((va | pa) & (block - 1ULL)) && size >= block)
+            break;
+    }
+
+    return level;
+}
+
+/**
+ * Zamienia duży liść na tablicę następnego poziomu z 512 liśćmi o tych samych
+ * uprawnieniach, żeby można było zmienić tylko część jego zakresu. Tłumaczenia
+ * się nie zmieniają, więc nie ma tu unieważnienia TLB: stary wpis dużego liścia
+ * zniknie przy unieważnieniu usuwanej części (dowolny adres w liściu go trafia).
+ * @param pte Wpis z liściem poziomu level (level > 0)
+ * @param level Poziom liścia
+ * @return 0 jeśli sukces, VM_ERR_NO_MEMORY w przeciwnym razie
+ */
+static int vm_split(pte_t *pte, int level)
+{
+    uint64_t flags = *pte & VM_PTE_LEAF_ATTR;
+    uint64_t pa = vm_pte_pa(*pte);
+    uint64_t step = vm_level_size(level - 1);
+    pte_t *table;
+    uint32_t i;
+    int err;
+
+    err = vm_table_alloc(&table);
+    if (err)
+        return err;
+
+    for (i = 0; i < VM_PTES_PER_TABLE; i++)
+        table[i] = vm_pte_make(pa + (uint64_t)i * step, flags);
+
+    *pte = vm_pte_make((uint64_t)(uintptr_t)table, PTE_V);
+    g_vm_stats.leaves[level]--;
+    g_vm_stats.leaves[level - 1] += VM_PTES_PER_TABLE;
+    return 0;
+}
+
+/**
+ * Zwraca pierwszy z 16 wpisów bloku NAPOT, do którego należy pte (pte opisuje va).
+ */
+static pte_t *vm_napot_group(pte_t *pte, uint64_t va)
+{
+    return pte - (vm_index(va, 0) & (VM_NAPOT_PTES - 1));
+}
+
+/**
+ * Zamienia 16 zwykłych liści 4KB (już wpisanych, ciągłych, o tych samych flagach)
+ * na blok NAPOT 64KB: każdy wpis ma N = 1, a PPN[3:0] = 1000b koduje rozmiar bloku.
+ * @param group Pierwszy wpis bloku
+ * @param pa Adres fizyczny bloku (wyrównany do 64KB)
+ * @param flags Flagi liścia (bez V)
+ */
+static void vm_napot_make(pte_t *group, uint64_t pa, uint64_t flags)
+{
+    pte_t pte = vm_pte_make(pa | (VM_NAPOT_SIZE >> 1), flags | PTE_N | PTE_V);
+    uint32_t i;
+
+    for (i = 0; i < VM_NAPOT_PTES; i++)
+        group[i] = pte;
+
+    g_vm_stats.leaves[0] -= VM_NAPOT_PTES;
+    g_vm_stats.napot++;
+}
+
+/**
+ * Rozbija blok NAPOT na 16 zwykłych liści 4KB z tymi samymi uprawnieniami
+ * (bez unieważnienia TLB, jak vm_split).
+ * @param group Pierwszy wpis bloku
+ */
+static void vm_napot_split(pte_t *group)
+{
+    uint64_t flags = group[0] & VM_PTE_LEAF_ATTR;
+    uint64_t pa = vm_pte_pa(group[0]) & ~(VM_NAPOT_SIZE - 1ULL);
+    uint32_t i;
+
+    for (i = 0; i < VM_NAPOT_PTES; i++)
+        group[i] = vm_pte_make(pa + (uint64_t)i * VM_PAGE_SIZE, flags);
+
+    g_vm_stats.napot--;
+    g_vm_stats.leaves[0] += VM_NAPOT_PTES;
+}
+
+/**
+ * Mapuje ciągły zakres, używając największych liści, na jakie pozwala wyrównanie.
+ * Przy błędzie część zakresu może zostać zmapowana.
+ * @param root Tablica najwyższego poziomu (w bieżącym trybie)
+ * @param va Adres wirtualny (wyrównany do strony)
+ * @param pa Adres fizyczny (wyrównany do strony)
+ * @param size Rozmiar (wielokrotność strony)
+ * @param flags PTE_R/W/X, opcjonalnie PTE_G/PTE_U i typ pamięci VM_MAP_IO/VM_MAP_WC
+ *              (bez Svpbmt pomijany - zostaje PMA); A i D są ustawiane zawsze
+ * @return 0 jeśli sukces, VM_ERR_* w przeciwnym razie
+ */
+int vm_map_range(pte_t *root, uint64_t va, uint64_t pa, uint64_t size, uint64_t flags)
+{
+    const vm_mode_t *mode = g_vm_mode;
+    int level;
+    int err;
+
+    if (!root || !size || ((va | pa | size) & (VM_PAGE_SIZE - 1ULL)))
+        return VM_ERR_BADVALUE;
+    if (va >= mode->va_limit || size > mode->va_limit - va)
+        return VM_ERR_BADVALUE;
+    /* W bez R jest zarezerwowane w specyfikacji */
+    if (!(flags & VM_PTE_PERM) || ((flags & PTE_W) && !(flags & PTE_R)))
+        return VM_ERR_BADVALUE;
+    if ((flags & PTE_PBMT_MASK) == PTE_PBMT_MASK)
+        return VM_ERR_BADVALUE;
+
+    flags = (flags & (VM_PTE_PERM | PTE_U | PTE_G | (g_vm_pbmt ? PTE_PBMT_MASK : 0))) | PTE_A | PTE_D;
+
+    while (size) {
+        level = vm_leaf_level(va, pa, size, mode->levels - 1);
+
+        /*
+         * Z Svnapot 64KB wyrównane do 64KB mapuje się jako 16 liści 4KB (to samo
+         * sprawdzanie kolizji co dla zwykłych stron), które potem stają się blokiem NAPOT.
+         */
+        if (!level && g_vm_napot && size >= VM_NAPOT_SIZE && !((va | pa) & (VM_NAPOT_SIZE - 1ULL))) {
+            uint32_t i;
+            int l;
+
+            for (i = 0; i < VM_NAPOT_PTES; i++) {
+                level = 0;
+                err = mode->map_one(root, va + i * VM_PAGE_SIZE, pa + i * VM_PAGE_SIZE, &level, flags);
+                if (err)
+                    return err;
+            }
+            vm_napot_make(mode->walk(root, va, &l), pa, flags);
+
+            va += VM_NAPOT_SIZE;
+            pa += VM_NAPOT_SIZE;
+            size -= VM_NAPOT_SIZE;
+            continue;
+        }
+
+        err = mode->map_one(root, va, pa, &level, flags);
+        if (err)
+            return err;
+
+        va += vm_level_size(level);
+        pa += vm_level_size(level);
+        size -= vm_level_size(level);
+    }
+
+    return 0;
+}
+
+/**
+ * Usuwa mapowania z zakresu. Dziury są pomijane; duży liść wystający poza
+ * zakres jest najpierw dzielony. Puste tablice pośrednie nie są zwalniane.
+ * @param root Tablica najwyższego poziomu (w bieżącym trybie)
+ * @param va Adres wirtualny (wyrównany do strony)
+ * @param size Rozmiar (wielokrotność strony)
+ * @return 0 jeśli sukces, VM_ERR_* w przeciwnym razie
+ */
+int vm_unmap_range(pte_t *root, uint64_t va, uint64_t size)
+{
+    const vm_mode_t *mode = g_vm_mode;
+    uint64_t start = va;
+    int err = 0;
+
+    if (!root || !size || ((va | size) & (VM_PAGE_SIZE - 1ULL)))
+        return VM_ERR_BADVALUE;
+    if (va >= mode->va_limit || size > mode->va_limit - va)
+        return VM_ERR_BADVALUE;
+
+    while (size) {
+        uint64_t block;
+        pte_t *pte;
+        int l;
+
+        pte = mode->walk(root, va, &l);
+
+        /* Dziura albo liść: krok do końca bloku tego poziomu */
+        block = vm_level_size(l) - (va & (vm_level_size(l) - 1ULL));
+        if (block > size)
+            block = size;
+
+        if (*pte & PTE_N) {
+            pte_t *group = vm_napot_group(pte, va);
+            uint32_t i;
+
+            /* Blok NAPOT usuwa się w całości albo najpierw rozbija */
+            if ((va & (VM_NAPOT_SIZE - 1ULL)) || size < VM_NAPOT_SIZE) {
+                vm_napot_split(group);
+                continue;
+            }
+            for (i = 0; i < VM_NAPOT_PTES; i++)
+                group[i] = 0;
+            g_vm_stats.napot--;
+            block = VM_NAPOT_SIZE;
+        } else if (*pte & PTE_V) {
+            if (block < vm_level_size(l)) {
+                err = vm_split(pte, l);
+                if (err)
+                    break;
+                continue;
+            }
+            *pte = 0;
+            g_vm_stats.leaves[l]--;
+        }
+
+        va += block;
+        size -= block;
+    }
+
+    /* Jedno unieważnienie na całe wywołanie (także po błędzie - część wpisów już zniknęła) */
+    if (vm_flush(start, va - start) && !err)
+        err = VM_ERR_SHOOTDOWN;
+    return err;
+}
+
+/**
+ * Tłumaczy adres wirtualny przez tablice (programowy page walk).
+ * @param root Tablica najwyższego poziomu (w bieżącym trybie)
+ * @param va Adres wirtualny
+ * @param pa Adres fizyczny (wyjście)
+ * @param flags Flagi liścia (wyjście, opcjonalne)
+ * @return 0 jeśli sukces, VM_ERR_NOT_MAPPED gdy adres nie jest zmapowany
+ */
+int vm_translate(const pte_t *root, uint64_t va, uint64_t *pa, uint64_t *flags)
+{
+    const vm_mode_t *mode = g_vm_mode;
+    const pte_t *pte;
+    int l;
+
+    if (!root || !pa || va >= mode->va_limit)
+        return VM_ERR_BADVALUE;
+
+    pte = mode->walk(root, va, &l);
+    if (!(*pte & PTE_V) || !vm_pte_is_leaf(*pte))
+        return VM_ERR_NOT_MAPPED;
+
+    if (*pte & PTE_N)
+        *pa = (vm_pte_pa(*pte) & ~(VM_NAPOT_SIZE - 1ULL)) + (va & (VM_NAPOT_SIZE - 1ULL));
+    else
+        *pa = vm_pte_pa(*pte) + (va & (vm_level_size(l) - 1ULL));
+    if (flags)
+        *flags = *pte & VM_PTE_LEAF_ATTR;
+    return 0;
+}
+
+/**
+ * Mapuje 1:1 zakres RAM z pominięciem obrazu jądra (mapowanego osobno z
+ * uprawnieniami sekcji). Granice są przycinane do pełnych stron, a koniec
+ * do granicy przestrzeni wirtualnej bieżącego trybu.
+ */
+static int vm_map_ram(pte_t *root, uint64_t start, uint64_t end)
+{
+    uint64_t kernel_start = (uint64_t)(uintptr_t)_kernel_start;
+    uint64_t kernel_end = (uint64_t)(uintptr_t)_kernel_image_end;
+    int err;
+
+    start = (start + VM_PAGE_SIZE - 1ULL) & ~(VM_PAGE_SIZE - 1ULL);
+    end &= ~(VM_PAGE_SIZE - 1ULL);
+    if (end > g_vm_mode->va_limit)
+        end = g_vm_mode->va_limit;
+    kernel_end = (kernel_end + VM_PAGE_SIZE - 1ULL) & ~(VM_PAGE_SIZE - 1ULL);
+
+    if (start < kernel_start && kernel_start < end) {
+        err = vm_map_range(root, start, start, kernel_start - start, MM_RW | PTE_G);
+        if (err)
+            return err;
+        start = kernel_start;
+    }
+    if (start < kernel_end)
+        start = (kernel_end < end) ? kernel_end : end;
+    if (start >= end)
+        return 0;
+
+    return vm_map_range(root, start, start, end - start, MM_RW | PTE_G);
+}
+
+/**
+ * Buduje tablice jądra w bieżącym trybie (g_vm_mode), bez włączania stronicowania.
+ * RAM i MMIO powyżej granicy przestrzeni wirtualnej trybu są pomijane.
+ * RAM dostaje PMA, MMIO typ IO, a okna MM_FLAG_WC typ NC (przy Svpbmt).
+ * @param out Tablica najwyższego poziomu (wyjście)
+ * @return 0 jeśli sukces, VM_ERR_* w przeciwnym razie
+ */
+static int vm_build_kernel(pte_t **out)
+{
+    const mm_state_t *mm = mm_state();
+    uint64_t text = (uint64_t)(uintptr_t)_text_start;
+    uint64_t rodata = (uint64_t)(uintptr_t)_rodata_start;
+    uint64_t data = (uint64_t)(uintptr_t)_data_start;
+    uint64_t image_end = ((uint64_t)(uintptr_t)_kernel_image_end + VM_PAGE_SIZE - 1ULL) & ~(VM_PAGE_SIZE - 1ULL);
+    uint64_t mmio_end = 0;
+    pte_t *root;
+    int err;
+    int i;
+
+    err = vm_table_alloc(&root);
+    if (err)
+        return err;
+
+    err = vm_map_range(root, text, text, rodata - text, MM_RX | PTE_G);
+    if (!err)
+        err = vm_map_range(root, rodata, rodata, data - rodata, MM_R | PTE_G);
+    if (!err)
+        err = vm_map_range(root, data, data, image_end - data, MM_RW | PTE_G);
+
+    for (i = 0; !err && i < mm->ram_count; i++)
+        err = vm_map_ram(root, mm->ram[i].start, mm->ram[i].end);
+
+    /* Regiony są posortowane; po zaokrągleniu do stron sąsiednie okna mogą dzielić stronę */
+    for (i = 0; !err && i < mm->reserved_count; i++) {
+        const mm_region_t *r = &mm->reserved[i];
+        uint64_t start = r->start & ~(VM_PAGE_SIZE - 1ULL);
+        uint64_t end = (r->end + VM_PAGE_SIZE - 1ULL) & ~(VM_PAGE_SIZE - 1ULL);
+
+        if (!(r->protect_flags & MM_FLAG_MMIO))
+            continue;
+        if (end > g_vm_mode->va_limit)
+            end = g_vm_mode->va_limit;
+        if (start < mmio_end)
+            start = mmio_end;
+        if (start >= end)
+            continue;
+
+        err = vm_map_range(root, start, start, end - start,
+                           MM_RW | PTE_G | ((r->protect_flags & MM_FLAG_WC) ? VM_MAP_WC : VM_MAP_IO));
+        mmio_end = end;
+    }
+
+    if (err) {
+        vm_table_free(root, g_vm_mode->levels - 1);
+        return err;
+    }
+
+    *out = root;
+    return 0;
+}
+
+/**
+ * Wybiera tryb, od którego zaczyna się sonda, na podstawie mmu-type harta startowego.
+ * Brak węzła CPU, brak właściwości albo nieznana wartość → najszerszy tryb.
+ * @param cpu Węzeł CPU harta startowego albo 0
+ * @return Indeks w g_vm_modes albo -1 dla "riscv,none"
+ */
+static int vm_mode_from_dtb(const dtb_cpu_t *cpu)
+{
+    int i;
+
+    if (!cpu || !cpu->mmu_type)
+        return 0;
+    if (strcmp(cpu->mmu_type, VM_DTB_MMU_NONE) == 0)
+        return -1;
+
+    for (i = 0; i < VM_MODE_COUNT; i++) {
+        if (strcmp(cpu->mmu_type, g_vm_modes[i].dtb_name) == 0)
+            return i;
+    }
+
+    return 0;
+}
+
+/**
+ * Składa wartość satp dla bieżącego trybu.
+ * @param root Tablica najwyższego poziomu
+ * @param asid ASID (obcinany do pola satp)
+ * @return Wartość do zapisu w satp
+ */
+uint64_t vm_satp(const pte_t *root, uint32_t asid)
+{
+    return (g_vm_mode->satp_mode << SATP_MODE_SHIFT) |
+           (((uint64_t)asid & SATP_ASID_MASK) << SATP_ASID_SHIFT) |
+           (((uint64_t)(uintptr_t)root / VM_PAGE_SIZE) & SATP_PPN_MASK);
+}
+
+/**
+ * Buduje tablice jądra i włącza stronicowanie (mapowanie 1:1):
+ * - obraz jądra z uprawnieniami sekcji: .text RX, .rodata R, .data/.bss/stos RW,
+ * - cały RAM z mapy pamięci RW, największymi liśćmi, na jakie pozwala wyrównanie,
+ * - regiony MMIO z mapy pamięci RW bez X, z typem pamięci IO (framebuffery NC).
+ * Tryb to mmu-type z DTB potwierdzony sondą satp: zapis nieobsługiwanego trybu
+ * nie zmienia satp, więc po nieudanej próbie tablice są zwalniane i budowane
+ * od nowa w następnym, węższym trybie. Przy Svnapot w riscv,isa wyrównane
+ * fragmenty 64KB dostają bloki NAPOT; bez Svpbmt typ pamięci zostaje z PMA.
+ * Tablice pochodzą z page_alloc, więc wymaga page_cache_init.
+ * @param hw Stan sprzętu (boot_cpu_node do odczytu mmu-type i riscv,isa)
+ * @return 0 jeśli sukces, VM_ERR_UNSUPPORTED gdy żaden tryb nie działa, inny VM_ERR_* przy błędzie
+ */
+int vm_init(const hw_state_t *hw)
+{
+    const mm_state_t *mm = mm_state();
+    const dtb_cpu_t *boot_cpu = 0;
+    dtb_cpu_t cpu;
+    pte_t *root;
+    int err;
+    int i;
+
+    if (!mm->ram)
+        return VM_ERR_NOT_READY;
+
+    if (hw && hw->boot_cpu_node >= 0 && !dtb_cpu_read(hw->boot_cpu_node, &cpu))
+        boot_cpu = &cpu;
+
+    i = vm_mode_from_dtb(boot_cpu);
+    if (i < 0)
+        return VM_ERR_UNSUPPORTED;
+    g_vm_napot = dtb_cpu_has_ext(boot_cpu, VM_ISA_SVNAPOT);
+    g_vm_pbmt = dtb_cpu_has_ext(boot_cpu, VM_ISA_SVPBMT);
+
+    for (; i < VM_MODE_COUNT; i++) {
+        const vm_mode_t *mode = &g_vm_modes[i];
+
+        g_vm_mode = mode;
+        err = vm_build_kernel(&root);
+        if (err)
+            return err;
+
+        /* Zapisy budujące tablice muszą być widoczne dla page-table walkera przed
+         * przełączeniem satp (jak local_flush_tlb_all przed csr_write(satp) w Linuksie) */
+        sfence_vma_all();
+        csr_write_satp(vm_satp(root, 0));
+        if ((csr_read_satp() >> SATP_MODE_SHIFT) == mode->satp_mode) {
+            sfence_vma_all();
+            shootdown_hart_online();
+            g_vm_kernel_root = root;
+            g_vm_enabled = 1;
+            return 0;
+        }
+
+        vm_table_free(root, mode->levels - 1);
+    }
+
+    g_vm_mode = &g_vm_modes[VM_MODE_DEFAULT];
+    g_vm_napot = 0;
+    g_vm_pbmt = 0;
+    return VM_ERR_UNSUPPORTED;
+}
+
+/**
+ * Zwraca tablicę najwyższego poziomu jądra albo 0 przed vm_init().
+ */
+pte_t *vm_kernel_root(void)
+{
+    return g_vm_kernel_root;
+}
+
+/**
+ * Zwraca 1, jeśli stronicowanie jest włączone.
+ */
+int vm_enabled(void)
+{
+    return g_vm_enabled;
+}
+
+/**
+ * Zwraca nazwę aktywnego trybu ("sv39", "sv48", "sv57") albo "bare".
+ */
+const char *vm_mode_name(void)
+{
+    return g_vm_enabled ? g_vm_mode->name : "bare";
+}
+
+/**
+ * Zwraca liczbę poziomów tablic bieżącego trybu (przed vm_init() Sv39).
+ */
+int vm_levels(void)
+{
+    return g_vm_mode->levels;
+}
+
+/**
+ * Zwraca statystyki liści i tablic.
+ */
+const vm_stats_t *vm_stats(void)
+{
+    return &g_vm_stats;
+}
+
+/**
+ * Wyświetla tryb stronicowania, obecność Svpbmt i liczbę liści każdego rozmiaru
+ * (64K tylko z Svnapot).
+ */
+void vm_dump(void)
+{
+    static const char *const leaf_names[VM_LEVELS_MAX] = { " 4K=", " 2M=", " 1G=", " 512G=", " 256T=" };
+    int l;
+
+    if (!uart_console_is_ready())
+        return;
+
+    uart_console_puts("[vm] mode=");
+    uart_console_puts(vm_mode_name());
+    uart_console_puts(g_vm_pbmt ? " pbmt=on" : " pbmt=off");
+    uart_console_puts(" leaves");
+    for (l = g_vm_mode->levels - 1; l >= 0; l--) {
+        uart_console_puts(leaf_names[l]);
+        uart_console_put_dec_u64(g_vm_stats.leaves[l]);
+        if (l == 0 && g_vm_napot) {
+            uart_console_puts(" 64K=");
+            uart_console_put_dec_u64(g_vm_stats.napot);
+        }
+    }
+    uart_console_puts(" tables=");
+    uart_console_put_dec_u64(g_vm_stats.tables);
+    uart_console_puts("\n");
+}
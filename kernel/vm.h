@@ -0,0 +1,63 @@
+#ifndef KERNEL_VM_H
+#define KERNEL_VM_H
+
+#include <stdint.h>
+#include <memory_map.h>
+#include <platform_init.h>
+
+/* Rozmiary liści: strona 4KB, megastrona 2MB, gigastrona 1GB (Sv48/Sv57 dodają 512GB i 256TB) */
+#define VM_PAGE_SIZE     0x1000ULL
+#define VM_MEGAPAGE_SIZE 0x200000ULL
+#define VM_GIGAPAGE_SIZE 0x40000000ULL
+
+/* Blok NAPOT (Svnapot): 16 sąsiednich wpisów poziomu 0 opisujących 64KB */
+#define VM_NAPOT_SIZE  0x10000ULL
+#define VM_NAPOT_PTES  16
+
+/* Poziomy tablic: Sv39 = 3, Sv48 = 4, Sv57 = 5; liczba wpisów w jednej tablicy */
+#define VM_LEVELS_SV39 3
+#define VM_LEVELS_SV48 4
+#define VM_LEVELS_SV57 5
+#define VM_LEVELS_MAX  VM_LEVELS_SV57
+#define VM_PTES_PER_TABLE 512
+
+/* Typ pamięci dla vm_map_range (Svpbmt); brak flagi = PMA platformy */
+#define VM_MAP_IO PTE_PBMT_IO
+#define VM_MAP_WC PTE_PBMT_NC
+
+enum {
+    VM_ERR_BADVALUE = -12000,
+    VM_ERR_NOT_READY,
+    VM_ERR_NO_MEMORY,
+    VM_ERR_EXISTS,
+    VM_ERR_NOT_MAPPED,
+    VM_ERR_UNSUPPORTED,
+    VM_ERR_SHOOTDOWN,
+};
+
+typedef uint64_t pte_t;
+
+/**
+ * Statystyki tablic jądra: liczba liści per poziom (0 = 4KB, 1 = 2MB, 2 = 1GB,
+ * 3 = 512GB, 4 = 256TB), liczba bloków NAPOT 64KB (ich wpisy nie wchodzą
+ * do leaves[0]) i liczba stron zajętych przez tablice.
+ */
+typedef struct {
+    uint64_t leaves[VM_LEVELS_MAX];
+    uint64_t napot;
+    uint64_t tables;
+} vm_stats_t;
+
+int vm_map_range(pte_t *root, uint64_t va, uint64_t pa, uint64_t size, uint64_t flags);
+int vm_unmap_range(pte_t *root, uint64_t va, uint64_t size);
+int vm_translate(const pte_t *root, uint64_t va, uint64_t *pa, uint64_t *flags);
+int vm_init(const hw_state_t *hw);
+pte_t *vm_kernel_root(void);
+uint64_t vm_satp(const pte_t *root, uint32_t asid);
+int vm_enabled(void);
+const char *vm_mode_name(void);
+int vm_levels(void);
+const vm_stats_t *vm_stats(void);
+void vm_dump(void);
+
+#endif
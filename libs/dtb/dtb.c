@@ -47,6 +47,831 @@ static int read_cells_u64(const fdt32_t *cells, int count, uint64_t *out)
     *out = val;
     return 0;
 }
+
+/*
+Flagi węzła w indeksie DTB (dtb_node_t.flags), wyliczane raz w dtb_index_build.
+Dzięki nim helpery takie jak node_is_enabled, node_is_cpu czy node_is_intc odpowiadają
+z pamięci zamiast wywoływać fdt_getprop i strcmp przy każdym zapytaniu.
+*/
+#define DTB_NODE_ENABLED  0x01  /* brak status albo status != "disabled" */
+#define DTB_NODE_CPU      0x02  /* device_type = "cpu" */
+#define DTB_NODE_MEMORY   0x04  /* device_type = "memory" */
+#define DTB_NODE_INTC     0x08  /* węzeł ma właściwość interrupt-controller */
+#define DTB_NODE_RANGES   0x10  /* węzeł ma właściwość ranges */
+#define DTB_NODE_IPARENT  0x20  /* interrupt_parent rozwiązany (własny lub odziedziczony) */
+#define DTB_NODE_ICELLS   0x40  /* interrupt_cells odczytane z #interrupt-cells */
+
+/*
+dtb_node_t to jeden węzeł „rozpłaszczonego” drzewa budowanego w dtb_index_init.
+Węzły leżą w tablicy g_dtb_nodes w kolejności przejścia w głąb (tej samej co fdt_next_node),
+więc offsety są rosnące i offset → węzeł rozwiązuje wyszukiwanie binarne (index_node).
+parent/first_child/next_sibling to indeksy w tej samej tablicy (-1 gdy brak).
+addr_cells/size_cells to #address-cells/#size-cells samego węzła (dla jego dzieci), dokładnie
+tak jak zwróciłyby je fdt_address_cells/fdt_size_cells, łącznie z ujemnym kodem błędu.
+compat_first/compat_count wskazują rozbitą listę compatible w g_dtb_compat.
+phandle i interrupt_cells to własne phandle węzła i jego #interrupt-cells (gdy DTB_NODE_ICELLS),
+potrzebne przy rozwiązywaniu interrupt-parent bez ponownego czytania bloba.
+*/
+typedef struct {
+    int offset;
+    int parent;
+    int first_child;
+    int next_sibling;
+    const char *name;
+    int16_t addr_cells;
+    int16_t size_cells;
+    uint32_t compat_first;
+    uint16_t compat_count;
+    uint16_t flags;
+    uint32_t phandle;
+    uint32_t interrupt_cells;
+    uint32_t interrupt_parent;
+} dtb_node_t;
+
+/*
+Stan indeksu: liczba węzłów i wpisów compatible oraz indeksy najczęściej
+odpytywanych węzłów z poziomu korzenia (/cpus, /reserved-memory, /chosen),
+żeby nie szukać ich po ścieżce przy każdym wywołaniu.
+*_cap i *_slots to pojemności tablic przydzielonych z areny przez dtb_index_init,
+policzone pierwszym przejściem po blobie (dtb_index_count).
+ready == 0 oznacza, że indeks nie istnieje (brak dtb_index_init albo za mała arena)
+i wszystkie helpery wracają do bezpośredniego czytania bloba przez libfdt.
+*/
+typedef struct {
+    int ready;
+    int node_count;
+    int compat_count;
+    int compat_ids;
+    int cpus;
+    int reserved_memory;
+    int chosen;
+    int node_cap;
+    int compat_cap;
+    int window_cap;
+    uint32_t phandle_slots;
+    uint32_t compat_slots;
+} dtb_index_t;
+
+/*
+Tablica haszująca phandle → indeks węzła z adresowaniem otwartym i próbkowaniem liniowym.
+Ma ponad dwa razy więcej slotów niż węzłów (phandle_slots), więc zapełnienie nie przekracza 1/2
+i średnia długość próbkowania jest stała. phandle 0 i 0xffffffff są w DTB nieprawidłowe, więc
+phandle == 0 oznacza pusty slot.
+*/
+
+typedef struct {
+    uint32_t phandle;
+    int node;
+} dtb_phandle_slot_t;
+
+/*
+Interning ciągów compatible: każdy różny ciąg dostaje małe id (0..compat_ids-1).
+g_dtb_compat_ids[i] to id wpisu g_dtb_compat[i], a g_dtb_compat_strs[id] opisuje ciąg:
+jego hash FNV-1a oraz fragment g_dtb_compat_nodes (first/count) z indeksami wszystkich węzłów,
+które go deklarują, w kolejności drzewa (czyli rosnąco). g_dtb_compat_slots to tablica
+haszująca ciąg → id+1 (0 = pusty slot) z próbkowaniem liniowym, znów o dwukrotnym zapasie
+(compat_slots).
+*/
+
+typedef struct {
+    const char *str;
+    uint32_t hash;
+    int first;
+    int count;
+} dtb_compat_str_t;
+
+/*
+Tablica pomocnicza do dekodowania reg/ranges, równoległa do g_dtb_nodes (ten sam indeks).
+Dla każdego węzła trzyma offset rodzica (albo kod błędu dla korzenia), #address-cells/#size-cells
+rodzica – czyli dokładnie to, czym interpretuje się reg węzła – oraz wskaźniki i długości
+właściwości reg i ranges w blobie (ptr == 0 i len == kod błędu, tak jak z fdt_getprop).
+Wypełniana w dtb_index_build, więc decode_reg_* i dtb_translate_ranges nie wywołują już
+fdt_parent_offset (w libfdt przejście od korzenia) ani fdt_getprop przy każdym wpisie.
+Dla magistral z niepustym ranges win_first/win_count wskazują okna translacji w g_dtb_windows,
+a win_err to wynik walidacji komórek (0 albo kod błędu), który dtb_translate_ranges zwróciłby od razu.
+*/
+typedef struct {
+    int parent;
+    int parent_addr_cells;
+    int parent_size_cells;
+    const fdt32_t *reg;
+    int reg_len;
+    const fdt32_t *ranges;
+    int ranges_len;
+    int win_err;
+    int win_first;
+    int win_count;
+} dtb_reg_ctx_t;
+
+/*
+Jedno okno translacji z ranges magistrali: adresy [child_base, child_base + size) w przestrzeni dzieci
+odpowiadają [parent_base, ...) w przestrzeni rodzica. Okna każdej magistrali leżą w g_dtb_windows
+obok siebie, posortowane po child_base, więc adres znajduje wyszukiwanie binarne.
+*/
+typedef struct {
+    uint64_t child_base;
+    uint64_t parent_base;
+    uint64_t size;
+} dtb_window_t;
+
+/*
+Tablice indeksu leżą w arenie wołającego (w jądrze memblock), a nie w .bss: ich rozmiar
+wynika z bloba, więc mała płytka nie płaci za limity dobrane pod duże SoC.
+*/
+static dtb_node_t *g_dtb_nodes;
+static dtb_reg_ctx_t *g_dtb_reg_ctx;
+static dtb_window_t *g_dtb_windows;
+static const char **g_dtb_compat;
+static uint32_t *g_dtb_compat_ids;
+static dtb_compat_str_t *g_dtb_compat_strs;
+static int *g_dtb_compat_nodes;
+static uint32_t *g_dtb_compat_slots;
+static dtb_phandle_slot_t *g_dtb_phandles;
+static dtb_index_t g_dtb_index;
+static int g_dtb_cursor;
+
+/*
+Zwraca wskaźnik do węzła indeksu o podanym offsecie w blobie albo 0, gdy indeks nie jest
+zbudowany lub offset nie jest początkiem żadnego węzła.
+Węzły są posortowane po offsecie, więc wyszukiwanie jest binarne – O(log n).
+g_dtb_cursor pamięta ostatnio znaleziony węzeł: kolejne zapytania o ten sam węzeł albo o jego
+następnika (typowa iteracja node_next + node_is_*) kosztują O(1). Kursor jest tylko podpowiedzią –
+przed użyciem zawsze sprawdzamy offset, więc nieaktualna wartość nie psuje wyniku.
+Wywołujący traktują 0 jako sygnał, żeby wykonać starą ścieżkę przez libfdt; dzięki temu
+błędne offsety dalej dają te same kody błędów co wcześniej.
+*/
+static const dtb_node_t *index_node(int node)
+{
+    int lo = 0;
+    int hi = g_dtb_index.node_count - 1;
+    int cur = g_dtb_cursor;
+
+    if (!g_dtb_index.ready || node < 0)
+        return 0;
+
+    if (cur >= 0 && cur < g_dtb_index.node_count) {
+        if (g_dtb_nodes[cur].offset == node)
+            return &g_dtb_nodes[cur];
+        if (cur + 1 < g_dtb_index.node_count && g_dtb_nodes[cur + 1].offset == node) {
+            g_dtb_cursor = cur + 1;
+            return &g_dtb_nodes[cur + 1];
+        }
+    }
+
+    while (lo <= hi) {
+        int mid = lo + ((hi - lo) / 2);
+        int off = g_dtb_nodes[mid].offset;
+
+        if (off == node) {
+            g_dtb_cursor = mid;
+            return &g_dtb_nodes[mid];
+        }
+        if (off < node)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return 0;
+}
+
+/*
+Pozycja startowa phandle w g_dtb_phandles. Mnożenie przez stałą Knutha rozrzuca kolejne
+phandle (dtc nadaje je po kolei od 1) po całej tablicy.
+*/
+static uint32_t phandle_slot(uint32_t phandle)
+{
+    return (phandle * 2654435761u) % g_dtb_index.phandle_slots;
+}
+
+/*
+Wstawia phandle → idx do tablicy haszującej. Jeśli phandle już jest, zostawia pierwszy
+wpis – tak jak fdt_node_offset_by_phandle zwraca pierwszy węzeł w kolejności drzewa.
+Pojemność jest gwarantowana przez phandle_slots > node_cap.
+*/
+static void phandle_insert(uint32_t phandle, int idx)
+{
+    uint32_t slot = phandle_slot(phandle);
+
+    while (g_dtb_phandles[slot].phandle) {
+        if (g_dtb_phandles[slot].phandle == phandle)
+            return;
+        slot = (slot + 1) % g_dtb_index.phandle_slots;
+    }
+
+    g_dtb_phandles[slot].phandle = phandle;
+    g_dtb_phandles[slot].node = idx;
+}
+
+/*
+Zwraca indeks węzła o danym phandle albo -1, gdy nie ma go w tablicy.
+Próbkowanie kończy się na pierwszym pustym slocie, więc brak trafienia jest też O(1) średnio.
+*/
+static int phandle_find(uint32_t phandle)
+{
+    uint32_t slot = phandle_slot(phandle);
+
+    while (g_dtb_phandles[slot].phandle) {
+        if (g_dtb_phandles[slot].phandle == phandle)
+            return g_dtb_phandles[slot].node;
+        slot = (slot + 1) % g_dtb_index.phandle_slots;
+    }
+
+    return -1;
+}
+
+/*
+Hash FNV-1a ciągu zakończonego zerem. Ciągi compatible są krótkie, a FNV-1a nie wymaga
+znajomości długości z góry, więc liczymy go jednym przejściem po znakach.
+*/
+static uint32_t compat_hash(const char *str)
+{
+    uint32_t h = 2166136261u;
+
+    while (*str) {
+        h ^= (uint8_t)*str++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*
+Zwraca id ciągu str albo -1, gdy żaden węzeł go nie deklaruje. hash to compat_hash(str);
+strcmp wykonuje się tylko dla slotów z tym samym hashem.
+*/
+static int compat_lookup_hashed(const char *str, uint32_t hash)
+{
+    uint32_t slot = hash % g_dtb_index.compat_slots;
+
+    while (g_dtb_compat_slots[slot]) {
+        const dtb_compat_str_t *cs = &g_dtb_compat_strs[g_dtb_compat_slots[slot] - 1];
+
+        if (cs->hash == hash && strcmp(cs->str, str) == 0)
+            return g_dtb_compat_slots[slot] - 1;
+        slot = (slot + 1) % g_dtb_index.compat_slots;
+    }
+
+    return -1;
+}
+
+static int compat_lookup(const char *str)
+{
+    if (!g_dtb_index.ready || !str)
+        return -1;
+    return compat_lookup_hashed(str, compat_hash(str));
+}
+
+/*
+Zwraca id ciągu str, dodając go do tablicy przy pierwszym wystąpieniu.
+Różnych ciągów nie może być więcej niż wpisów g_dtb_compat, więc miejsce jest zawsze.
+*/
+static int compat_intern(const char *str)
+{
+    uint32_t hash = compat_hash(str);
+    uint32_t slot = hash % g_dtb_index.compat_slots;
+    int id;
+
+    while (g_dtb_compat_slots[slot]) {
+        const dtb_compat_str_t *cs = &g_dtb_compat_strs[g_dtb_compat_slots[slot] - 1];
+
+        if (cs->hash == hash && strcmp(cs->str, str) == 0)
+            return g_dtb_compat_slots[slot] - 1;
+        slot = (slot + 1) % g_dtb_index.compat_slots;
+    }
+
+    id = g_dtb_index.compat_ids++;
+    g_dtb_compat_strs[id].str = str;
+    g_dtb_compat_strs[id].hash = hash;
+    g_dtb_compat_strs[id].first = 0;
+    g_dtb_compat_strs[id].count = 0;
+    g_dtb_compat_slots[slot] = (uint32_t)(id + 1);
+    return id;
+}
+
+/*
+Układa listy węzłów dla każdego id w g_dtb_compat_nodes (sortowanie przez zliczanie):
+najpierw liczności, potem sumy prefiksowe jako początki list, na końcu jedno przejście
+po węzłach w kolejności drzewa – dzięki temu każda lista jest posortowana po offsecie.
+*/
+static void compat_lists_build(int node_count)
+{
+    int pos = 0;
+    int id;
+    int n;
+
+    for (n = 0; n < node_count; n++) {
+        const dtb_node_t *node = &g_dtb_nodes[n];
+        int i;
+
+        for (i = 0; i < node->compat_count; i++)
+            g_dtb_compat_strs[g_dtb_compat_ids[node->compat_first + i]].count++;
+    }
+
+    for (id = 0; id < g_dtb_index.compat_ids; id++) {
+        g_dtb_compat_strs[id].first = pos;
+        pos += g_dtb_compat_strs[id].count;
+        g_dtb_compat_strs[id].count = 0;
+    }
+
+    for (n = 0; n < node_count; n++) {
+        const dtb_node_t *node = &g_dtb_nodes[n];
+        int i;
+
+        for (i = 0; i < node->compat_count; i++) {
+            dtb_compat_str_t *cs = &g_dtb_compat_strs[g_dtb_compat_ids[node->compat_first + i]];
+
+            /* ten sam ciąg dwa razy w jednym węźle liczymy raz */
+            if (cs->count && g_dtb_compat_nodes[cs->first + cs->count - 1] == n)
+                continue;
+            g_dtb_compat_nodes[cs->first + cs->count++] = n;
+        }
+    }
+}
+
+/*
+Zwraca offset pierwszego węzła z listy ciągu id, którego indeks jest większy niż after
+(after == -1 → od początku). Start na liście znajduje wyszukiwanie binarne.
+enabled_only pomija węzły ze status = "disabled". -FDT_ERR_NOTFOUND, gdy lista się skończyła.
+*/
+static int compat_list_next(int id, int after, int enabled_only)
+{
+    const dtb_compat_str_t *cs = &g_dtb_compat_strs[id];
+    const int *list = &g_dtb_compat_nodes[cs->first];
+    int lo = 0;
+    int hi = cs->count;
+
+    while (lo < hi) {
+        int mid = lo + ((hi - lo) / 2);
+
+        if (list[mid] <= after)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (; lo < cs->count; lo++) {
+        const dtb_node_t *node = &g_dtb_nodes[list[lo]];
+
+        if (!enabled_only || (node->flags & DTB_NODE_ENABLED))
+            return node->offset;
+    }
+
+    return -FDT_ERR_NOTFOUND;
+}
+
+/*
+Sprawdza, czy nazwa węzła name odpowiada base tak, jak robi to fdt_path_offset:
+pełna zgodność albo zgodność do znaku '@' (np. "cpus" pasuje do "cpus@0").
+Używana przy budowie indeksu do zapamiętania węzłów /cpus, /reserved-memory i /chosen.
+*/
+static int node_name_is(const char *name, const char *base)
+{
+    size_t len = strlen(base);
+
+    if (!name || strncmp(name, base, len) != 0)
+        return 0;
+    return name[len] == '\0' || name[len] == '@';
+}
+
+/*
+Parsuje ranges węzła node (już opisanego przez ctx) do tablicy okien g_dtb_windows od pozycji *w.
+Walidacja komórek odpowiada dtb_translate_ranges: najpierw błąd rodzica, potem #address-cells węzła,
+#address-cells rodzica, #size-cells węzła i zakresy 1..2; wynik trafia do ctx->win_err.
+Okna są wstawiane przez sortowanie przez wstawianie (magistrala ma ich zwykle kilka).
+Zwraca -FDT_ERR_NOSPACE, gdy okna nie mieszczą się w window_cap.
+*/
+static int windows_build(const dtb_node_t *node, dtb_reg_ctx_t *ctx, int *w)
+{
+    int child_cells = node->addr_cells;
+    int parent_cells = ctx->parent_addr_cells;
+    int size_cells = node->size_cells;
+    int stride;
+    int entries;
+    int i;
+
+    ctx->win_first = *w;
+    ctx->win_count = 0;
+
+    if (ctx->parent < 0)
+        ctx->win_err = ctx->parent;
+    else if (child_cells < 0)
+        ctx->win_err = child_cells;
+    else if (parent_cells < 0)
+        ctx->win_err = parent_cells;
+    else if (size_cells < 0)
+        ctx->win_err = size_cells;
+    else if (child_cells == 0 || child_cells > 2 || parent_cells == 0 || parent_cells > 2 ||
+             size_cells == 0 || size_cells > 2)
+        ctx->win_err = -FDT_ERR_BADNCELLS;
+    else
+        ctx->win_err = 0;
+
+    if (ctx->win_err || !ctx->ranges || ctx->ranges_len <= 0)
+        return 0;
+
+    stride = child_cells + parent_cells + size_cells;
+    entries = ctx->ranges_len / (stride * (int)sizeof(fdt32_t));
+    if (entries > g_dtb_index.window_cap - *w)
+        return -FDT_ERR_NOSPACE;
+
+    for (i = 0; i < entries; i++) {
+        const fdt32_t *entry = ctx->ranges + (i * stride);
+        dtb_window_t win;
+        int j;
+
+        read_cells_u64(entry, child_cells, &win.child_base);
+        read_cells_u64(entry + child_cells, parent_cells, &win.parent_base);
+        read_cells_u64(entry + child_cells + parent_cells, size_cells, &win.size);
+
+        j = ctx->win_first + ctx->win_count;
+        while (j > ctx->win_first && g_dtb_windows[j - 1].child_base > win.child_base) {
+            g_dtb_windows[j] = g_dtb_windows[j - 1];
+            j--;
+        }
+        g_dtb_windows[j] = win;
+        ctx->win_count++;
+    }
+
+    *w += entries;
+    return 0;
+}
+
+/*
+Tłumaczy addr przez okna magistrali opisanej ctx. Wyszukiwanie binarne znajduje ostatnie okno
+z child_base <= addr; jeśli go nie obejmuje, sprawdzane są jeszcze wcześniejsze okna (na wypadek
+nakładających się ranges). Zwraca -FDT_ERR_NOTFOUND, gdy addr nie leży w żadnym oknie.
+*/
+static int windows_lookup(const dtb_reg_ctx_t *ctx, uint64_t addr, uint64_t *out)
+{
+    const dtb_window_t *win = &g_dtb_windows[ctx->win_first];
+    int lo = 0;
+    int hi = ctx->win_count;
+
+    while (lo < hi) {
+        int mid = lo + ((hi - lo) / 2);
+
+        if (win[mid].child_base <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    while (--lo >= 0) {
+        if (addr - win[lo].child_base < win[lo].size) {
+            *out = win[lo].parent_base + (addr - win[lo].child_base);
+            return 0;
+        }
+    }
+
+    return -FDT_ERR_NOTFOUND;
+}
+
+/*
+Pierwsze przejście budowy indeksu: liczy węzły, wpisy compatible i górne ograniczenie liczby
+okien ranges (wpis ma co najmniej trzy komórki), żeby dtb_index_init przydzielił tablice
+dokładnie pod ten blob. Zwraca -FDT_ERR_NOSPACE dla drzewa głębszego niż DTB_INDEX_MAX_DEPTH.
+*/
+static int dtb_index_count(int *nodes, int *compat, int *windows)
+{
+    int depth = -1;
+    int off;
+
+    *nodes = 0;
+    *compat = 0;
+    *windows = 0;
+
+    for (off = fdt_next_node(g_fdt, -1, &depth);
+         off >= 0;
+         off = fdt_next_node(g_fdt, off, &depth)) {
+        int prop;
+
+        if (depth >= DTB_INDEX_MAX_DEPTH)
+            return -FDT_ERR_NOSPACE;
+        (*nodes)++;
+
+        fdt_for_each_property_offset(prop, g_fdt, off) {
+            const char *pname;
+            const char *val;
+            int len;
+
+            val = fdt_getprop_by_offset(g_fdt, prop, &pname, &len);
+            if (!val || !pname)
+                continue;
+
+            if (strcmp(pname, "compatible") == 0) {
+                int pos = 0;
+
+                while (pos < len && val[pos]) {
+                    (*compat)++;
+                    pos += (int)strlen(val + pos) + 1;
+                }
+            } else if (strcmp(pname, "ranges") == 0 && len > 0) {
+                *windows += len / (3 * (int)sizeof(fdt32_t));
+            }
+        }
+    }
+
+    return (off == -FDT_ERR_NOTFOUND) ? 0 : off;
+}
+
+/*
+Buduje indeks drzewa jednym przejściem fdt_next_node, z jednym przejściem po
+właściwościach każdego węzła. Stos rodziców (parents) i ostatnich dzieci (last_child)
+na każdym poziomie pozwala podpiąć węzeł do rodzica i rodzeństwa w O(1).
+interrupt-parent jest od razu dziedziczony od przodków, a listy compatible są rozbijane
+na osobne wskaźniki w g_dtb_compat i internowane (compat_intern), po czym compat_lists_build
+układa dla każdego ciągu listę węzłów. Każdy węzeł z phandle trafia do g_dtb_phandles,
+a ranges każdej magistrali są od razu rozkładane na posortowane okna (windows_build).
+Tablice muszą być już przydzielone przez dtb_index_init; -FDT_ERR_NOSPACE (drzewo większe
+niż policzone pojemności albo głębsze niż DTB_INDEX_MAX_DEPTH) zostawia indeks wyłączony
+i moduł działa dalej na samym blobie.
+*/
+static int dtb_index_build(void)
+{
+    int parents[DTB_INDEX_MAX_DEPTH];
+    int last_child[DTB_INDEX_MAX_DEPTH + 1];
+    int depth = -1;
+    int off;
+    int n = 0;
+    int c = 0;
+    int w = 0;
+    int err;
+
+    g_dtb_index.ready = 0;
+    g_dtb_index.node_count = 0;
+    g_dtb_index.compat_count = 0;
+    g_dtb_index.compat_ids = 0;
+    g_dtb_index.cpus = -1;
+    g_dtb_index.reserved_memory = -1;
+    g_dtb_index.chosen = -1;
+    memset(g_dtb_phandles, 0, g_dtb_index.phandle_slots * sizeof(*g_dtb_phandles));
+    memset(g_dtb_compat_slots, 0, g_dtb_index.compat_slots * sizeof(*g_dtb_compat_slots));
+    last_child[0] = -1;
+
+    for (off = fdt_next_node(g_fdt, -1, &depth);
+         off >= 0;
+         off = fdt_next_node(g_fdt, off, &depth)) {
+        dtb_node_t *node;
+        dtb_reg_ctx_t *ctx;
+        uint32_t linux_phandle = 0;
+        int prop;
+
+        if (n >= g_dtb_index.node_cap || depth >= DTB_INDEX_MAX_DEPTH)
+            return -FDT_ERR_NOSPACE;
+
+        node = &g_dtb_nodes[n];
+        memset(node, 0, sizeof(*node));
+        node->offset = off;
+        node->parent = (depth > 0) ? parents[depth - 1] : -1;
+        node->first_child = -1;
+        node->next_sibling = -1;
+        node->name = fdt_get_name(g_fdt, off, 0);
+        node->addr_cells = (int16_t)fdt_address_cells(g_fdt, off);
+        node->size_cells = (int16_t)fdt_size_cells(g_fdt, off);
+        node->compat_first = (uint32_t)c;
+        node->flags = DTB_NODE_ENABLED;
+
+        ctx = &g_dtb_reg_ctx[n];
+        ctx->parent = -FDT_ERR_NOTFOUND;
+        ctx->parent_addr_cells = -FDT_ERR_NOTFOUND;
+        ctx->parent_size_cells = -FDT_ERR_NOTFOUND;
+        ctx->reg = 0;
+        ctx->reg_len = -FDT_ERR_NOTFOUND;
+        ctx->ranges = 0;
+        ctx->ranges_len = -FDT_ERR_NOTFOUND;
+        if (node->parent >= 0) {
+            const dtb_node_t *pn = &g_dtb_nodes[node->parent];
+
+            ctx->parent = pn->offset;
+            ctx->parent_addr_cells = pn->addr_cells;
+            ctx->parent_size_cells = pn->size_cells;
+        }
+
+        if (depth > 0) {
+            if (last_child[depth] < 0)
+                g_dtb_nodes[node->parent].first_child = n;
+            else
+                g_dtb_nodes[last_child[depth]].next_sibling = n;
+        }
+        last_child[depth] = n;
+        last_child[depth + 1] = -1;
+        parents[depth] = n;
+
+        fdt_for_each_property_offset(prop, g_fdt, off) {
+            const char *pname;
+            const char *val;
+            int len;
+
+            val = fdt_getprop_by_offset(g_fdt, prop, &pname, &len);
+            if (!val || !pname)
+                continue;
+
+            if (strcmp(pname, "compatible") == 0) {
+                int pos = 0;
+
+                while (pos < len && val[pos]) {
+                    if (c >= g_dtb_index.compat_cap)
+                        return -FDT_ERR_NOSPACE;
+                    g_dtb_compat[c] = val + pos;
+                    g_dtb_compat_ids[c++] = (uint32_t)compat_intern(val + pos);
+                    pos += (int)strlen(val + pos) + 1;
+                }
+            } else if (strcmp(pname, "status") == 0) {
+                if (strcmp(val, "disabled") == 0)
+                    node->flags &= (uint16_t)~DTB_NODE_ENABLED;
+            } else if (strcmp(pname, "device_type") == 0) {
+                if (strcmp(val, "cpu") == 0)
+                    node->flags |= DTB_NODE_CPU;
+                else if (strcmp(val, "memory") == 0)
+                    node->flags |= DTB_NODE_MEMORY;
+            } else if (strcmp(pname, "interrupt-controller") == 0) {
+                node->flags |= DTB_NODE_INTC;
+            } else if (strcmp(pname, "reg") == 0) {
+                ctx->reg = (const fdt32_t *)val;
+                ctx->reg_len = len;
+            } else if (strcmp(pname, "ranges") == 0) {
+                node->flags |= DTB_NODE_RANGES;
+                ctx->ranges = (const fdt32_t *)val;
+                ctx->ranges_len = len;
+            } else if (strcmp(pname, "interrupt-parent") == 0) {
+                if (len >= (int)sizeof(fdt32_t)) {
+                    node->interrupt_parent = fdt32_to_cpu(*(const fdt32_t *)val);
+                    node->flags |= DTB_NODE_IPARENT;
+                }
+            } else if (strcmp(pname, "#interrupt-cells") == 0) {
+                if (len >= (int)sizeof(fdt32_t)) {
+                    node->interrupt_cells = fdt32_to_cpu(*(const fdt32_t *)val);
+                    node->flags |= DTB_NODE_ICELLS;
+                }
+            } else if (strcmp(pname, "phandle") == 0) {
+                if (len == (int)sizeof(fdt32_t))
+                    node->phandle = fdt32_to_cpu(*(const fdt32_t *)val);
+            } else if (strcmp(pname, "linux,phandle") == 0) {
+                if (len == (int)sizeof(fdt32_t))
+                    linux_phandle = fdt32_to_cpu(*(const fdt32_t *)val);
+            }
+        }
+
+        node->compat_count = (uint16_t)(c - node->compat_first);
+
+        err = windows_build(node, ctx, &w);
+        if (err)
+            return err;
+        if (!node->phandle)
+            node->phandle = linux_phandle;
+        if (node->phandle && node->phandle != ~0u)
+            phandle_insert(node->phandle, n);
+
+        if (!(node->flags & DTB_NODE_IPARENT) && node->parent >= 0 &&
+            (g_dtb_nodes[node->parent].flags & DTB_NODE_IPARENT)) {
+            node->interrupt_parent = g_dtb_nodes[node->parent].interrupt_parent;
+            node->flags |= DTB_NODE_IPARENT;
+        }
+
+        if (depth == 1) {
+            if (g_dtb_index.cpus < 0 && node_name_is(node->name, "cpus"))
+                g_dtb_index.cpus = n;
+            else if (g_dtb_index.reserved_memory < 0 && node_name_is(node->name, "reserved-memory"))
+                g_dtb_index.reserved_memory = n;
+            else if (g_dtb_index.chosen < 0 && node_name_is(node->name, "chosen"))
+                g_dtb_index.chosen = n;
+        }
+
+        n++;
+    }
+
+    if (off != -FDT_ERR_NOTFOUND)
+        return off;
+
+    g_dtb_index.node_count = n;
+    g_dtb_index.compat_count = c;
+    compat_lists_build(n);
+    g_dtb_index.ready = 1;
+    return 0;
+}
+
+/*
+Zwracają #address-cells / #size-cells węzła node (dla jego dzieci) z indeksu,
+a bez indeksu przez fdt_address_cells / fdt_size_cells. Kody błędów są identyczne,
+bo indeks zapamiętuje dokładnie to, co zwróciło libfdt w czasie budowy.
+*/
+static int node_addr_cells(int node)
+{
+    const dtb_node_t *n = index_node(node);
+    return n ? n->addr_cells : fdt_address_cells(g_fdt, node);
+}
+
+static int node_size_cells(int node)
+{
+    const dtb_node_t *n = index_node(node);
+    return n ? n->size_cells : fdt_size_cells(g_fdt, node);
+}
+
+/*
+Wypełnia ctx danymi potrzebnymi do dekodowania reg/ranges węzła node.
+Z indeksem to kopia wpisu g_dtb_reg_ctx (O(1) po znalezieniu węzła), bez indeksu – te same
+dane zebrane przez fdt_parent_offset, fdt_address_cells/fdt_size_cells rodzica i fdt_getprop.
+Zwraca tylko błąd rodzica (np. -FDT_ERR_NOTFOUND dla korzenia); komórki mogą być ujemnym
+kodem błędu libfdt i wywołujący sprawdzają je w swojej kolejności.
+*/
+static int node_reg_ctx(int node, dtb_reg_ctx_t *ctx)
+{
+    const dtb_node_t *n = index_node(node);
+
+    if (n) {
+        *ctx = g_dtb_reg_ctx[n - g_dtb_nodes];
+        return (ctx->parent < 0) ? ctx->parent : 0;
+    }
+
+    ctx->parent = fdt_parent_offset(g_fdt, node);
+    if (ctx->parent < 0)
+        return ctx->parent;
+
+    ctx->parent_addr_cells = fdt_address_cells(g_fdt, ctx->parent);
+    ctx->parent_size_cells = fdt_size_cells(g_fdt, ctx->parent);
+    ctx->reg = fdt_getprop(g_fdt, node, "reg", &ctx->reg_len);
+    ctx->ranges = fdt_getprop(g_fdt, node, "ranges", &ctx->ranges_len);
+    return 0;
+}
+
+/*
+Zwraca właściwość reg węzła (i jej długość w *len) – z tablicy pomocniczej, gdy jest indeks,
+w przeciwnym razie przez fdt_getprop. Dla dtb_devices_collect, który komórki rodzica zna już ze stosu.
+*/
+static const fdt32_t *node_reg_prop(int node, int *len)
+{
+    const dtb_node_t *n = index_node(node);
+
+    if (n) {
+        const dtb_reg_ctx_t *ctx = &g_dtb_reg_ctx[n - g_dtb_nodes];
+
+        *len = ctx->reg_len;
+        return ctx->reg;
+    }
+
+    return fdt_getprop(g_fdt, node, "reg", len);
+}
+
+/*
+Kolejny węzeł w kolejności przejścia w głąb po node (node < 0 → korzeń).
+Odpowiednik fdt_next_node bez śledzenia głębokości; z indeksem to po prostu następny
+element tablicy. Zwraca -FDT_ERR_NOTFOUND na końcu drzewa.
+*/
+static int node_next(int node)
+{
+    const dtb_node_t *n;
+
+    if (node < 0 && g_dtb_index.ready)
+        return g_dtb_index.node_count ? g_dtb_nodes[0].offset : -FDT_ERR_NOTFOUND;
+
+    n = index_node(node);
+    if (!n)
+        return fdt_next_node(g_fdt, node, 0);
+    if ((n - g_dtb_nodes) + 1 >= g_dtb_index.node_count)
+        return -FDT_ERR_NOTFOUND;
+    return n[1].offset;
+}
+
+/*
+Pierwsze dziecko / następne rodzeństwo węzła – odpowiedniki fdt_first_subnode
+i fdt_next_subnode czytane z indeksu w O(log n) zamiast przeskakiwania po blobie.
+*/
+static int node_first_child(int node)
+{
+    const dtb_node_t *n = index_node(node);
+
+    if (!n)
+        return fdt_first_subnode(g_fdt, node);
+    if (n->first_child < 0)
+        return -FDT_ERR_NOTFOUND;
+    return g_dtb_nodes[n->first_child].offset;
+}
+
+static int node_next_sibling(int node)
+{
+    const dtb_node_t *n = index_node(node);
+
+    if (!n)
+        return fdt_next_subnode(g_fdt, node);
+    if (n->next_sibling < 0)
+        return -FDT_ERR_NOTFOUND;
+    return g_dtb_nodes[n->next_sibling].offset;
+}
+
+/*
+Zwraca offset jednego z zapamiętanych węzłów z poziomu korzenia (cached to pole z
+dtb_index_t), a bez indeksu rozwiązuje ścieżkę path przez fdt_path_offset.
+Używana przez funkcje czytające /cpus, /reserved-memory i /chosen.
+*/
+static int root_child(int cached, const char *path)
+{
+    if (!g_dtb_index.ready)
+        return fdt_path_offset(g_fdt, path);
+    if (cached < 0)
+        return -FDT_ERR_NOTFOUND;
+    return g_dtb_nodes[cached].offset;
+}
+
 /*
 Pobiera z DTB wartość 32-bitową właściwości name dla węzła node, poprawnie obsługując big-endian i zwracając -FDT_ERR_BADVALUE przy braku bufora lub zbyt krótkich danych.
 Zwraca kod błędu z fdt_getprop jeśli właściwość nie istnieje, co pozwala wyżej położonym helperom rozróżniać brak pola od innych problemów.
@@ -90,9 +915,25 @@ static int compat_has(int node, const char *needle)
     int len;
     int off = 0;
     const char *compat;
+    const dtb_node_t *n;
 
     if (!needle)
         return 0;
+
+    n = index_node(node);
+    if (n) {
+        int id = compat_lookup(needle);
+        int i;
+
+        if (id < 0)
+            return 0;
+        for (i = 0; i < n->compat_count; i++) {
+            if (g_dtb_compat_ids[n->compat_first + i] == (uint32_t)id)
+                return 1;
+        }
+        return 0;
+    }
+
     compat = fdt_getprop(g_fdt, node, "compatible", &len);
     if (!compat || len <= 0)
         return 0;
@@ -119,14 +960,51 @@ Używana tam, gdzie wystarczy wiedzieć tylko pierwszy identyfikator urządzenia
 static const char *first_compat(int node)
 {
     int len;
-    const char *compat = fdt_getprop(g_fdt, node, "compatible", &len);
+    const char *compat;
+    const dtb_node_t *n = index_node(node);
+
+    if (n)
+        return n->compat_count ? g_dtb_compat[n->compat_first] : 0;
 
+    compat = fdt_getprop(g_fdt, node, "compatible", &len);
     if (!compat || len <= 0 || compat[0] == '\0')
         return 0;
 
     return compat;
 }
 
+/*
+Zwraca nazwę węzła (część ścieżki po ostatnim '/', z ewentualnym "@adres").
+Z indeksu to odczyt pola name, bez indeksu – fdt_get_name.
+*/
+static const char *node_name(int node)
+{
+    const dtb_node_t *n = index_node(node);
+    return n ? n->name : fdt_get_name(g_fdt, node, 0);
+}
+
+/*
+Szuka następnego po start_node (start_node < 0 → od korzenia) węzła, którego lista compatible zawiera compat.
+Z indeksem to jedno zapytanie do tablicy internowanych ciągów i wyszukiwanie binarne na liście węzłów tego ciągu,
+bez indeksu deleguje do fdt_node_offset_by_compatible.
+Nieprawidłowy start_node jest zawsze przekazywany do libfdt, żeby zachować jego kody błędów.
+Używana przez dtb_find_compatible(_n), find_any_compatible i dtb_uart_ns16550a.
+*/
+static int node_find_compatible(int start_node, const char *compat)
+{
+    const dtb_node_t *start = 0;
+    int id;
+
+    if (!g_dtb_index.ready || (start_node >= 0 && !(start = index_node(start_node))))
+        return fdt_node_offset_by_compatible(g_fdt, start_node, compat);
+
+    id = compat_lookup(compat);
+    if (id < 0)
+        return -FDT_ERR_NOTFOUND;
+
+    return compat_list_next(id, start ? (int)(start - g_dtb_nodes) : -1, 0);
+}
+
 /*
 Ładuje listę referencji (phandle + args) z właściwości prop_name w węźle node do bufora arr, konwertując Big-endianowe komórki na uint32_t.
 Waliduje wejście (arr, count, cap) i zwraca -FDT_ERR_BADVALUE przy brakujących buforach.
@@ -167,15 +1045,25 @@ Wędruje od węzła node w górę drzewa (fdt_parent_offset) i szuka właściwo
 Jeśli znajdzie wartość, zapisuje ją do *parent i zwraca 0.
 Jeśli napotka inny błąd niż brak (-FDT_ERR_NOTFOUND), propaguje go dalej.
 Jeżeli żadna instancja nie ma tej właściwości, zwraca -FDT_ERR_NOTFOUND.
+Z indeksem wynik jest już rozwiązany w czasie dtb_index_build (węzeł dziedziczy interrupt-parent po przodkach), więc nie ma wędrówki w górę.
 Funkcja jest używana np. w dtb_device_read, żeby ustalić kontroler przerwań obsługujący dane urządzenie i odczytać #interrupt-cells.
 */
 static int get_interrupt_parent(int node, uint32_t *parent)
 {
     int cur = node;
+    const dtb_node_t *n;
 
     if (!parent)
         return -FDT_ERR_BADVALUE;
 
+    n = index_node(node);
+    if (n) {
+        if (!(n->flags & DTB_NODE_IPARENT))
+            return -FDT_ERR_NOTFOUND;
+        *parent = n->interrupt_parent;
+        return 0;
+    }
+
     while (cur >= 0) {
         int ret = get_u32_prop(cur, "interrupt-parent", parent);
         if (!ret)
@@ -188,18 +1076,31 @@ static int get_interrupt_parent(int node, uint32_t *parent)
     return -FDT_ERR_NOTFOUND;
 }
 /*
-Wywołuje fdt_node_offset_by_phandle, żeby znaleźć offset węzła na podstawie phandle.
-Zwraca offset (>=0) lub kod błędu libfdt, jeśli phandle nie istnieje.
+Znajduje offset węzła na podstawie phandle. Z indeksem to jedno zapytanie do tablicy haszującej
+g_dtb_phandles (O(1) średnio), bez indeksu – fdt_node_offset_by_phandle, które skanuje cały blob.
+Zwraca offset (>=0) lub kod błędu zgodny z libfdt: -FDT_ERR_BADPHANDLE dla 0/0xffffffff,
+-FDT_ERR_NOTFOUND, jeśli phandle nie istnieje.
 Używana do lokalizowania kontrolera przerwań (lub innego węzła) po phandle z interrupt-parent, clocks itp.
 */
 static int find_node_by_phandle(uint32_t phandle)
 {
-    return fdt_node_offset_by_phandle(g_fdt, phandle);
+    int idx;
+
+    if (!g_dtb_index.ready)
+        return fdt_node_offset_by_phandle(g_fdt, phandle);
+    if (phandle == 0 || phandle == ~0u)
+        return -FDT_ERR_BADPHANDLE;
+
+    idx = phandle_find(phandle);
+    if (idx < 0)
+        return -FDT_ERR_NOTFOUND;
+    return g_dtb_nodes[idx].offset;
 }
 
 /*
 Znajduje węzeł kontrolera (parent_node) po phandle i odczytuje jego #interrupt-cells, czyli ile komórek opisuje jedno przerwanie.
 Jeśli właściwość istnieje, zapisuje tę wartość do *cells. Jeśli jej brak, przyjmuje domyślnie 1.
+Z indeksem zarówno phandle → węzeł, jak i #interrupt-cells są odczytem z pamięci.
 Zwraca kod błędu z find_node_by_phandle albo -FDT_ERR_BADVALUE, jeśli przekazano NULL, co upraszcza obsługę błędów wyżej.
 Używana w dtb_device_read, żeby wiedzieć, jak dzielić tablicę interrupts urządzenia na rekordy zgodne z kontrolerem przerwań.
 */
@@ -207,6 +1108,7 @@ static int get_interrupt_cells_for_parent(uint32_t parent_phandle, int *cells)
 {
     int parent_node;
     uint32_t val;
+    const dtb_node_t *n;
 
     if (!cells)
         return -FDT_ERR_BADVALUE;
@@ -215,6 +1117,12 @@ static int get_interrupt_cells_for_parent(uint32_t parent_phandle, int *cells)
     if (parent_node < 0)
         return parent_node;
 
+    n = index_node(parent_node);
+    if (n) {
+        *cells = (n->flags & DTB_NODE_ICELLS) ? (int)n->interrupt_cells : 1;
+        return 0;
+    }
+
     if (get_u32_prop(parent_node, "#interrupt-cells", &val) == 0) {
         *cells = (int)val;
         return 0;
@@ -225,17 +1133,17 @@ static int get_interrupt_cells_for_parent(uint32_t parent_phandle, int *cells)
 }
 /*
 Odczytuje index‑ty wpis z właściwości reg węzła node, interpretując go zgodnie z #address-cells/#size-cells rodzica.
-Najpierw sprawdza argumenty i pobiera rodzica (fdt_parent_offset), potem liczbę komórek adresowych i rozmiarowych (domyślnie 0–2 komórek).
+Najpierw sprawdza argumenty, potem bierze z node_reg_ctx rodzica, jego liczbę komórek adresowych i rozmiarowych (domyślnie 0–2 komórek) oraz wskaźnik na reg – z indeksem bez fdt_parent_offset i fdt_getprop, więc wpis kosztuje O(1).
 Przeskakuje do właściwego wpisu (entry = reg + index * stride), składa adres przez read_cells_u64, a rozmiar tylko jeśli #size-cells > 0 (bieżący CPU ma #size-cells=0, stąd special case).
 Zwraca kody błędów libfdt (-FDT_ERR_BADNCELLS, -FDT_ERR_NOTFOUND itd.), co pozwala wyższym helperom obsłużyć albo zgłosić brak właściwości.
 Funkcja jest wykorzystywana wszędzie tam, gdzie trzeba odczytać pojedynczy zakres MMIO: decode_reg_list, dtb_device_read, dtb_cpu_read, dtb_uart_ns16550a itd.
 */
 static int decode_reg_entry_with_parent(int node, int index, uint64_t *base, uint64_t *size)
 {
-    // Długość właściwości reg w bajtach, offset rodzica, liczba komórek adresowych 
+    // Kontekst reg węzła (rodzic, jego komórki, właściwość reg), liczba komórek adresowych
     // i rozmiarowych, wskaźnik do tablicy reg, wskaźnik do konkretnego wpisu, kod błędu.
+    dtb_reg_ctx_t ctx;
     int len;
-    int parent;
     int naddr;
     int nsize;
     int stride;
@@ -243,23 +1151,23 @@ static int decode_reg_entry_with_parent(int node, int index, uint64_t *base, uin
     const fdt32_t *entry;
     int err;
 
-    // Sprawdź argumenty i pobierz rodzica.
+    // Sprawdź argumenty.
     if (!base || !size || index < 0)
         return -FDT_ERR_BADVALUE;
 
-    // Pobierz offset rodzica, bo #address-cells/#size-cells są zdefiniowane przez rodzica.
-    parent = fdt_parent_offset(g_fdt, node);
-    if (parent < 0)
-        return parent;
+    // Pobierz rodzica, bo #address-cells/#size-cells są zdefiniowane przez rodzica.
+    err = node_reg_ctx(node, &ctx);
+    if (err)
+        return err;
 
-    // Pobierz liczbę komórek adresowych i rozmiarowych dla rodzica.
+    // Liczba komórek adresowych i rozmiarowych rodzica.
     // Są one używane do interpretacji właściwości "reg" bieżącego węzła.
-    naddr = fdt_address_cells(g_fdt, parent);
+    naddr = ctx.parent_addr_cells;
     if (naddr < 0)
         return naddr;
 
     // #size-cells może być 0, co oznacza, że rozmiar jest nieokreślony lub nieistotny (np. dla CPU), więc obsłuż to jako specjalny przypadek.
-    nsize = fdt_size_cells(g_fdt, parent);
+    nsize = ctx.parent_size_cells;
     if (nsize < 0)
         return nsize;
 
@@ -269,7 +1177,8 @@ static int decode_reg_entry_with_parent(int node, int index, uint64_t *base, uin
 
     // Stride to liczba komórek potrzebnych do opisu jednego zakresu (adres + rozmiar).
     stride = naddr + nsize;
-    reg = fdt_getprop(g_fdt, node, "reg", &len);
+    reg = ctx.reg;
+    len = ctx.reg_len;
     if (!reg)
         return len;
 
@@ -292,43 +1201,27 @@ static int decode_reg_entry_with_parent(int node, int index, uint64_t *base, uin
 }
 
 /*
-Parsuje wszystkie wpisy reg (adres + rozmiar) dla węzła node, stosując #address-cells/#size-cells rodzica i zapisując je do tablicy arr.
-Waliduje bufor (arr, count, cap) i zwraca -FDT_ERR_BADVALUE przy błędnych argumentach. Jeśli reg nie istnieje, ustawia *count=0 i kończy sukcesem.
-Limit cap zostaje użyty przez min_int, aby nie przepełnić bufora, a gdy liczba wpisów przekracza cap, funkcja zwraca -FDT_ERR_NOSPACE.
-decode_reg_entry_with_parent jest wywoływana dla każdego wpisu — dzięki temu można odczytać wszystkie regiony MMIO jednego urządzenia (dtb_device_read), listę pamięci (dtb_memory_regions) czy listę regionów w /reserved-memory.
+Dekoduje wszystkie wpisy właściwości reg (reg/len tak jak z fdt_getprop) przy znanych już #address-cells/#size-cells
+rodzica (naddr/nsize) jednym przejściem: każdy wpis to naddr + nsize komórek, składanych przez read_cells_u64.
+Waliduje bufor (arr, count, cap) i liczbę komórek (-FDT_ERR_BADNCELLS poza 1..2 / 0..2). Brak reg to *count=0 i sukces.
+Gdy wpisów jest więcej niż cap, wypełnia cap pierwszych i zwraca -FDT_ERR_NOSPACE.
+Wspólna dla decode_reg_list (komórki z rodzica) i dtb_devices_collect (komórki ze stosu rodziców).
 */
-static int decode_reg_list(int node, dtb_addr_t *arr, int cap, int *count)
+static int decode_reg_cells(const fdt32_t *reg, int len, int naddr, int nsize,
+                            dtb_addr_t *arr, int cap, int *count)
 {
-    int len;
-    int parent;
-    int naddr;
-    int nsize;
     int stride;
     int entries;
     int i;
     int outc;
-    const fdt32_t *reg;
 
     if (!arr || !count || cap < 0)
         return -FDT_ERR_BADVALUE;
 
-    parent = fdt_parent_offset(g_fdt, node);
-    if (parent < 0)
-        return parent;
-
-    naddr = fdt_address_cells(g_fdt, parent);
-    if (naddr < 0)
-        return naddr;
-
-    nsize = fdt_size_cells(g_fdt, parent);
-    if (nsize < 0)
-        return nsize;
-
     if (naddr <= 0 || naddr > 2 || nsize < 0 || nsize > 2)
         return -FDT_ERR_BADNCELLS;
 
     stride = naddr + nsize;
-    reg = fdt_getprop(g_fdt, node, "reg", &len);
     if (!reg) {
         if (len == -FDT_ERR_NOTFOUND) {
             *count = 0;
@@ -341,17 +1234,87 @@ static int decode_reg_list(int node, dtb_addr_t *arr, int cap, int *count)
     outc = min_int(entries, cap);
 
     for (i = 0; i < outc; i++) {
-        int err = decode_reg_entry_with_parent(node, i, &arr[i].base, &arr[i].size);
+        const fdt32_t *entry = reg + (i * stride);
+        int err = read_cells_u64(entry, naddr, &arr[i].base);
         if (err)
             return err;
+
+        arr[i].size = 0;
+        if (nsize > 0) {
+            err = read_cells_u64(entry + naddr, nsize, &arr[i].size);
+            if (err)
+                return err;
+        }
     }
 
-    *count = outc;
+    *count = outc;
+
+    if (entries > cap)
+        return -FDT_ERR_NOSPACE;
+
+    return 0;
+}
+
+/*
+Parsuje wszystkie wpisy reg (adres + rozmiar) dla węzła node, stosując #address-cells/#size-cells rodzica i zapisując je do tablicy arr.
+Rodzic, jego komórki i reg są pobierane raz dla całej listy (node_reg_ctx), a same wpisy dekoduje decode_reg_cells jednym przejściem
+(wcześniej każdy wpis szedł przez decode_reg_entry_with_parent, który za każdym razem od nowa szukał rodzica).
+Waliduje bufor (arr, count, cap) i zwraca -FDT_ERR_BADVALUE przy błędnych argumentach. Jeśli reg nie istnieje, ustawia *count=0 i kończy sukcesem.
+Gdy liczba wpisów przekracza cap, funkcja zwraca -FDT_ERR_NOSPACE.
+Dzięki temu można odczytać wszystkie regiony MMIO jednego urządzenia (dtb_device_read), listę pamięci (dtb_memory_regions) czy listę regionów w /reserved-memory.
+*/
+static int decode_reg_list(int node, dtb_addr_t *arr, int cap, int *count)
+{
+    dtb_reg_ctx_t ctx;
+    int err;
+
+    if (!arr || !count || cap < 0)
+        return -FDT_ERR_BADVALUE;
+
+    err = node_reg_ctx(node, &ctx);
+    if (err)
+        return err;
+
+    if (ctx.parent_addr_cells < 0)
+        return ctx.parent_addr_cells;
+
+    if (ctx.parent_size_cells < 0)
+        return ctx.parent_size_cells;
+
+    return decode_reg_cells(ctx.reg, ctx.reg_len, ctx.parent_addr_cells, ctx.parent_size_cells,
+                            arr, cap, count);
+}
+
+/*
+Zwraca liczbę wpisów reg węzła node (0 gdy reg nie ma albo komórki rodzica są błędne).
+Pozwala wariantom *_alloc przydzielić z areny tablicę dokładnie na tyle wpisów, ile jest w drzewie.
+*/
+static int reg_entry_count(int node)
+{
+    dtb_reg_ctx_t ctx;
+    int stride;
+
+    if (node_reg_ctx(node, &ctx) || !ctx.reg)
+        return 0;
+    if (ctx.parent_addr_cells <= 0 || ctx.parent_addr_cells > 2 ||
+        ctx.parent_size_cells < 0 || ctx.parent_size_cells > 2)
+        return 0;
+
+    stride = ctx.parent_addr_cells + ctx.parent_size_cells;
+    return ctx.reg_len / (stride * (int)sizeof(fdt32_t));
+}
 
-    if (entries > cap)
-        return -FDT_ERR_NOSPACE;
+/*
+Zwraca liczbę komórek u32 we właściwości name węzła node (0, gdy jej nie ma).
+Używana do wymiarowania list referencji (clocks, resets, ...) przed przydziałem z areny.
+*/
+static int prop_cell_count(int node, const char *name)
+{
+    int len;
 
-    return 0;
+    if (!fdt_getprop(g_fdt, node, name, &len) || len <= 0)
+        return 0;
+    return len / (int)sizeof(fdt32_t);
 }
 
 /*
@@ -361,10 +1324,60 @@ Pomaga identyfikować węzły procesorów podczas iteracji po /cpus w funkcjach
 static int node_is_cpu(int node)
 {
     int len;
-    const char *dtype = fdt_getprop(g_fdt, node, "device_type", &len);
+    const char *dtype;
+    const dtb_node_t *n = index_node(node);
+
+    if (n)
+        return (n->flags & DTB_NODE_CPU) != 0;
+
+    dtype = fdt_getprop(g_fdt, node, "device_type", &len);
     return dtype && strcmp(dtype, "cpu") == 0;
 }
 
+/*
+Sprawdza, czy węzeł ma device_type = "memory". Z indeksem to test flagi DTB_NODE_MEMORY,
+bez indeksu – fdt_getprop i strcmp. Używana przez dtb_memory_regions.
+*/
+static int node_is_memory(int node)
+{
+    int len;
+    const char *dtype;
+    const dtb_node_t *n = index_node(node);
+
+    if (n)
+        return (n->flags & DTB_NODE_MEMORY) != 0;
+
+    dtype = fdt_getprop(g_fdt, node, "device_type", &len);
+    return dtype && strcmp(dtype, "memory") == 0;
+}
+
+/*
+Sprawdza, czy węzeł jest kontrolerem przerwań (ma właściwość interrupt-controller).
+Z indeksem to test flagi DTB_NODE_INTC, bez indeksu – prop_exists.
+Używana przez dtb_interrupt_controller_read i dtb_interrupt_controllers_scan.
+*/
+static int node_is_intc(int node)
+{
+    const dtb_node_t *n = index_node(node);
+
+    if (n)
+        return (n->flags & DTB_NODE_INTC) != 0;
+    return prop_exists(node, "interrupt-controller");
+}
+
+/*
+Zwraca 1, jeśli węzeł ma właściwość ranges (także pustą), w przeciwnym razie 0.
+Z indeksem to test flagi DTB_NODE_RANGES. Używana przez dtb_bus_info.
+*/
+static int node_has_ranges(int node)
+{
+    const dtb_node_t *n = index_node(node);
+
+    if (n)
+        return (n->flags & DTB_NODE_RANGES) ? 1 : 0;
+    return prop_exists(node, "ranges") ? 1 : 0;
+}
+
 /*
 Sprawdza właściwość status i zwraca true jeśli jej nie ma albo nie równa się "disabled".
 Używana wszędzie, gdzie trzeba pominąć wyłączone węzły (np. w iteracji /cpus, /reserved-memory, dtb_device_first/next).
@@ -372,7 +1385,13 @@ Używana wszędzie, gdzie trzeba pominąć wyłączone węzły (np. w iteracji /
 static int node_is_enabled(int node)
 {
     int len;
-    const char *status = fdt_getprop(g_fdt, node, "status", &len);
+    const char *status;
+    const dtb_node_t *n = index_node(node);
+
+    if (n)
+        return (n->flags & DTB_NODE_ENABLED) != 0;
+
+    status = fdt_getprop(g_fdt, node, "status", &len);
     return !status || strcmp(status, "disabled") != 0;
 }
 
@@ -389,6 +1408,8 @@ static int node_is_device(int node)
 Upewnia się, że przekazany wskaźnik dtb nie jest NULL; jeśli jest, zwraca -FDT_ERR_BADVALUE.
 Wywołuje fdt_check_header, żeby sprawdzić nagłówek DTB (magic, wersja, spójność); przy błędzie zwraca kod libfdt.
 Jeśli wszystko OK, zapisuje blob do globalnego g_fdt, dzięki czemu reszta modułu może korzystać z DTB przez helper dtb_require_init.
+Indeksu nie buduje – na tym etapie wołający zwykle nie ma jeszcze pamięci (jądro przed memblock_init).
+Do czasu dtb_index_init wszystkie funkcje dtb_* czytają blob bezpośrednio przez libfdt, z tymi samymi wynikami.
 */
 int dtb_init(void *dtb)
 {
@@ -402,6 +1423,118 @@ int dtb_init(void *dtb)
         return err;
 
     g_fdt = dtb;
+    g_dtb_index.ready = 0;
+    return 0;
+}
+
+/*
+Zaokrągla rozmiar w górę do 8 bajtów – wyrównania, z jakim dtb_index_init przydziela tablice indeksu.
+*/
+static uint64_t index_align8(uint64_t size)
+{
+    return (size + 7ULL) & ~7ULL;
+}
+
+/*
+Rozmiar tablic indeksu dla podanych liczności, sumowany tak samo jak przydziały w dtb_index_init.
+*/
+static uint64_t dtb_index_bytes(int nodes, int compat, int windows)
+{
+    uint64_t phandle_slots = 2ULL * (uint64_t)nodes + 1ULL;
+    uint64_t compat_slots = 2ULL * (uint64_t)compat + 1ULL;
+    uint64_t bytes = 0;
+
+    bytes += index_align8((uint64_t)nodes * sizeof(dtb_node_t));
+    bytes += index_align8((uint64_t)nodes * sizeof(dtb_reg_ctx_t));
+    bytes += index_align8((uint64_t)windows * sizeof(dtb_window_t));
+    bytes += index_align8((uint64_t)compat * sizeof(const char *));
+    bytes += index_align8((uint64_t)compat * sizeof(uint32_t));
+    bytes += index_align8((uint64_t)compat * sizeof(dtb_compat_str_t));
+    bytes += index_align8((uint64_t)compat * sizeof(int));
+    bytes += index_align8(compat_slots * sizeof(uint32_t));
+    bytes += index_align8(phandle_slots * sizeof(dtb_phandle_slot_t));
+    return bytes;
+}
+
+/*
+Zwraca w *bytes, ile miejsca w arenie potrzebuje dtb_index_init dla bieżącego bloba
+(z zapasem na wyrównanie początku areny). Host-owe narzędzia przydzielają tyle przez malloc.
+*/
+int dtb_index_size(uint64_t *bytes)
+{
+    int nodes;
+    int compat;
+    int windows;
+    int err = dtb_require_init();
+    if (err)
+        return err;
+
+    if (!bytes)
+        return -FDT_ERR_BADVALUE;
+
+    err = dtb_index_count(&nodes, &compat, &windows);
+    if (err)
+        return err;
+
+    *bytes = dtb_index_bytes(nodes, compat, windows) + sizeof(uint64_t);
+    return 0;
+}
+
+/*
+Buduje indeks drzewa w arenie: pierwsze przejście (dtb_index_count) liczy węzły, wpisy compatible
+i okna ranges, potem tablice dostają z areny dokładnie tyle miejsca, a dtb_index_build wypełnia je
+drugim przejściem. Przydziały są trwałe – indeks żyje tak długo jak arena, więc w jądrze to
+memblock_alloc-owa część memblock, rezerwowana potem w mapie pamięci.
+Zwraca -FDT_ERR_NOSPACE, gdy arena jest za mała albo drzewo za głębokie; arena wraca wtedy do
+stanu sprzed wywołania, a moduł działa dalej na samym blobie, więc błąd nie musi być krytyczny.
+*/
+int dtb_index_init(dtb_arena_t *arena)
+{
+    uint64_t mark;
+    int nodes;
+    int compat;
+    int windows;
+    int err = dtb_require_init();
+    if (err)
+        return err;
+
+    if (!arena)
+        return -FDT_ERR_BADVALUE;
+
+    g_dtb_index.ready = 0;
+    err = dtb_index_count(&nodes, &compat, &windows);
+    if (err)
+        return err;
+
+    mark = arena->used;
+    g_dtb_index.node_cap = nodes;
+    g_dtb_index.compat_cap = compat;
+    g_dtb_index.window_cap = windows;
+    g_dtb_index.phandle_slots = 2u * (uint32_t)nodes + 1u;
+    g_dtb_index.compat_slots = 2u * (uint32_t)compat + 1u;
+
+    g_dtb_nodes = dtb_arena_alloc(arena, (uint64_t)nodes * sizeof(*g_dtb_nodes), 8);
+    g_dtb_reg_ctx = dtb_arena_alloc(arena, (uint64_t)nodes * sizeof(*g_dtb_reg_ctx), 8);
+    g_dtb_windows = dtb_arena_alloc(arena, (uint64_t)windows * sizeof(*g_dtb_windows), 8);
+    g_dtb_compat = dtb_arena_alloc(arena, (uint64_t)compat * sizeof(*g_dtb_compat), 8);
+    g_dtb_compat_ids = dtb_arena_alloc(arena, (uint64_t)compat * sizeof(*g_dtb_compat_ids), 8);
+    g_dtb_compat_strs = dtb_arena_alloc(arena, (uint64_t)compat * sizeof(*g_dtb_compat_strs), 8);
+    g_dtb_compat_nodes = dtb_arena_alloc(arena, (uint64_t)compat * sizeof(*g_dtb_compat_nodes), 8);
+    g_dtb_compat_slots = dtb_arena_alloc(arena, g_dtb_index.compat_slots * sizeof(*g_dtb_compat_slots), 8);
+    g_dtb_phandles = dtb_arena_alloc(arena, g_dtb_index.phandle_slots * sizeof(*g_dtb_phandles), 8);
+    if (!g_dtb_nodes || !g_dtb_reg_ctx || !g_dtb_windows || !g_dtb_compat || !g_dtb_compat_ids ||
+        !g_dtb_compat_strs || !g_dtb_compat_nodes || !g_dtb_compat_slots || !g_dtb_phandles) {
+        arena->used = mark;
+        return -FDT_ERR_NOSPACE;
+    }
+
+    err = dtb_index_build();
+    if (err) {
+        g_dtb_index.ready = 0;
+        arena->used = mark;
+        return err;
+    }
+
     return 0;
 }
 
@@ -427,7 +1560,7 @@ int dtb_node_addr_cells(int node, int *cells)
     if (!cells)
         return -FDT_ERR_BADVALUE;
 
-    *cells = fdt_address_cells(g_fdt, node);
+    *cells = node_addr_cells(node);
     return (*cells < 0) ? *cells : 0;
 }
 
@@ -443,7 +1576,7 @@ int dtb_node_size_cells(int node, int *cells)
     if (!cells)
         return -FDT_ERR_BADVALUE;
 
-    *cells = fdt_size_cells(g_fdt, node);
+    *cells = node_size_cells(node);
     return (*cells < 0) ? *cells : 0;
 }
 
@@ -462,17 +1595,20 @@ int dtb_decode_reg(int node, int index, uint64_t *base, uint64_t *size)
 }
 
 /*
-Tłumaczy adres dziecka (child_addr) na adres CPU przez przeszukanie właściwości ranges węzła node.
-Pobiera #address-cells dziecka i rodzica oraz #size-cells, żeby wiedzieć, jak podzielić każdy wpis ranges.
+Tłumaczy adres dziecka (child_addr) na adres w przestrzeni rodzica przez ranges węzła node (jeden poziom).
+Z indeksem ranges są już rozłożone na posortowane okna (windows_build), więc zostaje walidacja zapamiętana
+w win_err i wyszukiwanie binarne (windows_lookup).
+Bez indeksu pobiera #address-cells dziecka i rodzica oraz #size-cells, żeby wiedzieć, jak podzielić każdy wpis ranges,
+i iteruje po wpisach, szukając zakresu, w którym mieści się child_addr; gdy znajdzie, oblicza offset i dodaje go do adresu bazowego rodzica.
 Jeśli ranges nie istnieje lub jest puste, przyjmuje mapowanie 1:1 (child_addr = cpu_addr).
-Iteruje po wpisach ranges i szuka zakresu, w którym mieści się child_addr; gdy znajdzie, oblicza offset i dodaje go do adresu bazowego rodzica.
 Zwraca -FDT_ERR_NOTFOUND, jeśli żaden zakres nie pasuje, lub kody błędów libfdt przy problemach z odczytem właściwości.
 Używana przy dekodowaniu adresów urządzeń na magistralach z translacją adresów (np. PCI, simple-bus z ranges).
 */
-int dtb_translate_ranges(int node, uint64_t child_addr, uint64_t *cpu_addr)
+static int translate_one(int node, uint64_t child_addr, uint64_t *cpu_addr)
 {
+    const dtb_node_t *n;
+    dtb_reg_ctx_t ctx;
     int err;
-    int parent;
     int child_cells;
     int parent_cells;
     int size_cells;
@@ -482,33 +1618,40 @@ int dtb_translate_ranges(int node, uint64_t child_addr, uint64_t *cpu_addr)
     int entries;
     const fdt32_t *ranges;
 
-    err = dtb_require_init();
-    if (err)
-        return err;
+    n = index_node(node);
+    if (n) {
+        const dtb_reg_ctx_t *bus = &g_dtb_reg_ctx[n - g_dtb_nodes];
 
-    if (!cpu_addr)
-        return -FDT_ERR_BADVALUE;
+        if (bus->win_err)
+            return bus->win_err;
+        if (!bus->ranges || bus->ranges_len == 0) {
+            *cpu_addr = child_addr;
+            return 0;
+        }
+        return windows_lookup(bus, child_addr, cpu_addr);
+    }
 
-    parent = fdt_parent_offset(g_fdt, node);
-    if (parent < 0)
-        return parent;
+    err = node_reg_ctx(node, &ctx);
+    if (err)
+        return err;
 
-    child_cells = fdt_address_cells(g_fdt, node);
+    child_cells = node_addr_cells(node);
     if (child_cells < 0)
         return child_cells;
 
-    parent_cells = fdt_address_cells(g_fdt, parent);
+    parent_cells = ctx.parent_addr_cells;
     if (parent_cells < 0)
         return parent_cells;
 
-    size_cells = fdt_size_cells(g_fdt, node);
+    size_cells = node_size_cells(node);
     if (size_cells < 0)
         return size_cells;
 
     if (child_cells <= 0 || child_cells > 2 || parent_cells <= 0 || parent_cells > 2 || size_cells <= 0 || size_cells > 2)
         return -FDT_ERR_BADNCELLS;
 
-    ranges = fdt_getprop(g_fdt, node, "ranges", &len);
+    ranges = ctx.ranges;
+    len = ctx.ranges_len;
     if (!ranges) {
         if (len == -FDT_ERR_NOTFOUND) {
             *cpu_addr = child_addr;
@@ -541,137 +1684,435 @@ int dtb_translate_ranges(int node, uint64_t child_addr, uint64_t *cpu_addr)
         if (err)
             return err;
 
-        if (child_addr >= cbase && child_addr < (cbase + sz)) {
-            off = child_addr - cbase;
-            *cpu_addr = pbase + off;
-            return 0;
-        }
-    }
+        if (child_addr >= cbase && child_addr < (cbase + sz)) {
+            off = child_addr - cbase;
+            *cpu_addr = pbase + off;
+            return 0;
+        }
+    }
+
+    return -FDT_ERR_NOTFOUND;
+}
+
+/*
+Publiczna nakładka na translate_one: translacja przez ranges jednego poziomu (węzła node).
+*/
+int dtb_translate_ranges(int node, uint64_t child_addr, uint64_t *cpu_addr)
+{
+    int err = dtb_require_init();
+    if (err)
+        return err;
+
+    if (!cpu_addr)
+        return -FDT_ERR_BADVALUE;
+
+    return translate_one(node, child_addr, cpu_addr);
+}
+
+/*
+Pełna translacja adresu z reg węzła node (przestrzeń adresowa jego rodzica) do przestrzeni CPU.
+Idzie w górę od rodzica węzła aż do korzenia i na każdym poziomie tłumaczy adres przez ranges magistrali
+(translate_one – z indeksem wyszukiwanie binarne w oknach zbudowanych w dtb_index_init, bez parsowania właściwości).
+Magistrala bez ranges jest traktowana jak mapowanie 1:1, tak samo jak w dtb_translate_ranges.
+Zwraca -FDT_ERR_NOTFOUND, gdy adres wypada poza okna któregoś poziomu.
+*/
+int dtb_translate_reg(int node, uint64_t addr, uint64_t *cpu_addr)
+{
+    dtb_reg_ctx_t ctx;
+    int bus;
+    int err;
+
+    err = dtb_require_init();
+    if (err)
+        return err;
+
+    if (!cpu_addr)
+        return -FDT_ERR_BADVALUE;
+
+    err = node_reg_ctx(node, &ctx);
+    if (err)
+        return err;
+
+    for (bus = ctx.parent; bus >= 0; bus = ctx.parent) {
+        if (node_reg_ctx(bus, &ctx))
+            break;
+        err = translate_one(bus, addr, &addr);
+        if (err)
+            return err;
+    }
+
+    *cpu_addr = addr;
+    return 0;
+}
+
+/*
+dtb_decode_reg z adresem przetłumaczonym do przestrzeni CPU (dtb_translate_reg).
+Właściwa funkcja dla sterowników, które mapują rejestry urządzenia leżącego za zagnieżdżonymi magistralami.
+*/
+int dtb_decode_reg_cpu(int node, int index, uint64_t *base, uint64_t *size)
+{
+    int err = dtb_decode_reg(node, index, base, size);
+    if (err)
+        return err;
+    return dtb_translate_reg(node, *base, base);
+}
+
+/*
+Zwraca offset pierwszego węzła w drzewie DTB, który jest urządzeniem (ma compatible) i jest włączony (status != "disabled").
+Iteruje po wszystkich węzłach od korzenia (node_next – z indeksem kolejne elementy tablicy), sprawdzając node_is_device i node_is_enabled.
+Zapisuje offset do *node i zwraca 0 przy sukcesie, lub -FDT_ERR_NOTFOUND gdy nie ma żadnego pasującego węzła.
+Używana razem z dtb_device_next do iteracji po wszystkich urządzeniach w drzewie.
+*/
+int dtb_device_first(int *node)
+{
+    int err;
+    int off;
+
+    err = dtb_require_init();
+    if (err)
+        return err;
+
+    if (!node)
+        return -FDT_ERR_BADVALUE;
+
+    for (off = node_next(-1); off >= 0; off = node_next(off)) {
+        if (node_is_device(off) && node_is_enabled(off)) {
+            *node = off;
+            return 0;
+        }
+    }
+
+    return -FDT_ERR_NOTFOUND;
+}
+
+/*
+Zwraca offset kolejnego węzła urządzenia po węźle wskazanym przez *node.
+Kontynuuje iterację (node_next) od bieżącego węzła, szukając następnego, który spełnia node_is_device i node_is_enabled.
+Iteracja nie śledzi głębokości, więc nie kończy się po wyjściu z poddrzewa bieżącego węzła (wcześniej fdt_next_node z depth = 0 zatrzymywał się na pierwszym liściu).
+Aktualizuje *node i zwraca 0 przy sukcesie, lub -FDT_ERR_NOTFOUND gdy nie ma więcej pasujących węzłów.
+Używana w pętli razem z dtb_device_first do przeglądania wszystkich urządzeń w drzewie DTB.
+*/
+int dtb_device_next(int *node)
+{
+    int err;
+    int off;
+
+    err = dtb_require_init();
+    if (err)
+        return err;
+
+    if (!node)
+        return -FDT_ERR_BADVALUE;
+
+    for (off = node_next(*node); off >= 0; off = node_next(off)) {
+        if (node_is_device(off) && node_is_enabled(off)) {
+            *node = off;
+            return 0;
+        }
+    }
+
+    return -FDT_ERR_NOTFOUND;
+}
+
+/*
+Rozkłada właściwość interrupts węzła node na rekordy dtb_irq_t (numer przerwania, phandle kontrolera, liczba komórek).
+has_parent/parent_phandle to rozwiązany interrupt-parent; bez niego każde przerwanie ma 1 komórkę i parent_phandle 0.
+Zapisuje co najwyżej cap rekordów do arr i ich liczbę do *count; zwraca łączną liczbę przerwań w węźle,
+więc wywołanie z cap = 0 służy do policzenia, ile miejsca potrzeba.
+*/
+static int decode_irq_list(int node, int has_parent, uint32_t parent_phandle,
+                           dtb_irq_t *arr, int cap, int *count)
+{
+    int irq_cells = 1;
+    int groups = 0;
+    int len;
+    const fdt32_t *intr;
+
+    *count = 0;
+
+    if (!has_parent)
+        parent_phandle = 0;
+    else
+        get_interrupt_cells_for_parent(parent_phandle, &irq_cells);
+
+    intr = fdt_getprop(g_fdt, node, "interrupts", &len);
+    if (intr && len > 0) {
+        int cells = len / (int)sizeof(fdt32_t);
+        int i;
+
+        groups = (irq_cells > 0) ? (cells / irq_cells) : 0;
+        *count = min_int(groups, cap);
+        for (i = 0; i < *count; i++) {
+            arr[i].irq = fdt32_to_cpu(intr[i * irq_cells]);
+            arr[i].parent_phandle = parent_phandle;
+            arr[i].cells = (uint32_t)irq_cells;
+        }
+    }
+
+    return groups;
+}
+
+/*
+Uzupełnia w out część opisu urządzenia niezależną od reg: przerwania i listy referencji clocks, resets, dmas, gpios.
+has_parent/parent_phandle to rozwiązany interrupt-parent węzła; bez niego przerwania mają po 1 komórce i parent_phandle 0.
+Przerwania są grupowane według #interrupt-cells kontrolera; każdy rekord irqs[] zawiera numer przerwania, phandle kontrolera i liczbę komórek.
+Wspólna dla dtb_device_read i dtb_devices_collect.
+*/
+static void device_fill_irqs_refs(int node, int has_parent, uint32_t parent_phandle, dtb_device_t *out)
+{
+    decode_irq_list(node, has_parent, parent_phandle, out->irqs, DTB_MAX_IRQS, &out->irq_count);
+
+    read_ref_list(node, "clocks", out->clocks, DTB_MAX_REFS, &out->clock_count);
+    read_ref_list(node, "resets", out->resets, DTB_MAX_REFS, &out->reset_count);
+    read_ref_list(node, "dmas", out->dmas, DTB_MAX_REFS, &out->dma_count);
+    read_ref_list(node, "gpios", out->gpios, DTB_MAX_REFS, &out->gpio_count);
+}
+
+/*
+Wypełnia strukturę dtb_device_t danymi z węzła node: nazwę, pierwszy ciąg compatible, listę regionów MMIO (reg), przerwania (interrupts) z uwzględnieniem #interrupt-cells kontrolera nadrzędnego, oraz listy referencji clocks, resets, dmas, gpios.
+Zeruje strukturę przed wypełnieniem, żeby nieużywane pola były zawsze zerem.
+Przerwania są grupowane według irq_cells pobranego z interrupt-parent; każdy rekord irqs[] zawiera numer przerwania, phandle kontrolera i liczbę komórek.
+Zwraca 0 przy sukcesie lub kod błędu libfdt, jeśli inicjalizacja nie była wykonana albo out jest NULL.
+Używana przez dtb_interrupt_map_device i bezpośrednio przez kod jądra do odczytu pełnego opisu urządzenia.
+*/
+int dtb_device_read(int node, dtb_device_t *out)
+{
+    int err;
+    uint32_t parent_phandle = 0;
+    int has_parent;
+
+    err = dtb_require_init();
+    if (err)
+        return err;
+
+    if (!out)
+        return -FDT_ERR_BADVALUE;
+
+    memset(out, 0, sizeof(*out));
+    out->node = node;
+    out->name = node_name(node);
+    out->compatible = first_compat(node);
+
+    err = decode_reg_list(node, out->regs, DTB_MAX_REGS, &out->reg_count);
+    if (err && err != -FDT_ERR_NOSPACE)
+        return err;
+
+    has_parent = (get_interrupt_parent(node, &parent_phandle) == 0);
+    device_fill_irqs_refs(node, has_parent, parent_phandle, out);
 
-    return -FDT_ERR_NOTFOUND;
+    return 0;
 }
 
 /*
-Zwraca offset pierwszego węzła w drzewie DTB, który jest urządzeniem (ma compatible) i jest włączony (status != "disabled").
-Iteruje po wszystkich węzłach od korzenia przez fdt_next_node, sprawdzając node_is_device i node_is_enabled.
-Zapisuje offset do *node i zwraca 0 przy sukcesie, lub -FDT_ERR_NOTFOUND gdy nie ma żadnego pasującego węzła.
-Używana razem z dtb_device_next do iteracji po wszystkich urządzeniach w drzewie.
+Przygotowuje arenę typu bump nad buforem [base, base + size). Arena nie ma zwalniania pojedynczych
+obiektów – cała zawartość żyje tyle, co bufor; reset to ponowne dtb_arena_init.
 */
-int dtb_device_first(int *node)
+void dtb_arena_init(dtb_arena_t *arena, void *base, uint64_t size)
 {
-    int err;
-    int depth = -1;
-    int off;
+    if (!arena)
+        return;
 
-    err = dtb_require_init();
-    if (err)
-        return err;
+    arena->base = (uint8_t *)base;
+    arena->size = base ? size : 0;
+    arena->used = 0;
+}
 
-    if (!node)
-        return -FDT_ERR_BADVALUE;
+/*
+Przydziela size bajtów wyrównanych do align (potęga dwójki, 0 → 1) z areny.
+Zwraca 0, gdy w arenie brakuje miejsca; stan areny nie zmienia się wtedy.
+*/
+void *dtb_arena_alloc(dtb_arena_t *arena, uint64_t size, uint64_t align)
+{
+    uintptr_t base;
+    uint64_t start;
 
-    off = fdt_next_node(g_fdt, -1, &depth);
-    while (off >= 0) {
-        if (node_is_device(off) && node_is_enabled(off)) {
-            *node = off;
-            return 0;
-        }
-        off = fdt_next_node(g_fdt, off, &depth);
-    }
+    if (!arena || !arena->base)
+        return 0;
+    if (!align)
+        align = 1;
 
-    return -FDT_ERR_NOTFOUND;
+    base = (uintptr_t)arena->base;
+    start = ((base + arena->used + (align - 1)) & ~(uint64_t)(align - 1)) - base;
+    if (start > arena->size || size > arena->size - start)
+        return 0;
+
+    arena->used = start + size;
+    return arena->base + start;
 }
 
 /*
-Zwraca offset kolejnego węzła urządzenia po węźle wskazanym przez *node.
-Kontynuuje iterację przez fdt_next_node od bieżącego węzła, szukając następnego, który spełnia node_is_device i node_is_enabled.
-Aktualizuje *node i zwraca 0 przy sukcesie, lub -FDT_ERR_NOTFOUND gdy nie ma więcej pasujących węzłów.
-Używana w pętli razem z dtb_device_first do przeglądania wszystkich urządzeń w drzewie DTB.
+Zbiera wszystkie włączone urządzenia (węzły z compatible i status != "disabled") jednym przejściem fdt_next_node.
+Stos rodziców trzyma dla każdego poziomu #address-cells/#size-cells i odziedziczony interrupt-parent,
+więc reg każdego węzła jest dekodowany przez decode_reg_cells bez szukania rodzica, a przerwania bez wędrówki w górę.
+Rekordy dtb_device_t są układane w arenie jeden za drugim; *devices wskazuje pierwszy, *count to ich liczba.
+Węzeł z niepoprawnym reg (np. złe #address-cells rodzica) trafia do wyniku z reg_count = 0.
+Zwraca -FDT_ERR_NOSPACE, gdy arena się skończy albo drzewo jest głębsze niż DTB_INDEX_MAX_DEPTH – wtedy
+*devices i *count opisują rekordy zebrane do tego miejsca, a resztę można dociągnąć przez dtb_device_next/dtb_device_read.
 */
-int dtb_device_next(int *node)
+int dtb_devices_collect(dtb_arena_t *arena, dtb_device_t **devices, int *count)
 {
-    int err;
-    int depth = 0;
+    struct {
+        int addr_cells;
+        int size_cells;
+        int has_iparent;
+        uint32_t iparent;
+    } stack[DTB_INDEX_MAX_DEPTH];
+    dtb_device_t *out;
+    int depth = -1;
+    int n = 0;
     int off;
+    int err;
 
     err = dtb_require_init();
     if (err)
         return err;
 
-    if (!node)
+    if (!arena || !devices || !count)
         return -FDT_ERR_BADVALUE;
 
-    off = fdt_next_node(g_fdt, *node, &depth);
-    while (off >= 0) {
-        if (node_is_device(off) && node_is_enabled(off)) {
-            *node = off;
-            return 0;
+    out = dtb_arena_alloc(arena, 0, sizeof(uint64_t));
+    if (!out)
+        return -FDT_ERR_NOSPACE;
+    *devices = out;
+    *count = 0;
+
+    for (off = fdt_next_node(g_fdt, -1, &depth);
+         off >= 0;
+         off = fdt_next_node(g_fdt, off, &depth)) {
+        uint32_t iparent;
+        dtb_device_t *dev;
+
+        if (depth >= DTB_INDEX_MAX_DEPTH)
+            return -FDT_ERR_NOSPACE;
+
+        stack[depth].addr_cells = node_addr_cells(off);
+        stack[depth].size_cells = node_size_cells(off);
+        if (get_u32_prop(off, "interrupt-parent", &iparent) == 0) {
+            stack[depth].has_iparent = 1;
+            stack[depth].iparent = iparent;
+        } else if (depth > 0) {
+            stack[depth].has_iparent = stack[depth - 1].has_iparent;
+            stack[depth].iparent = stack[depth - 1].iparent;
+        } else {
+            stack[depth].has_iparent = 0;
+            stack[depth].iparent = 0;
+        }
+
+        if (!node_is_device(off) || !node_is_enabled(off))
+            continue;
+
+        dev = dtb_arena_alloc(arena, sizeof(*dev), sizeof(uint64_t));
+        if (!dev)
+            return -FDT_ERR_NOSPACE;
+
+        memset(dev, 0, sizeof(*dev));
+        dev->node = off;
+        dev->name = node_name(off);
+        dev->compatible = first_compat(off);
+
+        if (depth > 0) {
+            const fdt32_t *reg;
+            int len;
+
+            reg = node_reg_prop(off, &len);
+            err = decode_reg_cells(reg, len, stack[depth - 1].addr_cells, stack[depth - 1].size_cells,
+                                   dev->regs, DTB_MAX_REGS, &dev->reg_count);
+            if (err && err != -FDT_ERR_NOSPACE)
+                dev->reg_count = 0;
         }
-        off = fdt_next_node(g_fdt, off, &depth);
+
+        device_fill_irqs_refs(off, stack[depth].has_iparent, stack[depth].iparent, dev);
+        *count = ++n;
     }
 
-    return -FDT_ERR_NOTFOUND;
+    if (off != -FDT_ERR_NOTFOUND)
+        return off;
+
+    return 0;
 }
 
 /*
-Wypełnia strukturę dtb_device_t danymi z węzła node: nazwę, pierwszy ciąg compatible, listę regionów MMIO (reg), przerwania (interrupts) z uwzględnieniem #interrupt-cells kontrolera nadrzędnego, oraz listy referencji clocks, resets, dmas, gpios.
-Zeruje strukturę przed wypełnieniem, żeby nieużywane pola były zawsze zerem.
-Przerwania są grupowane według irq_cells pobranego z interrupt-parent; każdy rekord irqs[] zawiera numer przerwania, phandle kontrolera i liczbę komórek.
-Zwraca 0 przy sukcesie lub kod błędu libfdt, jeśli inicjalizacja nie była wykonana albo out jest NULL.
-Używana przez dtb_interrupt_map_device i bezpośrednio przez kod jądra do odczytu pełnego opisu urządzenia.
+Przydziela z areny tablicę count elementów po size bajtów (count == 0 → wskaźnik 0, bez przydziału).
+Zwraca 0 przy sukcesie lub -FDT_ERR_NOSPACE, gdy arena jest pełna.
 */
-int dtb_device_read(int node, dtb_device_t *out)
+static int arena_array(dtb_arena_t *arena, int count, uint64_t size, void **out)
+{
+    *out = 0;
+    if (count <= 0)
+        return 0;
+
+    *out = dtb_arena_alloc(arena, (uint64_t)count * size, sizeof(uint64_t));
+    return *out ? 0 : -FDT_ERR_NOSPACE;
+}
+
+/*
+Odpowiednik dtb_device_read bez limitów DTB_MAX_*: najpierw liczy wpisy reg, przerwania i referencje węzła,
+potem przydziela z areny tablice dokładnie tej długości i wypełnia je. out zawiera tylko wskaźniki i liczniki,
+więc jest mały i nic się nie obcina. Zwraca -FDT_ERR_NOSPACE, gdy arena się skończy (out jest wtedy niepełne).
+*/
+int dtb_device_read_alloc(dtb_arena_t *arena, int node, dtb_device_dyn_t *out)
 {
-    int err;
     uint32_t parent_phandle = 0;
-    int irq_cells = 1;
-    int len;
-    const fdt32_t *intr;
+    int has_parent;
+    int reg_cap;
+    int irq_cap;
+    int err;
 
     err = dtb_require_init();
     if (err)
         return err;
 
-    if (!out)
+    if (!arena || !out)
         return -FDT_ERR_BADVALUE;
 
     memset(out, 0, sizeof(*out));
     out->node = node;
-    out->name = fdt_get_name(g_fdt, node, 0);
+    out->name = node_name(node);
     out->compatible = first_compat(node);
 
-    err = decode_reg_list(node, out->regs, DTB_MAX_REGS, &out->reg_count);
-    if (err && err != -FDT_ERR_NOSPACE)
+    reg_cap = reg_entry_count(node);
+    err = arena_array(arena, reg_cap, sizeof(dtb_addr_t), (void **)&out->regs);
+    if (err)
         return err;
+    if (reg_cap) {
+        err = decode_reg_list(node, out->regs, reg_cap, &out->reg_count);
+        if (err)
+            return err;
+    }
 
-    if (get_interrupt_parent(node, &parent_phandle) == 0)
-        get_interrupt_cells_for_parent(parent_phandle, &irq_cells);
+    has_parent = (get_interrupt_parent(node, &parent_phandle) == 0);
+    irq_cap = decode_irq_list(node, has_parent, parent_phandle, 0, 0, &out->irq_count);
+    err = arena_array(arena, irq_cap, sizeof(dtb_irq_t), (void **)&out->irqs);
+    if (err)
+        return err;
+    decode_irq_list(node, has_parent, parent_phandle, out->irqs, irq_cap, &out->irq_count);
 
-    intr = fdt_getprop(g_fdt, node, "interrupts", &len);
-    if (intr && len > 0) {
-        int cells = len / (int)sizeof(fdt32_t);
-        int groups = (irq_cells > 0) ? (cells / irq_cells) : 0;
-        int i;
+    out->clock_count = prop_cell_count(node, "clocks");
+    out->reset_count = prop_cell_count(node, "resets");
+    out->dma_count = prop_cell_count(node, "dmas");
+    out->gpio_count = prop_cell_count(node, "gpios");
 
-        out->irq_count = min_int(groups, DTB_MAX_IRQS);
-        for (i = 0; i < out->irq_count; i++) {
-            out->irqs[i].irq = fdt32_to_cpu(intr[i * irq_cells]);
-            out->irqs[i].parent_phandle = parent_phandle;
-            out->irqs[i].cells = (uint32_t)irq_cells;
-        }
-    }
+    if (arena_array(arena, out->clock_count, sizeof(uint32_t), (void **)&out->clocks) ||
+        arena_array(arena, out->reset_count, sizeof(uint32_t), (void **)&out->resets) ||
+        arena_array(arena, out->dma_count, sizeof(uint32_t), (void **)&out->dmas) ||
+        arena_array(arena, out->gpio_count, sizeof(uint32_t), (void **)&out->gpios))
+        return -FDT_ERR_NOSPACE;
 
-    read_ref_list(node, "clocks", out->clocks, DTB_MAX_REFS, &out->clock_count);
-    read_ref_list(node, "resets", out->resets, DTB_MAX_REFS, &out->reset_count);
-    read_ref_list(node, "dmas", out->dmas, DTB_MAX_REFS, &out->dma_count);
-    read_ref_list(node, "gpios", out->gpios, DTB_MAX_REFS, &out->gpio_count);
+    if (out->clocks)
+        read_ref_list(node, "clocks", out->clocks, out->clock_count, &out->clock_count);
+    if (out->resets)
+        read_ref_list(node, "resets", out->resets, out->reset_count, &out->reset_count);
+    if (out->dmas)
+        read_ref_list(node, "dmas", out->dmas, out->dma_count, &out->dma_count);
+    if (out->gpios)
+        read_ref_list(node, "gpios", out->gpios, out->gpio_count, &out->gpio_count);
 
     return 0;
 }
 
 /*
 Wyszukuje pierwszy węzeł w drzewie DTB, którego lista compatible zawiera dokładnie ciąg compat.
-Używa fdt_node_offset_by_compatible zaczynając od korzenia (-1).
+Używa node_find_compatible zaczynając od korzenia (-1), czyli z indeksem nie dotyka bloba.
 Zapisuje offset do *node i zwraca 0 przy sukcesie, lub kod błędu libfdt (np. -FDT_ERR_NOTFOUND) gdy węzeł nie istnieje.
 Używana do szybkiego lokalizowania konkretnego urządzenia po jego identyfikatorze compatible.
 */
@@ -687,7 +2128,7 @@ int dtb_find_compatible(const char *compat, int *node)
     if (!compat || !node)
         return -FDT_ERR_BADVALUE;
 
-    off = fdt_node_offset_by_compatible(g_fdt, -1, compat);
+    off = node_find_compatible(-1, compat);
     if (off < 0)
         return off;
 
@@ -713,7 +2154,73 @@ int dtb_find_compatible_n(const char *compat, int start_node, int *node)
     if (!compat || !node)
         return -FDT_ERR_BADVALUE;
 
-    off = fdt_node_offset_by_compatible(g_fdt, start_node, compat);
+    off = node_find_compatible(start_node, compat);
+    if (off < 0)
+        return off;
+
+    *node = off;
+    return 0;
+}
+
+/*
+Zamienia ciąg compatible na jego internowane id nadane w dtb_index_init.
+Sterownik robi to raz (np. przy rejestracji), a potem dopasowuje węzły przez dtb_find_compatible_id,
+bez porównywania ciągów. Zwraca -FDT_ERR_NOTFOUND, gdy żaden węzeł nie deklaruje compat,
+oraz -FDT_ERR_NOSPACE, gdy indeks nie został zbudowany (brak dtb_index_init albo za mała arena) –
+wtedy trzeba użyć dtb_find_compatible_n.
+*/
+int dtb_compat_id(const char *compat, int *id)
+{
+    int cid;
+    int err = dtb_require_init();
+    if (err)
+        return err;
+
+    if (!compat || !id)
+        return -FDT_ERR_BADVALUE;
+
+    if (!g_dtb_index.ready)
+        return -FDT_ERR_NOSPACE;
+
+    cid = compat_lookup(compat);
+    if (cid < 0)
+        return -FDT_ERR_NOTFOUND;
+
+    *id = cid;
+    return 0;
+}
+
+/*
+Szybka ścieżka dopasowania sterowników: zwraca w *node następny po start_node (start_node < 0 → od początku)
+włączony węzeł (status != "disabled"), który ma w compatible ciąg o danym id z dtb_compat_id.
+Lista węzłów każdego id jest posortowana po offsecie, więc start jest wyszukiwaniem binarnym,
+a kolejne wywołania z poprzednim wynikiem przechodzą po liście bez skanowania drzewa.
+W przeciwieństwie do dtb_find_compatible_n pomija węzły wyłączone.
+*/
+int dtb_find_compatible_id(int id, int start_node, int *node)
+{
+    const dtb_node_t *start = 0;
+    int off;
+    int err = dtb_require_init();
+    if (err)
+        return err;
+
+    if (!node)
+        return -FDT_ERR_BADVALUE;
+
+    if (!g_dtb_index.ready)
+        return -FDT_ERR_NOSPACE;
+
+    if (id < 0 || id >= g_dtb_index.compat_ids)
+        return -FDT_ERR_BADVALUE;
+
+    if (start_node >= 0) {
+        start = index_node(start_node);
+        if (!start)
+            return -FDT_ERR_BADOFFSET;
+    }
+
+    off = compat_list_next(id, start ? (int)(start - g_dtb_nodes) : -1, 1);
     if (off < 0)
         return off;
 
@@ -739,7 +2246,7 @@ int dtb_interrupt_controller_read(int node, dtb_intc_t *out)
     if (!out)
         return -FDT_ERR_BADVALUE;
 
-    if (!prop_exists(node, "interrupt-controller"))
+    if (!node_is_intc(node))
         return -FDT_ERR_NOTFOUND;
 
     memset(out, 0, sizeof(*out));
@@ -765,14 +2272,13 @@ int dtb_interrupt_controller_read(int node, dtb_intc_t *out)
 
 /*
 Skanuje całe drzewo DTB i zbiera wszystkie węzły z właściwością interrupt-controller do tablicy arr.
-Iteruje przez fdt_next_node i dla każdego pasującego węzła wywołuje dtb_interrupt_controller_read.
+Iteruje po węzłach (node_next) i dla każdego pasującego węzła wywołuje dtb_interrupt_controller_read.
 Ogranicza liczbę wpisów do cap przez min_int; gdy jest ich więcej, zwraca -FDT_ERR_NOSPACE.
 Używana przy inicjalizacji systemu przerwań, żeby wykryć i skatalogować wszystkie dostępne kontrolery.
 */
 int dtb_interrupt_controllers_scan(dtb_intc_t *arr, int cap, int *count)
 {
     int err;
-    int depth = -1;
     int off;
     int n = 0;
 
@@ -783,14 +2289,12 @@ int dtb_interrupt_controllers_scan(dtb_intc_t *arr, int cap, int *count)
     if (!arr || !count || cap < 0)
         return -FDT_ERR_BADVALUE;
 
-    off = fdt_next_node(g_fdt, -1, &depth);
-    while (off >= 0) {
-        if (prop_exists(off, "interrupt-controller")) {
+    for (off = node_next(-1); off >= 0; off = node_next(off)) {
+        if (node_is_intc(off)) {
             if (n < cap)
                 dtb_interrupt_controller_read(off, &arr[n]);
             n++;
         }
-        off = fdt_next_node(g_fdt, off, &depth);
     }
 
     *count = min_int(n, cap);
@@ -831,7 +2335,7 @@ int dtb_interrupt_map_device(int dev_node, dtb_irq_t *arr, int cap, int *count)
 
 /*
 Przeszukuje drzewo DTB w poszukiwaniu pierwszego węzła pasującego do któregokolwiek z ciągów w tablicy compat (o długości compat_count).
-Iteruje po liście compatible i wywołuje fdt_node_offset_by_compatible dla każdego; przy pierwszym trafieniu zapisuje offset do *node i zwraca 0.
+Iteruje po liście compatible i wywołuje node_find_compatible dla każdego; przy pierwszym trafieniu zapisuje offset do *node i zwraca 0.
 Jeśli żaden ciąg nie pasuje, zwraca -FDT_ERR_NOTFOUND.
 Używana przez dtb_detect_plic, dtb_detect_clint, dtb_detect_imsic i dtb_get_timer_node, żeby obsłużyć wiele możliwych nazw compatible dla tego samego typu urządzenia.
 */
@@ -839,7 +2343,7 @@ static int find_any_compatible(const char **compat, int compat_count, int *node)
 {
     int i;
     for (i = 0; i < compat_count; i++) {
-        int off = fdt_node_offset_by_compatible(g_fdt, -1, compat[i]);
+        int off = node_find_compatible(-1, compat[i]);
         if (off >= 0) {
             *node = off;
             return 0;
@@ -916,7 +2420,7 @@ int dtb_get_timebase(uint32_t *timebase)
     if (!timebase)
         return -FDT_ERR_BADVALUE;
 
-    cpus = fdt_path_offset(g_fdt, "/cpus");
+    cpus = root_child(g_dtb_index.cpus, "/cpus");
     if (cpus < 0)
         return cpus;
 
@@ -1012,6 +2516,100 @@ int dtb_get_device_clocks(int node, uint32_t *clks, int cap, int *count)
     return read_ref_list(node, "clocks", clks, cap, count);
 }
 
+/*
+Zwraca w *node offset węzła o podanym phandle.
+Z indeksem to jedno zapytanie do tablicy haszującej budowanej w dtb_index_init, więc koszt nie zależy od rozmiaru drzewa.
+Zwraca 0 przy sukcesie, -FDT_ERR_NOTFOUND gdy phandle nie istnieje, -FDT_ERR_BADPHANDLE dla 0 i 0xffffffff.
+Używana przez sterowniki do rozwiązywania referencji (interrupt-parent, clocks, resets, dmas) na węzły dostawców.
+*/
+int dtb_node_by_phandle(uint32_t phandle, int *node)
+{
+    int off;
+    int err = dtb_require_init();
+    if (err)
+        return err;
+
+    if (!node)
+        return -FDT_ERR_BADVALUE;
+
+    off = find_node_by_phandle(phandle);
+    if (off < 0)
+        return off;
+
+    *node = off;
+    return 0;
+}
+
+/*
+Rozkłada index-ty wpis listy referencji list_name (np. "clocks", "resets", "dmas") węzła node na phandle, węzeł dostawcy i argumenty.
+Liczbę argumentów każdego wpisu bierze z właściwości cells_name dostawcy (np. "#clock-cells"); cells_name == 0 oznacza wpisy bez argumentów.
+Każdy wpis przed szukanym wymaga rozwiązania phandle, dlatego korzysta z tablicy haszującej (find_node_by_phandle) zamiast skanować blob.
+phandle 0 to pusty wpis (bez argumentów) – przy trafieniu w niego zwraca -FDT_ERR_NOTFOUND.
+Zwraca -FDT_ERR_NOSPACE, gdy wpis ma więcej niż DTB_MAX_PHANDLE_ARGS argumentów, -FDT_ERR_BADVALUE dla uciętej listy.
+*/
+int dtb_parse_phandle_with_args(int node, const char *list_name, const char *cells_name,
+                                int index, dtb_phandle_args_t *out)
+{
+    int err;
+    int len;
+    int cells;
+    int pos = 0;
+    int cur = 0;
+    const fdt32_t *list;
+
+    err = dtb_require_init();
+    if (err)
+        return err;
+
+    if (!list_name || !out || index < 0)
+        return -FDT_ERR_BADVALUE;
+
+    list = fdt_getprop(g_fdt, node, list_name, &len);
+    if (!list)
+        return len;
+
+    cells = len / (int)sizeof(fdt32_t);
+    while (pos < cells) {
+        uint32_t phandle = fdt32_to_cpu(list[pos++]);
+        uint32_t nargs = 0;
+        int provider = -1;
+        uint32_t i;
+
+        if (phandle) {
+            provider = find_node_by_phandle(phandle);
+            if (provider < 0)
+                return provider;
+            if (cells_name) {
+                err = get_u32_prop(provider, cells_name, &nargs);
+                if (err)
+                    return err;
+            }
+        }
+
+        if (nargs > (uint32_t)(cells - pos))
+            return -FDT_ERR_BADVALUE;
+
+        if (cur == index) {
+            if (!phandle)
+                return -FDT_ERR_NOTFOUND;
+            if (nargs > DTB_MAX_PHANDLE_ARGS)
+                return -FDT_ERR_NOSPACE;
+
+            out->node = provider;
+            out->phandle = phandle;
+            out->args_count = nargs;
+            for (i = 0; i < nargs; i++)
+                out->args[i] = fdt32_to_cpu(list[pos + (int)i]);
+            return 0;
+        }
+
+        pos += (int)nargs;
+        cur++;
+    }
+
+    return -FDT_ERR_NOTFOUND;
+}
+
 /*
 Wyszukuje węzeł timera RISC-V w drzewie DTB, sprawdzając compatible "riscv,timer" lub "riscv,clint0".
 Zapisuje offset węzła do *node i zwraca 0 przy sukcesie, lub -FDT_ERR_NOTFOUND gdy żaden timer nie istnieje.
@@ -1052,13 +2650,13 @@ int dtb_get_cpu_count(int *count)
     if (!count)
         return -FDT_ERR_BADVALUE;
 
-    cpus = fdt_path_offset(g_fdt, "/cpus");
+    cpus = root_child(g_dtb_index.cpus, "/cpus");
     if (cpus < 0)
         return cpus;
 
-    for (off = fdt_first_subnode(g_fdt, cpus);
+    for (off = node_first_child(cpus);
          off >= 0;
-         off = fdt_next_subnode(g_fdt, off)) {
+         off = node_next_sibling(off)) {
         if (!node_is_cpu(off))
             continue;
         if (!node_is_enabled(off))
@@ -1132,13 +2730,13 @@ int dtb_cpu_list(dtb_cpu_t *arr, int cap, int *count)
     if (!arr || !count || cap < 0)
         return -FDT_ERR_BADVALUE;
 
-    cpus = fdt_path_offset(g_fdt, "/cpus");
+    cpus = root_child(g_dtb_index.cpus, "/cpus");
     if (cpus < 0)
         return cpus;
 
-    for (off = fdt_first_subnode(g_fdt, cpus);
+    for (off = node_first_child(cpus);
          off >= 0;
-         off = fdt_next_subnode(g_fdt, off)) {
+         off = node_next_sibling(off)) {
         if (!node_is_cpu(off))
             continue;
         if (!node_is_enabled(off))
@@ -1156,6 +2754,60 @@ int dtb_cpu_list(dtb_cpu_t *arr, int cap, int *count)
     return (n > cap) ? -FDT_ERR_NOSPACE : 0;
 }
 
+/*
+Wariant dtb_cpu_list bez limitu DTB_MAX_CPUS: liczy aktywne rdzenie (dtb_get_cpu_count), przydziela z areny
+tablicę dokładnie na tyle wpisów i wypełnia ją przez dtb_cpu_list. *arr wskazuje tablicę w arenie.
+Zwraca -FDT_ERR_NOSPACE, gdy arena jest za mała.
+*/
+int dtb_cpu_list_alloc(dtb_arena_t *arena, dtb_cpu_t **arr, int *count)
+{
+    int err;
+    int n = 0;
+
+    err = dtb_require_init();
+    if (err)
+        return err;
+
+    if (!arena || !arr || !count)
+        return -FDT_ERR_BADVALUE;
+
+    err = dtb_get_cpu_count(&n);
+    if (err)
+        return err;
+
+    err = arena_array(arena, n, sizeof(dtb_cpu_t), (void **)arr);
+    if (err)
+        return err;
+
+    *count = 0;
+    if (!n)
+        return 0;
+
+    return dtb_cpu_list(*arr, n, count);
+}
+
+/*
+Sprawdza, czy riscv,isa rdzenia zawiera rozszerzenie wieloliterowe (np. "svnapot"): całe słowo między '_' a kolejnym '_' albo końcem napisu.
+Nazwa musi być podana małymi literami, tak jak w riscv,isa. Brak cpu albo riscv,isa daje 0.
+Używana przez kod stronicowania i TLB do wykrywania Svnapot, Svpbmt i Svinval.
+*/
+int dtb_cpu_has_ext(const dtb_cpu_t *cpu, const char *ext)
+{
+    size_t len;
+    const char *p;
+
+    if (!cpu || !cpu->riscv_isa || !ext)
+        return 0;
+
+    len = strlen(ext);
+    for (p = strchr(cpu->riscv_isa, '_'); p; p = strchr(p + 1, '_')) {
+        if (strncmp(p + 1, ext, len) == 0 && (p[len + 1] == '_' || p[len + 1] == '\0'))
+            return 1;
+    }
+
+    return 0;
+}
+
 /*
 Wyszukuje węzeł CPU o podanym hartid w węźle /cpus drzewa DTB.
 Iteruje po podwęzłach /cpus, sprawdzając node_is_cpu i odczytując reg przez decode_reg_entry_with_parent; gdy reg pasuje do hartid, zapisuje offset do *cpu_node.
@@ -1175,13 +2827,13 @@ int dtb_cpu_find_hart(uint32_t hartid, int *cpu_node)
     if (!cpu_node)
         return -FDT_ERR_BADVALUE;
 
-    cpus = fdt_path_offset(g_fdt, "/cpus");
+    cpus = root_child(g_dtb_index.cpus, "/cpus");
     if (cpus < 0)
         return cpus;
 
-    for (off = fdt_first_subnode(g_fdt, cpus);
+    for (off = node_first_child(cpus);
          off >= 0;
-         off = fdt_next_subnode(g_fdt, off)) {
+         off = node_next_sibling(off)) {
         uint64_t reg;
         uint64_t dummy_size;
 
@@ -1230,14 +2882,13 @@ int dtb_get_memory(uint64_t *base, uint64_t *size)
 
 /*
 Zbiera wszystkie regiony pamięci z węzłów o device_type = "memory" w drzewie DTB.
-Iteruje przez fdt_next_node, szukając węzłów pamięci, i dla każdego wywołuje decode_reg_list, żeby odczytać wszystkie zakresy adresowe.
+Iteruje po węzłach (node_next), szukając węzłów pamięci (node_is_memory), i dla każdego wywołuje decode_reg_list, żeby odczytać wszystkie zakresy adresowe.
 Ogranicza liczbę wpisów do cap; gdy jest ich więcej, zwraca -FDT_ERR_NOSPACE.
 Używana przez dtb_get_memory i dtb_memory_total, a także bezpośrednio przez kod zarządzania pamięcią.
 */
 int dtb_memory_regions(dtb_addr_t *arr, int cap, int *count)
 {
     int err;
-    int depth = -1;
     int off;
     int n = 0;
 
@@ -1248,11 +2899,8 @@ int dtb_memory_regions(dtb_addr_t *arr, int cap, int *count)
     if (!arr || !count || cap < 0)
         return -FDT_ERR_BADVALUE;
 
-    off = fdt_next_node(g_fdt, -1, &depth);
-    while (off >= 0) {
-        int len;
-        const char *dtype = fdt_getprop(g_fdt, off, "device_type", &len);
-        if (dtype && strcmp(dtype, "memory") == 0) {
+    for (off = node_next(-1); off >= 0; off = node_next(off)) {
+        if (node_is_memory(off)) {
             dtb_addr_t regs[DTB_MAX_REGS];
             int reg_count = 0;
             int i;
@@ -1266,13 +2914,56 @@ int dtb_memory_regions(dtb_addr_t *arr, int cap, int *count)
                 n++;
             }
         }
-        off = fdt_next_node(g_fdt, off, &depth);
     }
 
     *count = min_int(n, cap);
     return (n > cap) ? -FDT_ERR_NOSPACE : 0;
 }
 
+/*
+Wariant dtb_memory_regions bez limitów DTB_MAX_MEM_REGIONS i DTB_MAX_REGS na węzeł: pierwsze przejście
+po węzłach memory sumuje wpisy reg, drugie dekoduje je do tablicy przydzielonej z areny dokładnie na tę liczbę.
+*arr wskazuje tablicę w arenie, *count to liczba regionów. Zwraca -FDT_ERR_NOSPACE, gdy arena jest za mała.
+*/
+int dtb_memory_regions_alloc(dtb_arena_t *arena, dtb_addr_t **arr, int *count)
+{
+    int err;
+    int off;
+    int total = 0;
+    int n = 0;
+
+    err = dtb_require_init();
+    if (err)
+        return err;
+
+    if (!arena || !arr || !count)
+        return -FDT_ERR_BADVALUE;
+
+    for (off = node_next(-1); off >= 0; off = node_next(off)) {
+        if (node_is_memory(off))
+            total += reg_entry_count(off);
+    }
+
+    err = arena_array(arena, total, sizeof(dtb_addr_t), (void **)arr);
+    if (err)
+        return err;
+
+    for (off = node_next(-1); off >= 0 && n < total; off = node_next(off)) {
+        int reg_count = 0;
+
+        if (!node_is_memory(off))
+            continue;
+
+        err = decode_reg_list(off, *arr + n, total - n, &reg_count);
+        if (err && err != -FDT_ERR_NOSPACE)
+            return err;
+        n += reg_count;
+    }
+
+    *count = n;
+    return 0;
+}
+
 /*
 Zbiera wszystkie regiony zarezerwowanej pamięci z podwęzłów /reserved-memory w drzewie DTB.
 Iteruje po podwęzłach /reserved-memory i dla każdego wywołuje decode_reg_list, żeby odczytać zakresy adresowe.
@@ -1294,13 +2985,13 @@ int dtb_reserved_memory_regions(dtb_addr_t *arr, int cap, int *count)
     if (!arr || !count || cap < 0)
         return -FDT_ERR_BADVALUE;
 
-    rmem = fdt_path_offset(g_fdt, "/reserved-memory");
+    rmem = root_child(g_dtb_index.reserved_memory, "/reserved-memory");
     if (rmem < 0)
         return rmem;
 
-    for (sub = fdt_first_subnode(g_fdt, rmem);
+    for (sub = node_first_child(rmem);
          sub >= 0;
-         sub = fdt_next_subnode(g_fdt, sub)) {
+         sub = node_next_sibling(sub)) {
         dtb_addr_t regs[DTB_MAX_REGS];
         int reg_count = 0;
         int i;
@@ -1367,9 +3058,9 @@ int dtb_uart_ns16550a(int *node, uint64_t *base, uint64_t *size)
     if (!node || !base || !size)
         return -FDT_ERR_BADVALUE;
 
-    uart = fdt_node_offset_by_compatible(g_fdt, -1, "ns16550a");
+    uart = node_find_compatible(-1, "ns16550a");
     if (uart < 0)
-        uart = fdt_node_offset_by_compatible(g_fdt, -1, "ns16550");
+        uart = node_find_compatible(-1, "ns16550");
     if (uart < 0)
         return uart;
 
@@ -1377,6 +3068,10 @@ int dtb_uart_ns16550a(int *node, uint64_t *base, uint64_t *size)
     if (err)
         return err;
 
+    err = dtb_translate_reg(uart, *base, base);
+    if (err)
+        return err;
+
     *node = uart;
     return 0;
 }
@@ -1404,7 +3099,7 @@ int dtb_chosen_stdout(int *node)
     if (!node)
         return -FDT_ERR_BADVALUE;
 
-    chosen = fdt_path_offset(g_fdt, "/chosen");
+    chosen = root_child(g_dtb_index.chosen, "/chosen");
     if (chosen < 0)
         return chosen;
 
@@ -1482,21 +3177,21 @@ int dtb_bus_info(int node, int *addr_cells, int *size_cells, int *has_ranges)
     if (!addr_cells || !size_cells || !has_ranges)
         return -FDT_ERR_BADVALUE;
 
-    *addr_cells = fdt_address_cells(g_fdt, node);
+    *addr_cells = node_addr_cells(node);
     if (*addr_cells < 0)
         return *addr_cells;
 
-    *size_cells = fdt_size_cells(g_fdt, node);
+    *size_cells = node_size_cells(node);
     if (*size_cells < 0)
         return *size_cells;
 
-    *has_ranges = prop_exists(node, "ranges") ? 1 : 0;
+    *has_ranges = node_has_ranges(node);
     return 0;
 }
 
 /*
 Iteruje po bezpośrednich podwęzłach węzła magistrali bus_node.
-Gdy *child_node < 0, zwraca pierwszy podwęzeł przez fdt_first_subnode; w przeciwnym razie zwraca następny przez fdt_next_subnode.
+Gdy *child_node < 0, zwraca pierwszy podwęzeł (node_first_child); w przeciwnym razie zwraca następny (node_next_sibling) – z indeksem bez skanowania bloba.
 Aktualizuje *child_node i zwraca 0 przy sukcesie, lub kod błędu libfdt (np. -FDT_ERR_NOTFOUND) gdy nie ma więcej podwęzłów.
 Używana do przeglądania urządzeń podłączonych do konkretnej magistrali (np. simple-bus) bez rekurencji w głąb drzewa.
 */
@@ -1510,9 +3205,9 @@ int dtb_bus_walk(int bus_node, int *child_node)
         return -FDT_ERR_BADVALUE;
 
     if (*child_node < 0)
-        *child_node = fdt_first_subnode(g_fdt, bus_node);
+        *child_node = node_first_child(bus_node);
     else
-        *child_node = fdt_next_subnode(g_fdt, *child_node);
+        *child_node = node_next_sibling(*child_node);
 
     return (*child_node < 0) ? *child_node : 0;
 }
@@ -17,6 +17,19 @@ DTB zawiera więcej wpisów, nadmiar jest ignorowany (funkcje zwracają
 #define DTB_MAX_CPUS 16
 #define DTB_MAX_MEM_REGIONS 32
 #define DTB_MAX_INTC 8
+#define DTB_MAX_PHANDLE_ARGS 8
+
+/*
+Indeks drzewa („rozpłaszczona” tablica węzłów z indeksami rodzica/dziecka/rodzeństwa,
+rozwiązanymi #address-cells/#size-cells i rozbitymi listami compatible) buduje
+dtb_index_init w arenie wołającego, z tablicami policzonymi pod konkretny blob.
+Bez indeksu (brak areny, za mała arena, drzewo głębsze niż DTB_INDEX_MAX_DEPTH)
+moduł przeszukuje blob przez libfdt, więc limit wpływa tylko na wydajność.
+Można go nadpisać z linii poleceń kompilatora (-DDTB_INDEX_MAX_DEPTH=...).
+*/
+#ifndef DTB_INDEX_MAX_DEPTH
+#define DTB_INDEX_MAX_DEPTH 32
+#endif
 
 
 /*
@@ -67,6 +80,29 @@ typedef struct {
     uint32_t gpios[DTB_MAX_REFS];
     int gpio_count;
 } dtb_device_t;
+/*
+dtb_device_dyn_t to ten sam opis urządzenia co dtb_device_t, ale tablice regs, irqs i referencji
+są wskaźnikami do areny o długości dokładnie *_count (0 → wskaźnik 0). Wypełnia ją
+dtb_device_read_alloc, więc nie ma limitów DTB_MAX_* ani kopiowania dużej struktury po stosie.
+*/
+typedef struct {
+    int node;
+    const char *name;
+    const char *compatible;
+    dtb_addr_t *regs;
+    int reg_count;
+    dtb_irq_t *irqs;
+    int irq_count;
+    uint32_t *clocks;
+    int clock_count;
+    uint32_t *resets;
+    int reset_count;
+    uint32_t *dmas;
+    int dma_count;
+    uint32_t *gpios;
+    int gpio_count;
+} dtb_device_dyn_t;
+
 /*
 dtb_cpu_t (dtb.h (lines 46-54)) zawiera informacje z węzłów /cpus: hartid
 (z reg), stringi isa, mmu-type, riscv,isa, flagę svinval (obecność riscv,svinval)
@@ -82,6 +118,18 @@ typedef struct {
 } dtb_cpu_t;
 
 
+/*
+dtb_phandle_args_t to jeden rozłożony wpis listy referencji (clocks, resets, dmas, ...):
+phandle, offset węzła dostawcy (node) i argumenty w liczbie podanej przez #*-cells dostawcy.
+Wypełniana przez dtb_parse_phandle_with_args.
+*/
+typedef struct {
+    int node;
+    uint32_t phandle;
+    uint32_t args_count;
+    uint32_t args[DTB_MAX_PHANDLE_ARGS];
+} dtb_phandle_args_t;
+
 /*
 dtb_intc_t (dtb.h (lines 56-63)) opisuje kontroler przerwań: offset,
 typ, phandle, liczbę komórek interrupt-cells i jego własne regiony MMIO (regs).
@@ -98,19 +146,40 @@ typedef struct {
     int reg_count;
 } dtb_intc_t;
 
+/*
+dtb_arena_t to prosta arena typu bump: bufor base o rozmiarze size, z którego kolejne
+przydziały są wycinane od used w górę. Używana przez dtb_devices_collect, żeby zwrócić
+tablicę rekordów o długości równej faktycznej liczbie urządzeń, bez alokatora jądra.
+*/
+typedef struct {
+    uint8_t *base;
+    uint64_t size;
+    uint64_t used;
+} dtb_arena_t;
+
 int dtb_init(void *dtb);
+int dtb_index_init(dtb_arena_t *arena);
+int dtb_index_size(uint64_t *bytes);
 const void *dtb_get(void);
+void dtb_arena_init(dtb_arena_t *arena, void *base, uint64_t size);
+void *dtb_arena_alloc(dtb_arena_t *arena, uint64_t size, uint64_t align);
 
 int dtb_node_addr_cells(int node, int *cells);
 int dtb_node_size_cells(int node, int *cells);
 int dtb_decode_reg(int node, int index, uint64_t *base, uint64_t *size);
 int dtb_translate_ranges(int node, uint64_t child_addr, uint64_t *cpu_addr);
+int dtb_translate_reg(int node, uint64_t addr, uint64_t *cpu_addr);
+int dtb_decode_reg_cpu(int node, int index, uint64_t *base, uint64_t *size);
 
 int dtb_device_first(int *node);
 int dtb_device_next(int *node);
 int dtb_device_read(int node, dtb_device_t *out);
+int dtb_devices_collect(dtb_arena_t *arena, dtb_device_t **devices, int *count);
+int dtb_device_read_alloc(dtb_arena_t *arena, int node, dtb_device_dyn_t *out);
 int dtb_find_compatible(const char *compat, int *node);
 int dtb_find_compatible_n(const char *compat, int start_node, int *node);
+int dtb_compat_id(const char *compat, int *id);
+int dtb_find_compatible_id(int id, int start_node, int *node);
 
 int dtb_interrupt_controller_read(int node, dtb_intc_t *out);
 int dtb_interrupt_controllers_scan(dtb_intc_t *arr, int cap, int *count);
@@ -124,14 +193,20 @@ int dtb_get_u32(int node, const char *prop, uint32_t *out);
 int dtb_get_clock_frequency(int node, uint64_t *freq);
 int dtb_get_device_clocks(int node, uint32_t *clks, int cap, int *count);
 int dtb_get_timer_node(int *node);
+int dtb_node_by_phandle(uint32_t phandle, int *node);
+int dtb_parse_phandle_with_args(int node, const char *list_name, const char *cells_name,
+                                int index, dtb_phandle_args_t *out);
 
 int dtb_get_cpu_count(int *count);
 int dtb_cpu_read(int cpu_node, dtb_cpu_t *out);
 int dtb_cpu_list(dtb_cpu_t *arr, int cap, int *count);
+int dtb_cpu_list_alloc(dtb_arena_t *arena, dtb_cpu_t **arr, int *count);
 int dtb_cpu_find_hart(uint32_t hartid, int *cpu_node);
+int dtb_cpu_has_ext(const dtb_cpu_t *cpu, const char *ext);
 
 int dtb_get_memory(uint64_t *base, uint64_t *size);
 int dtb_memory_regions(dtb_addr_t *arr, int cap, int *count);
+int dtb_memory_regions_alloc(dtb_arena_t *arena, dtb_addr_t **arr, int *count);
 int dtb_reserved_memory_regions(dtb_addr_t *arr, int cap, int *count);
 int dtb_memory_total(uint64_t *bytes);
 
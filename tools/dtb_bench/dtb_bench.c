@@ -0,0 +1,462 @@
+/*
+    Host-side benchmark modułu libs/dtb.
+
+    Generuje syntetyczne drzewa DTB (fdt_sw z libfdt) o zadanej liczbie węzłów,
+    z zagnieżdżonymi magistralami (ranges), wieloma phandle (zegary, kontroler
+    przerwań) i wieloma bankami pamięci, a następnie mierzy opóźnienie i
+    przepustowość publicznych zapytań dtb_*.
+
+    Budowanie: make dtb-bench (host gcc, te same źródła libfdt co jądro).
+    Użycie:    ./dtb_bench [-d głębokość] [-m banki] [-s próbki] [węzły ...]
+    Domyślnie: 1000 10000 100000 węzłów.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libfdt.h>
+#include <dtb.h>
+
+#define BENCH_COMPAT_KINDS 64
+#define BENCH_CLOCKS 32
+#define BENCH_PLIC_PHANDLE 1
+#define BENCH_CLOCK_PHANDLE0 16
+#define BENCH_DEVICE_PHANDLE0 1024
+#define BENCH_BUS_WINDOW 0x10000000ULL
+#define BENCH_DEVICE_STRIDE 0x1000ULL
+#define BENCH_FIND_QUERIES 2000
+#define BENCH_REPEAT 20
+
+typedef struct {
+    int nodes;
+    int depth;
+    int mem_banks;
+    int samples;
+} bench_cfg_t;
+
+/*
+Stan generatora: bieżący blob (fdt_sw), licznik węzłów i kolejne phandle urządzeń.
+*/
+typedef struct {
+    void *fdt;
+    int nodes;
+    uint32_t next_phandle;
+} synth_t;
+
+static char g_compat_names[BENCH_COMPAT_KINDS][32];
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/*
+Zapisuje właściwość z listą komórek u32 (w kolejności big-endian, jak w DTB).
+*/
+static int prop_cells(void *fdt, const char *name, const uint32_t *cells, int count)
+{
+    fdt32_t buf[8];
+    int i;
+
+    for (i = 0; i < count; i++)
+        buf[i] = cpu_to_fdt32(cells[i]);
+    return fdt_property(fdt, name, buf, count * (int)sizeof(fdt32_t));
+}
+
+static int prop_u32(void *fdt, const char *name, uint32_t val)
+{
+    return prop_cells(fdt, name, &val, 1);
+}
+
+static int begin_node(synth_t *s, const char *fmt, uint64_t unit)
+{
+    char name[64];
+
+    snprintf(name, sizeof(name), fmt, (unsigned long long)unit);
+    s->nodes++;
+    return fdt_begin_node(s->fdt, name);
+}
+
+/*
+Jedno urządzenie na magistrali z #address-cells = #size-cells = 1: compatible z jednej z
+BENCH_COMPAT_KINDS rodzin, reg, dwa przerwania, referencja do zegara i własne phandle.
+*/
+static int synth_device(synth_t *s, int idx, uint32_t base)
+{
+    const char *kind = g_compat_names[idx % BENCH_COMPAT_KINDS];
+    char compat[64];
+    uint32_t reg[2] = { base, (uint32_t)BENCH_DEVICE_STRIDE };
+    uint32_t irqs[2] = { (uint32_t)(idx % 1000) + 1, (uint32_t)(idx % 1000) + 2 };
+    uint32_t clk = BENCH_CLOCK_PHANDLE0 + (uint32_t)(idx % BENCH_CLOCKS);
+    int len = (int)strlen(kind) + 1;
+    int err = 0;
+
+    memcpy(compat, kind, (size_t)len);
+    memcpy(compat + len, "bench,generic", sizeof("bench,generic"));
+
+    err |= begin_node(s, "dev@%llx", base);
+    err |= fdt_property(s->fdt, "compatible", compat, len + (int)sizeof("bench,generic"));
+    err |= prop_cells(s->fdt, "reg", reg, 2);
+    err |= prop_cells(s->fdt, "interrupts", irqs, 2);
+    err |= prop_u32(s->fdt, "clocks", clk);
+    err |= prop_u32(s->fdt, "phandle", s->next_phandle++);
+    if (idx % 17 == 0)
+        err |= fdt_property_string(s->fdt, "status", "disabled");
+    err |= fdt_end_node(s->fdt);
+    return err;
+}
+
+/*
+Łańcuch depth magistral simple-bus; każda tłumaczy swoje okno [0, BENCH_BUS_WINDOW) na
+adres parent_base w przestrzeni rodzica. Urządzenia wiszą na najgłębszym poziomie.
+parent_cells to #address-cells rodzica pierwszej magistrali (2 dla /soc, potem 1).
+*/
+static int synth_bus_chain(synth_t *s, int depth, int parent_cells, uint64_t parent_base,
+                           int first_dev, int dev_count)
+{
+    uint32_t ranges[4];
+    int err = 0;
+    int i;
+
+    ranges[0] = 0;
+    if (parent_cells == 2) {
+        ranges[1] = (uint32_t)(parent_base >> 32);
+        ranges[2] = (uint32_t)parent_base;
+        ranges[3] = (uint32_t)BENCH_BUS_WINDOW;
+    } else {
+        ranges[1] = (uint32_t)parent_base;
+        ranges[2] = (uint32_t)BENCH_BUS_WINDOW;
+    }
+
+    err |= begin_node(s, "bus@%llx", parent_base);
+    err |= fdt_property_string(s->fdt, "compatible", "simple-bus");
+    err |= prop_u32(s->fdt, "#address-cells", 1);
+    err |= prop_u32(s->fdt, "#size-cells", 1);
+    err |= prop_cells(s->fdt, "ranges", ranges, parent_cells == 2 ? 4 : 3);
+
+    if (depth > 1) {
+        err |= synth_bus_chain(s, depth - 1, 1, 0, first_dev, dev_count);
+    } else {
+        for (i = 0; i < dev_count; i++)
+            err |= synth_device(s, first_dev + i, (uint32_t)((uint64_t)i * BENCH_DEVICE_STRIDE));
+    }
+
+    err |= fdt_end_node(s->fdt);
+    return err;
+}
+
+/*
+Buduje całe drzewo w buforze o rozmiarze size. Zwraca 0 albo kod błędu libfdt
+(-FDT_ERR_NOSPACE → wywołujący powiększa bufor).
+*/
+static int synth_tree(synth_t *s, const bench_cfg_t *cfg, void *buf, int size)
+{
+    int devices_per_group = 256;
+    int dev_total;
+    int groups;
+    int err = 0;
+    int i;
+
+    s->fdt = buf;
+    s->nodes = 0;
+    s->next_phandle = BENCH_DEVICE_PHANDLE0;
+
+    err |= fdt_create(buf, size);
+    err |= fdt_finish_reservemap(buf);
+    err |= fdt_begin_node(buf, "");
+    s->nodes++;
+    err |= prop_u32(buf, "#address-cells", 2);
+    err |= prop_u32(buf, "#size-cells", 2);
+    err |= fdt_property_string(buf, "compatible", "bench,synthetic");
+
+    err |= fdt_begin_node(buf, "chosen");
+    s->nodes++;
+    err |= fdt_end_node(buf);
+
+    err |= fdt_begin_node(buf, "cpus");
+    s->nodes++;
+    err |= prop_u32(buf, "#address-cells", 1);
+    err |= prop_u32(buf, "#size-cells", 0);
+    err |= prop_u32(buf, "timebase-frequency", 10000000);
+    for (i = 0; i < 4; i++) {
+        err |= begin_node(s, "cpu@%llx", (uint64_t)i);
+        err |= fdt_property_string(buf, "device_type", "cpu");
+        err |= fdt_property_string(buf, "compatible", "riscv");
+        err |= prop_u32(buf, "reg", (uint32_t)i);
+        err |= fdt_property_string(buf, "riscv,isa", "rv64imafdc");
+        err |= fdt_property_string(buf, "mmu-type", "riscv,sv39");
+        err |= fdt_end_node(buf);
+    }
+    err |= fdt_end_node(buf);
+
+    for (i = 0; i < cfg->mem_banks; i++) {
+        uint64_t base = 0x80000000ULL + (uint64_t)i * 0x40000000ULL;
+        uint32_t reg[4] = { (uint32_t)(base >> 32), (uint32_t)base, 0, 0x10000000 };
+
+        err |= begin_node(s, "memory@%llx", base);
+        err |= fdt_property_string(buf, "device_type", "memory");
+        err |= prop_cells(buf, "reg", reg, 4);
+        err |= fdt_end_node(buf);
+    }
+
+    err |= fdt_begin_node(buf, "soc");
+    s->nodes++;
+    err |= prop_u32(buf, "#address-cells", 2);
+    err |= prop_u32(buf, "#size-cells", 2);
+    err |= fdt_property_string(buf, "compatible", "simple-bus");
+    err |= fdt_property(buf, "ranges", 0, 0);
+    err |= prop_u32(buf, "interrupt-parent", BENCH_PLIC_PHANDLE);
+
+    {
+        uint32_t reg[4] = { 0, 0x0c000000, 0, 0x600000 };
+
+        err |= begin_node(s, "plic@%llx", 0x0c000000ULL);
+        err |= fdt_property_string(buf, "compatible", "riscv,plic0");
+        err |= fdt_property(buf, "interrupt-controller", 0, 0);
+        err |= prop_u32(buf, "#interrupt-cells", 1);
+        err |= prop_cells(buf, "reg", reg, 4);
+        err |= prop_u32(buf, "phandle", BENCH_PLIC_PHANDLE);
+        err |= fdt_end_node(buf);
+    }
+
+    for (i = 0; i < BENCH_CLOCKS; i++) {
+        err |= begin_node(s, "clock@%llx", (uint64_t)i);
+        err |= fdt_property_string(buf, "compatible", "fixed-clock");
+        err |= prop_u32(buf, "#clock-cells", 0);
+        err |= prop_u32(buf, "clock-frequency", 24000000);
+        err |= prop_u32(buf, "phandle", BENCH_CLOCK_PHANDLE0 + (uint32_t)i);
+        err |= fdt_end_node(buf);
+    }
+
+    dev_total = cfg->nodes - s->nodes;
+    if (dev_total < 1)
+        dev_total = 1;
+    groups = (dev_total + devices_per_group - 1) / devices_per_group;
+    for (i = 0; i < groups && !err; i++) {
+        int first = i * devices_per_group;
+        int count = dev_total - first;
+
+        if (count > devices_per_group)
+            count = devices_per_group;
+        err |= synth_bus_chain(s, cfg->depth, 2, 0x100000000ULL + (uint64_t)i * BENCH_BUS_WINDOW,
+                               first, count);
+    }
+
+    err |= fdt_end_node(buf);
+    err |= fdt_finish(buf);
+    return err ? -FDT_ERR_NOSPACE : 0;
+}
+
+static void *synth_blob(const bench_cfg_t *cfg, int *out_nodes)
+{
+    int size = cfg->nodes * 256 + 65536;
+    synth_t s;
+
+    for (;;) {
+        void *buf = malloc((size_t)size);
+
+        if (!buf)
+            return 0;
+        if (synth_tree(&s, cfg, buf, size) == 0) {
+            *out_nodes = s.nodes;
+            return buf;
+        }
+        free(buf);
+        size *= 2;
+    }
+}
+
+static void report(int nodes, const char *api, long ops, double ns)
+{
+    double per_op = ops ? ns / (double)ops : 0.0;
+
+    printf("nodes=%-7d api=%-28s ops=%-8ld total_ms=%10.3f ns_per_op=%12.1f ops_per_s=%12.0f\n",
+           nodes, api, ops, ns / 1e6, per_op, per_op > 0.0 ? 1e9 / per_op : 0.0);
+}
+
+/*
+Wybiera do samples urządzeń rozłożonych równomiernie po drzewie (dtb_device_first/next),
+żeby pomiary dtb_device_read/dtb_interrupt_map_device nie zależały tylko od początku drzewa.
+*/
+static int pick_devices(int *out, int samples)
+{
+    int total = 0;
+    int node;
+    int err;
+    int step;
+    int n = 0;
+    int i = 0;
+
+    for (err = dtb_device_first(&node); !err; err = dtb_device_next(&node))
+        total++;
+    if (!total)
+        return 0;
+
+    step = (total + samples - 1) / samples;
+    for (err = dtb_device_first(&node); !err && n < samples; err = dtb_device_next(&node), i++) {
+        if (i % step == 0)
+            out[n++] = node;
+    }
+    return n;
+}
+
+static void bench_one(const bench_cfg_t *cfg)
+{
+    static volatile long sink;
+    dtb_device_t dev;
+    dtb_irq_t irqs[DTB_MAX_IRQS];
+    dtb_addr_t *mem;
+    int *devices;
+    int dev_count;
+    int nodes = 0;
+    void *blob;
+    void *index_buf;
+    uint64_t index_size = 0;
+    double t0;
+    long ops;
+    int i;
+    int r;
+
+    blob = synth_blob(cfg, &nodes);
+    if (!blob) {
+        fprintf(stderr, "dtb_bench: cannot build %d-node tree\n", cfg->nodes);
+        return;
+    }
+
+    if (dtb_init(blob) || dtb_index_size(&index_size)) {
+        fprintf(stderr, "dtb_bench: dtb_init failed\n");
+        free(blob);
+        return;
+    }
+    index_buf = malloc((size_t)index_size);
+    if (!index_buf) {
+        free(blob);
+        return;
+    }
+
+    t0 = now_ns();
+    for (r = 0; r < BENCH_REPEAT; r++) {
+        dtb_arena_t arena;
+
+        dtb_arena_init(&arena, index_buf, index_size);
+        if (dtb_init(blob)) {
+            fprintf(stderr, "dtb_bench: dtb_init failed\n");
+            free(index_buf);
+            free(blob);
+            return;
+        }
+#ifndef BENCH_NO_INDEX
+        if (dtb_index_init(&arena)) {
+            fprintf(stderr, "dtb_bench: dtb_index_init failed\n");
+            free(index_buf);
+            free(blob);
+            return;
+        }
+#endif
+    }
+    report(nodes, "dtb_init+dtb_index_init", BENCH_REPEAT, now_ns() - t0);
+
+    t0 = now_ns();
+    for (i = 0; i < BENCH_FIND_QUERIES; i++) {
+        int node;
+        const char *compat = (i % 8 == 7) ? "bench,missing" : g_compat_names[i % BENCH_COMPAT_KINDS];
+
+        sink += dtb_find_compatible(compat, &node);
+    }
+    report(nodes, "dtb_find_compatible", BENCH_FIND_QUERIES, now_ns() - t0);
+
+    devices = calloc((size_t)cfg->samples, sizeof(*devices));
+    if (!devices) {
+        free(index_buf);
+        free(blob);
+        return;
+    }
+    dev_count = pick_devices(devices, cfg->samples);
+
+    t0 = now_ns();
+    for (i = 0; i < dev_count; i++)
+        sink += dtb_device_read(devices[i], &dev);
+    report(nodes, "dtb_device_read", dev_count, now_ns() - t0);
+
+    t0 = now_ns();
+    for (i = 0; i < dev_count; i++) {
+        int count;
+
+        sink += dtb_interrupt_map_device(devices[i], irqs, DTB_MAX_IRQS, &count);
+    }
+    report(nodes, "dtb_interrupt_map_device", dev_count, now_ns() - t0);
+
+    mem = calloc((size_t)cfg->mem_banks, sizeof(*mem));
+    if (mem) {
+        ops = 0;
+        t0 = now_ns();
+        for (r = 0; r < BENCH_REPEAT; r++) {
+            int count;
+
+            sink += dtb_memory_regions(mem, cfg->mem_banks, &count);
+            ops++;
+        }
+        report(nodes, "dtb_memory_regions", ops, now_ns() - t0);
+        free(mem);
+    }
+
+    free(devices);
+    free(index_buf);
+    free(blob);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: dtb_bench [-d depth] [-m mem_banks] [-s samples] [nodes ...]\n");
+}
+
+int main(int argc, char **argv)
+{
+    static const int defaults[] = { 1000, 10000, 100000 };
+    bench_cfg_t cfg = { 0, 4, 8, 2000 };
+    int sizes[64];
+    int size_count = 0;
+    int i;
+
+    for (i = 0; i < BENCH_COMPAT_KINDS; i++)
+        snprintf(g_compat_names[i], sizeof(g_compat_names[i]), "bench,dev%d", i);
+
+    for (i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "-m") == 0 ||
+             strcmp(argv[i], "-s") == 0) && i + 1 < argc) {
+            int val = atoi(argv[i + 1]);
+
+            if (val <= 0) {
+                usage();
+                return 1;
+            }
+            if (argv[i][1] == 'd')
+                cfg.depth = val;
+            else if (argv[i][1] == 'm')
+                cfg.mem_banks = val;
+            else
+                cfg.samples = val;
+            i++;
+        } else if (argv[i][0] != '-' && size_count < 64) {
+            sizes[size_count++] = atoi(argv[i]);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (!size_count) {
+        for (i = 0; i < 3; i++)
+            sizes[size_count++] = defaults[i];
+    }
+
+    for (i = 0; i < size_count; i++) {
+        cfg.nodes = sizes[i];
+        bench_one(&cfg);
+    }
+
+    return 0;
+}
@@ -0,0 +1,244 @@
+/*
+    Host-side prekompilacja DTB do statycznego opisu platformy.
+
+    Wczytuje blob .dtb i uruchamia na nim te same ekstrakcje co jądro przy starcie:
+    platform_probe_dtb (hw_state_t), uart_console_probe_from_dtb (uart_console_info_t)
+    i mm_dtb_regions_collect (RAM, /reserved-memory, MMIO). Wynik zapisuje jako plik C
+    ze stałą g_platform_desc (kernel/platform_desc.h), który ląduje w .rodata jądra.
+    Opis jest ważny tylko dla bloba o identycznym hashu, więc .dtb musi być dokładnie
+    tym, co firmware przekazuje jądru (po fixupach OpenSBI).
+
+    Budowanie: make dtb-precompile, albo pośrednio make kernel PLATFORM_DTB=board.dtb.
+    Użycie:    ./dtb_precompile [-H hartid] [-o wyjście.c] board.dtb
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libfdt.h>
+#include <dtb/dtb.h>
+#include <uart/uart_console.h>
+#include <platform_init.h>
+#include <memory_map.h>
+#include <platform_desc.h>
+
+#define PRECOMPILE_RESERVED_CAP 4096
+#define PRECOMPILE_ARENA_SIZE 0x10000ULL
+
+/* Symbole linkera jądra, do których odwołują się memory_map.c i memblock.c.
+   Narzędzie woła tylko mm_dtb_regions_collect, które z nich nie korzysta. */
+char _kernel_start[1];
+char _kernel_image_end[1];
+
+static uint64_t g_arena_buf[PRECOMPILE_ARENA_SIZE / sizeof(uint64_t)];
+static mm_region_t g_reserved[PRECOMPILE_RESERVED_CAP];
+
+/*
+Wczytuje cały plik do pamięci; *size dostaje liczbę wczytanych bajtów.
+*/
+static void *read_file(const char *path, long *size)
+{
+    FILE *f = fopen(path, "rb");
+    void *buf;
+    long len;
+
+    if (!f)
+        return 0;
+    if (fseek(f, 0, SEEK_END) || (len = ftell(f)) <= 0 || fseek(f, 0, SEEK_SET)) {
+        fclose(f);
+        return 0;
+    }
+
+    buf = malloc((size_t)len);
+    if (buf && fread(buf, 1, (size_t)len, f) != (size_t)len) {
+        free(buf);
+        buf = 0;
+    }
+    fclose(f);
+
+    *size = len;
+    return buf;
+}
+
+/*
+Wypisuje literał napisu C; znaki spoza drukowalnego ASCII idą jako sekwencje ósemkowe.
+*/
+static void emit_string(FILE *out, const char *s)
+{
+    if (!s) {
+        fputs("0", out);
+        return;
+    }
+
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+
+        if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if (c < 0x20 || c > 0x7e)
+            fprintf(out, "\\%03o", c);
+        else
+            fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+static void emit_regions(FILE *out, const char *name, const mm_region_t *arr, int count)
+{
+    int i;
+
+    if (!count)
+        return;
+
+    fprintf(out, "static const mm_region_t %s[%d] = {\n", name, count);
+    for (i = 0; i < count; i++) {
+        fprintf(out, "    { 0x%llxULL, 0x%llxULL, 0x%02x, 0x%04x, ",
+                (unsigned long long)arr[i].start, (unsigned long long)arr[i].end,
+                arr[i].pte_flags, arr[i].protect_flags);
+        emit_string(out, arr[i].source);
+        fputs(" },\n", out);
+    }
+    fputs("};\n\n", out);
+}
+
+static void emit_desc(FILE *out, const char *dtb_path, uint64_t hash, uint32_t size,
+                      const hw_state_t *hw, const uart_console_info_t *uart,
+                      const mm_region_t *ram, int ram_count,
+                      const mm_region_t *reserved, int reserved_count)
+{
+    fputs("/* Wygenerowane przez tools/dtb_precompile z ", out);
+    fputs(dtb_path, out);
+    fputs(" -- nie edytować. */\n", out);
+    fputs("#include <platform_desc.h>\n\n", out);
+
+    emit_regions(out, "g_platform_desc_ram", ram, ram_count);
+    emit_regions(out, "g_platform_desc_reserved", reserved, reserved_count);
+
+    fputs("const platform_desc_t g_platform_desc = {\n", out);
+    fprintf(out, "    .dtb_hash = 0x%016llxULL,\n", (unsigned long long)hash);
+    fprintf(out, "    .dtb_size = %u,\n", size);
+    fputs("    .hw = {\n", out);
+    fprintf(out, "        .boot_hartid = %u,\n", hw->boot_hartid);
+    fprintf(out, "        .boot_cpu_node = %d,\n", hw->boot_cpu_node);
+    fprintf(out, "        .cpu_count = %d,\n", hw->cpu_count);
+    fprintf(out, "        .mem_base = 0x%llxULL,\n", (unsigned long long)hw->mem_base);
+    fprintf(out, "        .mem_size = 0x%llxULL,\n", (unsigned long long)hw->mem_size);
+    fprintf(out, "        .mem_total = 0x%llxULL,\n", (unsigned long long)hw->mem_total);
+    fprintf(out, "        .timebase_hz = %u,\n", hw->timebase_hz);
+    fprintf(out, "        .timer_node = %d,\n", hw->timer_node);
+    fprintf(out, "        .plic_node = %d,\n", hw->plic_node);
+    fprintf(out, "        .clint_node = %d,\n", hw->clint_node);
+    fprintf(out, "        .imsic_node = %d,\n", hw->imsic_node);
+    fputs("    },\n", out);
+    fputs("    .uart = {\n", out);
+    fprintf(out, "        .node = %d,\n", uart->node);
+    fprintf(out, "        .base = 0x%llxULL,\n", (unsigned long long)uart->base);
+    fprintf(out, "        .size = 0x%llxULL,\n", (unsigned long long)uart->size);
+    fprintf(out, "        .input_clock_hz = %lluULL,\n", (unsigned long long)uart->input_clock_hz);
+    fprintf(out, "        .baud_rate = %u,\n", uart->baud_rate);
+    fprintf(out, "        .reg_shift = %u,\n", uart->reg_shift);
+    fprintf(out, "        .reg_io_width = %u,\n", uart->reg_io_width);
+    fputs("    },\n", out);
+    fprintf(out, "    .ram = %s,\n", ram_count ? "g_platform_desc_ram" : "0");
+    fprintf(out, "    .ram_count = %d,\n", ram_count);
+    fprintf(out, "    .reserved = %s,\n", reserved_count ? "g_platform_desc_reserved" : "0");
+    fprintf(out, "    .reserved_count = %d,\n", reserved_count);
+    fputs("};\n", out);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: dtb_precompile [-H hartid] [-o out.c] board.dtb\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *out_path = 0;
+    const char *dtb_path = 0;
+    unsigned long hartid = 0;
+    hw_state_t hw;
+    uart_console_info_t uart;
+    dtb_arena_t arena;
+    mm_region_t *ram = 0;
+    int ram_count = 0;
+    mm_region_buf_t reserved = { g_reserved, 0, PRECOMPILE_RESERVED_CAP, 0 };
+    void *blob;
+    long blob_len = 0;
+    uint32_t size;
+    FILE *out;
+    int err;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-H") == 0 && i + 1 < argc) {
+            hartid = strtoul(argv[++i], 0, 0);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (argv[i][0] != '-' && !dtb_path) {
+            dtb_path = argv[i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (!dtb_path) {
+        usage();
+        return 1;
+    }
+
+    blob = read_file(dtb_path, &blob_len);
+    if (!blob || blob_len < (long)sizeof(struct fdt_header) || fdt_check_header(blob)) {
+        fprintf(stderr, "dtb_precompile: %s: not a valid DTB\n", dtb_path);
+        return 1;
+    }
+
+    size = fdt_totalsize(blob);
+    if ((long)size > blob_len) {
+        fprintf(stderr, "dtb_precompile: %s: truncated DTB\n", dtb_path);
+        return 1;
+    }
+
+    err = dtb_init(blob);
+    if (err) {
+        fprintf(stderr, "dtb_precompile: dtb_init: %s\n", fdt_strerror(err));
+        return 1;
+    }
+
+    memset(&hw, 0, sizeof(hw));
+    err = platform_probe_dtb(&hw, hartid);
+    if (err) {
+        fprintf(stderr, "dtb_precompile: %s\n", platform_strerror(err));
+        return 1;
+    }
+
+    err = uart_console_probe_from_dtb(&uart);
+    if (err) {
+        fprintf(stderr, "dtb_precompile: %s\n", uart_console_strerror(err));
+        return 1;
+    }
+
+    dtb_arena_init(&arena, g_arena_buf, sizeof(g_arena_buf));
+    err = mm_dtb_regions_collect(&arena, &ram, &ram_count, &reserved);
+    if (err) {
+        fprintf(stderr, "dtb_precompile: mm_dtb_regions_collect failed (%d)\n", err);
+        return 1;
+    }
+
+    out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "dtb_precompile: cannot write %s\n", out_path);
+        return 1;
+    }
+
+    emit_desc(out, dtb_path, platform_desc_hash(blob, size), size, &hw, &uart,
+              ram, ram_count, reserved.regions, reserved.count);
+
+    if (out != stdout && fclose(out)) {
+        fprintf(stderr, "dtb_precompile: cannot write %s\n", out_path);
+        return 1;
+    }
+
+    free(blob);
+    return 0;
+}